@@ -0,0 +1,354 @@
+/* The benchmark suite's workloads
+ *
+ * The demos print as they go and mix several things into one run, which
+ * is fine for reading them but not for tracking a number from one commit
+ * to the next. Each case here is one code path the notes cover, with a
+ * fixed input and no output:
+ *
+ *  alloc        malloc/free of small and mixed sizes, the string builder
+ *               and the rope (5.x)
+ *  sort_search  qsort and bsearch (9.2, 9.3)
+ *  hash_tree    hsearch_r and tsearch (9.5, 9.6)
+ *  string_codec UTF-8 validation and UTF-8 <-> UTF-32 (5.x, 6.x)
+ *  ctype        the ctype.h functions against the bulk tables and the wide
+ *               character cache (4.x)
+ *
+ * Inputs are built once by bench_cases_init from fixed seeds, so every run
+ * of every build sees the same data. Every case folds what it computed into
+ * bench_sink, so the compiler can't decide the work isn't needed.
+ * */
+#include "bench_cases.h"
+#include "04_bulk_ctype.h"
+#include "04_wctype_cache.h"
+#include "05_string_builder.h"
+#include "05_utf8.h"
+#include "06_utf_transcode.h"
+
+#include <stdio.h>      /* snprintf */
+#include <stdlib.h>     /* malloc, free, qsort, bsearch */
+#include <string.h>     /* memcpy, strcmp, strdup */
+#include <ctype.h>      /* isalpha, toupper */
+#include <search.h>     /* hsearch_r, tsearch */
+#include <locale.h>     /* setlocale */
+#include <uchar.h>      /* char32_t */
+#include <wchar.h>      /* wchar_t */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+
+/* sizes of the inputs */
+#ifndef BENCH_ALLOCS
+#define BENCH_ALLOCS 20000
+#endif
+#ifndef BENCH_SORT_LEN
+#define BENCH_SORT_LEN 100000
+#endif
+#ifndef BENCH_KEYS
+#define BENCH_KEYS 20000
+#endif
+#ifndef BENCH_TEXT_BYTES
+#define BENCH_TEXT_BYTES (1UL << 20)
+#endif
+
+static volatile size_t bench_sink;
+
+static struct {
+    size_t * alloc_sizes;       /* BENCH_ALLOCS of them, 16 bytes to 16k */
+    int * unsorted;             /* BENCH_SORT_LEN random ints */
+    int * sorted;
+    int * scratch;
+    char (*keys)[16];           /* BENCH_KEYS distinct strings */
+    char * text;                /* BENCH_TEXT_BYTES of UTF-8 */
+    char32_t * text32;          /* the text as UTF-32 */
+    size_t len32;
+    char * text8;
+    uint16_t * masks;
+    wchar_t * wtext;            /* the text as wide characters */
+    size_t wlen;
+    wctype_cache * wcache;
+} in;
+
+static unsigned long next_random(unsigned long * state)
+{
+    *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+    return *state >> 33;
+}
+
+static void * checked_malloc(size_t size)
+{
+    void * p = malloc(size);
+    if(p == NULL)
+        error(EXIT_FAILURE, errno, "benchmark input allocation failed");
+    return p;
+}
+
+static int compare_ints(const void * a, const void * b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+void bench_cases_init(void)
+{
+    unsigned long state = 2024;
+
+    in.alloc_sizes = checked_malloc(BENCH_ALLOCS * sizeof(size_t));
+    for(size_t i = 0; i < BENCH_ALLOCS; i++)
+        in.alloc_sizes[i] = 16 << (next_random(&state) % 11);
+
+    in.unsorted = checked_malloc(BENCH_SORT_LEN * sizeof(int));
+    in.sorted = checked_malloc(BENCH_SORT_LEN * sizeof(int));
+    in.scratch = checked_malloc(BENCH_SORT_LEN * sizeof(int));
+    for(size_t i = 0; i < BENCH_SORT_LEN; i++)
+        in.unsorted[i] = next_random(&state);
+    memcpy(in.sorted, in.unsorted, BENCH_SORT_LEN * sizeof(int));
+    qsort(in.sorted, BENCH_SORT_LEN, sizeof(int), compare_ints);
+
+    in.keys = checked_malloc(BENCH_KEYS * sizeof(*in.keys));
+    for(size_t i = 0; i < BENCH_KEYS; i++)
+        snprintf(in.keys[i], sizeof(in.keys[i]), "key%08lx%02zx",
+                next_random(&state) & 0xffffffff, i & 0xff);
+
+    in.text = utf8_bench_text(BENCH_TEXT_BYTES);
+    in.text32 = checked_malloc(BENCH_TEXT_BYTES * sizeof(char32_t));
+    size_t error_pos;
+    in.len32 = utf8_to_utf32(in.text, BENCH_TEXT_BYTES, in.text32,
+                &error_pos);
+    if(in.len32 == UTF_ERROR)
+        error(EXIT_FAILURE, 0, "benchmark text isn't valid UTF-8");
+    in.text8 = checked_malloc(4 * BENCH_TEXT_BYTES);
+    in.masks = checked_malloc(BENCH_TEXT_BYTES * sizeof(uint16_t));
+
+    /* the wide character cases want a UTF-8 LC_CTYPE, the byte ones C */
+    char * saved = strdup(setlocale(LC_CTYPE, NULL));
+    if(setlocale(LC_CTYPE, "C.UTF-8") == NULL)
+        error(EXIT_FAILURE, 0, "the suite needs the C.UTF-8 locale");
+    in.wtext = checked_malloc((BENCH_TEXT_BYTES + 1) * sizeof(wchar_t));
+    in.wlen = mbstowcs(in.wtext, in.text, BENCH_TEXT_BYTES + 1);
+    if(in.wlen == (size_t)-1)
+        error(EXIT_FAILURE, errno, "benchmark text isn't valid UTF-8");
+    in.wcache = wctype_cache_create();
+    if(in.wcache == NULL)
+        error(EXIT_FAILURE, 0, "wctype_cache_create failed");
+    setlocale(LC_CTYPE, saved);
+    free(saved);
+    ctype_bulk_init();
+}
+
+void bench_cases_release(void)
+{
+    wctype_cache_destroy(in.wcache);
+    free(in.wtext);
+    free(in.masks);
+    free(in.text8);
+    free(in.text32);
+    free(in.text);
+    free(in.keys);
+    free(in.scratch);
+    free(in.sorted);
+    free(in.unsorted);
+    free(in.alloc_sizes);
+}
+
+/* ===== alloc ===== */
+
+/* all of them, then all freed, newest first */
+static void alloc_small(void)
+{
+    static void * blocks[BENCH_ALLOCS];
+    for(size_t i = 0; i < BENCH_ALLOCS; i++)
+    {
+        blocks[i] = malloc(16 + (i & 0x7f));
+        *(char *)blocks[i] = i;
+    }
+    for(size_t i = BENCH_ALLOCS; i-- > 0; )
+        free(blocks[i]);
+}
+
+/* sizes 16 bytes to 16k, each freed some time after, like a real program */
+static void alloc_mixed(void)
+{
+    enum { LIVE = 256 };
+    void * live[LIVE] = { 0 };
+    for(size_t i = 0; i < BENCH_ALLOCS; i++)
+    {
+        size_t slot = (i * 97) % LIVE;
+        free(live[slot]);
+        live[slot] = malloc(in.alloc_sizes[i]);
+        *(char *)live[slot] = i;
+    }
+    for(size_t i = 0; i < LIVE; i++)
+        free(live[i]);
+}
+
+static void alloc_strbuf(void)
+{
+    strbuf sb;
+    strbuf_init(&sb);
+    for(size_t i = 0; i < BENCH_KEYS; i++)
+        strbuf_append(&sb, in.keys[i], 13);
+    bench_sink += sb.len;
+    strbuf_free(&sb);
+}
+
+static void alloc_rope(void)
+{
+    rope r;
+    rope_init(&r);
+    for(size_t i = 0; i < BENCH_KEYS; i++)
+        rope_append(&r, in.keys[i], 13);
+    bench_sink += r.len;
+    rope_free(&r);
+}
+
+/* ===== sort_search ===== */
+
+static void sort_qsort(void)
+{
+    memcpy(in.scratch, in.unsorted, BENCH_SORT_LEN * sizeof(int));
+    qsort(in.scratch, BENCH_SORT_LEN, sizeof(int), compare_ints);
+    bench_sink += in.scratch[BENCH_SORT_LEN / 2];
+}
+
+/* every value in the array, looked up in a random order */
+static void search_bsearch(void)
+{
+    size_t found = 0;
+    for(size_t i = 0; i < BENCH_SORT_LEN; i++)
+        found += bsearch(&in.unsorted[i], in.sorted, BENCH_SORT_LEN,
+                    sizeof(int), compare_ints) != NULL;
+    bench_sink += found;
+}
+
+/* ===== hash_tree ===== */
+
+static void hash_hsearch(void)
+{
+    struct hsearch_data table = { 0 };
+    if(hcreate_r(BENCH_KEYS * 2, &table) == 0)
+        error(EXIT_FAILURE, errno, "hcreate_r failed");
+    ENTRY item;
+    ENTRY * found;
+    for(size_t i = 0; i < BENCH_KEYS; i++)
+    {
+        item.key = in.keys[i];
+        item.data = (void *)i;
+        hsearch_r(item, ENTER, &found, &table);
+    }
+    size_t hits = 0;
+    for(size_t i = 0; i < BENCH_KEYS; i++)
+    {
+        item.key = in.keys[i];
+        hits += hsearch_r(item, FIND, &found, &table) != 0;
+    }
+    hdestroy_r(&table);
+    bench_sink += hits;
+}
+
+static int compare_keys(const void * a, const void * b)
+{
+    return strcmp(a, b);
+}
+
+/* the keys themselves are the nodes' data, tdestroy has nothing to free */
+static void no_free(void * node)
+{
+    (void)node;
+}
+
+static void tree_tsearch(void)
+{
+    void * root = NULL;
+    for(size_t i = 0; i < BENCH_KEYS; i++)
+        tsearch(in.keys[i], &root, compare_keys);
+    size_t hits = 0;
+    for(size_t i = 0; i < BENCH_KEYS; i++)
+        hits += tfind(in.keys[i], &root, compare_keys) != NULL;
+    tdestroy(root, no_free);
+    bench_sink += hits;
+}
+
+/* ===== string_codec ===== */
+
+static void codec_utf8_validate(void)
+{
+    bench_sink += utf8_validate(in.text, BENCH_TEXT_BYTES);
+}
+
+static void codec_utf8_count(void)
+{
+    bench_sink += utf8_count(in.text, BENCH_TEXT_BYTES);
+}
+
+/* into text8, text32 stays what the next case reads */
+static void codec_utf8_to_utf32(void)
+{
+    size_t error_pos;
+    bench_sink += utf8_to_utf32(in.text, BENCH_TEXT_BYTES,
+                    (char32_t *)in.text8, &error_pos);
+}
+
+static void codec_utf32_to_utf8(void)
+{
+    size_t error_pos;
+    bench_sink += utf32_to_utf8(in.text32, in.len32, in.text8, &error_pos);
+}
+
+/* ===== ctype ===== */
+
+static void ctype_isalpha_loop(void)
+{
+    size_t n = 0;
+    for(size_t i = 0; i < BENCH_TEXT_BYTES; i++)
+        n += isalpha((unsigned char)in.text[i]) != 0;
+    bench_sink += n;
+}
+
+static void ctype_bulk_alpha(void)
+{
+    size_t counts[CTYPE_NUM_CLASSES];
+    ctype_bulk_count(in.text, BENCH_TEXT_BYTES, counts);
+    bench_sink += counts[CTYPE_ALPHA];
+}
+
+static void ctype_toupper_loop(void)
+{
+    for(size_t i = 0; i < BENCH_TEXT_BYTES; i++)
+        in.text8[i] = toupper((unsigned char)in.text[i]);
+    bench_sink += in.text8[BENCH_TEXT_BYTES / 2];
+}
+
+static void ctype_bulk_upper(void)
+{
+    ctype_bulk_toupper(in.text8, in.text, BENCH_TEXT_BYTES);
+    bench_sink += in.text8[BENCH_TEXT_BYTES / 2];
+}
+
+static void ctype_wcache_classify(void)
+{
+    wcache_classify(in.wcache, in.wtext, in.wlen, in.masks);
+    bench_sink += in.masks[in.wlen / 2];
+}
+
+#define CASE(group, fn) { #group, #fn, fn }
+
+const bench_case bench_cases[] = {
+    CASE(alloc, alloc_small),
+    CASE(alloc, alloc_mixed),
+    CASE(alloc, alloc_strbuf),
+    CASE(alloc, alloc_rope),
+    CASE(sort_search, sort_qsort),
+    CASE(sort_search, search_bsearch),
+    CASE(hash_tree, hash_hsearch),
+    CASE(hash_tree, tree_tsearch),
+    CASE(string_codec, codec_utf8_validate),
+    CASE(string_codec, codec_utf8_count),
+    CASE(string_codec, codec_utf8_to_utf32),
+    CASE(string_codec, codec_utf32_to_utf8),
+    CASE(ctype, ctype_isalpha_loop),
+    CASE(ctype, ctype_bulk_alpha),
+    CASE(ctype, ctype_toupper_loop),
+    CASE(ctype, ctype_bulk_upper),
+    CASE(ctype, ctype_wcache_classify),
+};
+const size_t bench_num_cases = sizeof(bench_cases) / sizeof(bench_cases[0]);
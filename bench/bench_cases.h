@@ -0,0 +1,21 @@
+#ifndef BENCH_CASES_H
+#define BENCH_CASES_H
+
+#include <stddef.h> /* size_t */
+
+/* one timed workload of the suite. run does the same fixed amount of work
+ * every call, so its times can be compared run to run and build to build */
+typedef struct _bench_case {
+    const char * group;     /* alloc, sort_search, hash_tree, ... */
+    const char * name;
+    void (*run)(void);
+} bench_case;
+
+extern const bench_case bench_cases[];
+extern const size_t bench_num_cases;
+
+/* builds the inputs every case reads, call once before running any */
+void bench_cases_init(void);
+void bench_cases_release(void);
+
+#endif /* BENCH_CASES_H */
@@ -0,0 +1,516 @@
+/* Benchmark results and comparing them
+ *
+ * A run of the suite is saved as JSON, every sample of every case rather
+ * than only a summary, so a later run can be compared against the whole
+ * distribution:
+ *
+ *  {
+ *    "suite": "libc_notes",
+ *    "compiler": "12.2.0",
+ *    "timestamp": 1792300000,
+ *    "cases": [
+ *      {"group": "alloc", "name": "alloc_small", "median_ns": 81234.0,
+ *       "samples_ns": [81002.0, 81234.0, ...]},
+ *      ...
+ *    ]
+ *  }
+ *
+ * The reader only understands that layout (any key it doesn't know is
+ * skipped, strings don't get \u escapes), which is enough to read back what
+ * the suite writes without pulling in a JSON library.
+ *
+ * Timings aren't normally distributed: they have a floor and a long tail of
+ * runs that got interrupted, so comparing means with a t test flags noise.
+ * The Mann-Whitney U test only looks at how the two sets of samples rank
+ * against each other. If every new sample is slower than every baseline one
+ * the p value is tiny even with a handful of runs, and one outlier barely
+ * moves it. A significant difference on a 0.3% change isn't worth failing a
+ * build over though, so a case only counts as a regression when the median
+ * also moved by more than the threshold.
+ * */
+#include "bench_results.h"
+
+#include <stdio.h>      /* fopen, fprintf, printf */
+#include <stdlib.h>     /* malloc, realloc, free, strtod, qsort */
+#include <string.h>     /* strcmp, strncmp, memcpy */
+#include <ctype.h>      /* isspace */
+#include <math.h>       /* sqrt, erfc, fabs */
+#include <errno.h>      /* errno */
+
+static int compare_doubles(const void * a, const void * b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+double results_median(double * samples, size_t n)
+{
+    if(n == 0)
+        return 0;
+    qsort(samples, n, sizeof(double), compare_doubles);
+    if(n % 2 == 1)
+        return samples[n / 2];
+    return (samples[n / 2 - 1] + samples[n / 2]) / 2;
+}
+
+/* the median of samples, leaving them as they were */
+static double median_of(const case_result * c)
+{
+    double * copy = malloc(c->num_samples * sizeof(double) + 1);
+    if(copy == NULL)
+        return 0;
+    memcpy(copy, c->samples_ns, c->num_samples * sizeof(double));
+    double median = results_median(copy, c->num_samples);
+    free(copy);
+    return median;
+}
+
+/* the names are ours, but quote them properly anyway */
+static void write_string(FILE * f, const char * s)
+{
+    fputc('"', f);
+    for(; *s != '\0'; s++)
+    {
+        if(*s == '"' || *s == '\\')
+            fputc('\\', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+int results_save(const suite_results * results, const char * path)
+{
+    FILE * f = fopen(path, "w");
+    if(f == NULL)
+        return -1;
+
+    fprintf(f, "{\n  \"suite\": \"libc_notes\",\n  \"compiler\": ");
+    write_string(f, results->compiler);
+    fprintf(f, ",\n  \"timestamp\": %ld,\n  \"cases\": [\n",
+            results->timestamp);
+    for(size_t i = 0; i < results->num_cases; i++)
+    {
+        const case_result * c = &results->cases[i];
+        fprintf(f, "    {\"group\": ");
+        write_string(f, c->group);
+        fprintf(f, ", \"name\": ");
+        write_string(f, c->name);
+        fprintf(f, ", \"median_ns\": %.1f,\n     \"samples_ns\": [",
+                median_of(c));
+        for(size_t j = 0; j < c->num_samples; j++)
+            fprintf(f, "%s%.1f", j > 0 ? ", " : "", c->samples_ns[j]);
+        fprintf(f, "]}%s\n", i + 1 < results->num_cases ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    /* a full disk shows up here rather than at the fprintfs */
+    if(ferror(f))
+    {
+        int err = errno;
+        fclose(f);
+        errno = err;
+        return -1;
+    }
+    return fclose(f);
+}
+
+/* the reader, over the whole file in memory */
+typedef struct _json_reader {
+    const char * p;
+    int failed;
+} json_reader;
+
+static void skip_ws(json_reader * r)
+{
+    while(isspace((unsigned char)*r->p))
+        r->p++;
+}
+
+/* consumes c if it's next */
+static int accept(json_reader * r, char c)
+{
+    skip_ws(r);
+    if(*r->p != c)
+        return 0;
+    r->p++;
+    return 1;
+}
+
+static void expect(json_reader * r, char c)
+{
+    if(!accept(r, c))
+        r->failed = 1;
+}
+
+/* a string, malloced. NULL on failure */
+static char * parse_string(json_reader * r)
+{
+    skip_ws(r);
+    if(*r->p != '"')
+    {
+        r->failed = 1;
+        return NULL;
+    }
+    const char * start = ++r->p;
+    size_t len = 0;
+    for(; *r->p != '"'; r->p++, len++)
+    {
+        if(*r->p == '\\' && r->p[1] != '\0')
+            r->p++;
+        if(*r->p == '\0')
+        {
+            r->failed = 1;
+            return NULL;
+        }
+    }
+    r->p++;
+    char * s = malloc(len + 1);
+    if(s == NULL)
+    {
+        r->failed = 1;
+        return NULL;
+    }
+    for(size_t i = 0; i < len; i++, start++)
+    {
+        if(*start == '\\')
+            start++;
+        s[i] = *start;
+    }
+    s[len] = '\0';
+    return s;
+}
+
+static double parse_number(json_reader * r)
+{
+    skip_ws(r);
+    char * end;
+    double d = strtod(r->p, &end);
+    if(end == r->p)
+        r->failed = 1;
+    r->p = end;
+    return d;
+}
+
+/* a value of any kind, for the keys we don't know */
+static void skip_value(json_reader * r)
+{
+    skip_ws(r);
+    if(*r->p == '"')
+        free(parse_string(r));
+    else if(*r->p == '{' || *r->p == '[')
+    {
+        char close = *r->p == '{' ? '}' : ']';
+        r->p++;
+        if(accept(r, close))
+            return;
+        do
+        {
+            if(close == '}')
+            {
+                free(parse_string(r));
+                expect(r, ':');
+            }
+            skip_value(r);
+        } while(!r->failed && accept(r, ','));
+        expect(r, close);
+    }
+    else if(strncmp(r->p, "true", 4) == 0 || strncmp(r->p, "null", 4) == 0)
+        r->p += 4;
+    else if(strncmp(r->p, "false", 5) == 0)
+        r->p += 5;
+    else
+        parse_number(r);
+}
+
+static void parse_samples(json_reader * r, case_result * c)
+{
+    size_t cap = 0;
+    expect(r, '[');
+    if(r->failed || accept(r, ']'))
+        return;
+    do
+    {
+        if(c->num_samples == cap)
+        {
+            cap = cap ? cap * 2 : 32;
+            double * grown = realloc(c->samples_ns, cap * sizeof(double));
+            if(grown == NULL)
+            {
+                r->failed = 1;
+                return;
+            }
+            c->samples_ns = grown;
+        }
+        c->samples_ns[c->num_samples++] = parse_number(r);
+    } while(!r->failed && accept(r, ','));
+    expect(r, ']');
+}
+
+static void parse_case(json_reader * r, case_result * c)
+{
+    /* no empty cases, parse_string fails on the } */
+    expect(r, '{');
+    do
+    {
+        char * key = parse_string(r);
+        expect(r, ':');
+        if(r->failed)
+        {
+            free(key);
+            return;
+        }
+        if(strcmp(key, "group") == 0 && c->group == NULL)
+            c->group = parse_string(r);
+        else if(strcmp(key, "name") == 0 && c->name == NULL)
+            c->name = parse_string(r);
+        else if(strcmp(key, "samples_ns") == 0 && c->samples_ns == NULL)
+            parse_samples(r, c);
+        else
+            skip_value(r);
+        free(key);
+    } while(!r->failed && accept(r, ','));
+    expect(r, '}');
+    if(c->group == NULL || c->name == NULL || c->num_samples == 0)
+        r->failed = 1;
+}
+
+static void parse_cases(json_reader * r, suite_results * results)
+{
+    size_t cap = 0;
+    expect(r, '[');
+    if(r->failed || accept(r, ']'))
+        return;
+    do
+    {
+        if(results->num_cases == cap)
+        {
+            cap = cap ? cap * 2 : 16;
+            case_result * grown = realloc(results->cases,
+                                    cap * sizeof(case_result));
+            if(grown == NULL)
+            {
+                r->failed = 1;
+                return;
+            }
+            results->cases = grown;
+        }
+        case_result * c = &results->cases[results->num_cases++];
+        *c = (case_result){ 0 };
+        parse_case(r, c);
+    } while(!r->failed && accept(r, ','));
+    expect(r, ']');
+}
+
+/* the whole file, NUL terminated */
+static char * read_file(const char * path)
+{
+    FILE * f = fopen(path, "r");
+    if(f == NULL)
+        return NULL;
+    size_t len = 0;
+    size_t cap = 4096;
+    char * buf = malloc(cap);
+    size_t n;
+    while(buf != NULL && (n = fread(buf + len, 1, cap - len - 1, f)) > 0)
+    {
+        len += n;
+        if(cap - len - 1 == 0)
+        {
+            char * grown = realloc(buf, cap *= 2);
+            if(grown == NULL)
+                free(buf);
+            buf = grown;
+        }
+    }
+    int err = ferror(f) ? errno : 0;
+    fclose(f);
+    if(buf == NULL || err != 0)
+    {
+        free(buf);
+        errno = err ? err : ENOMEM;
+        return NULL;
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+int results_load(suite_results * results, const char * path)
+{
+    *results = (suite_results){ 0 };
+    char * text = read_file(path);
+    if(text == NULL)
+        return -1;
+
+    json_reader r = { .p = text, .failed = 0 };
+    int is_suite = 0;
+    expect(&r, '{');
+    do
+    {
+        char * key = parse_string(&r);
+        expect(&r, ':');
+        if(r.failed)
+        {
+            free(key);
+            break;
+        }
+        if(strcmp(key, "suite") == 0)
+        {
+            char * suite = parse_string(&r);
+            is_suite = suite != NULL && strcmp(suite, "libc_notes") == 0;
+            free(suite);
+        }
+        else if(strcmp(key, "compiler") == 0 && results->compiler == NULL)
+            results->compiler = parse_string(&r);
+        else if(strcmp(key, "timestamp") == 0)
+            results->timestamp = parse_number(&r);
+        else if(strcmp(key, "cases") == 0 && results->cases == NULL)
+            parse_cases(&r, results);
+        else
+            skip_value(&r);
+        free(key);
+    } while(!r.failed && accept(&r, ','));
+    expect(&r, '}');
+    free(text);
+
+    if(r.failed || !is_suite)
+    {
+        results_free(results);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+void results_free(suite_results * results)
+{
+    for(size_t i = 0; i < results->num_cases; i++)
+    {
+        free(results->cases[i].group);
+        free(results->cases[i].name);
+        free(results->cases[i].samples_ns);
+    }
+    free(results->cases);
+    free(results->compiler);
+    *results = (suite_results){ 0 };
+}
+
+/* a sample and which side it came from, for ranking both together */
+typedef struct _ranked {
+    double value;
+    int from_a;
+} ranked;
+
+static int compare_ranked(const void * a, const void * b)
+{
+    return compare_doubles(&((const ranked *)a)->value,
+                           &((const ranked *)b)->value);
+}
+
+double mann_whitney_p(const double * a, size_t na, const double * b,
+        size_t nb)
+{
+    size_t n = na + nb;
+    if(na == 0 || nb == 0)
+        return 1;
+    ranked * all = malloc(n * sizeof(ranked));
+    if(all == NULL)
+        return 1;
+    for(size_t i = 0; i < na; i++)
+        all[i] = (ranked){ a[i], 1 };
+    for(size_t i = 0; i < nb; i++)
+        all[na + i] = (ranked){ b[i], 0 };
+    qsort(all, n, sizeof(ranked), compare_ranked);
+
+    /* rank sum of a. Ties all get the average of the ranks they span, and
+     * shrink the variance by (t^3 - t) for a run of t of them */
+    double rank_sum_a = 0;
+    double ties = 0;
+    for(size_t i = 0; i < n; )
+    {
+        size_t j = i + 1;
+        while(j < n && all[j].value == all[i].value)
+            j++;
+        double rank = (i + 1 + j) / 2.0;   /* ranks i+1 .. j */
+        for(size_t k = i; k < j; k++)
+            if(all[k].from_a)
+                rank_sum_a += rank;
+        double t = j - i;
+        ties += t * t * t - t;
+        i = j;
+    }
+    free(all);
+
+    double u = rank_sum_a - na * (na + 1) / 2.0;
+    double mu = na * (double)nb / 2;
+    double sigma = sqrt(na * (double)nb / 12
+                    * ((n + 1) - ties / ((double)n * (n - 1))));
+    if(sigma == 0)
+        return 1;
+    /* with the continuity correction, never past the mean */
+    double dist = fabs(u - mu) - 0.5;
+    if(dist < 0)
+        dist = 0;
+    return erfc(dist / sigma / sqrt(2));
+}
+
+static const case_result * find_case(const suite_results * results,
+        const case_result * c)
+{
+    for(size_t i = 0; i < results->num_cases; i++)
+        if(strcmp(results->cases[i].group, c->group) == 0
+                && strcmp(results->cases[i].name, c->name) == 0)
+            return &results->cases[i];
+    return NULL;
+}
+
+size_t results_compare(const suite_results * baseline,
+        const suite_results * run, double threshold, double alpha)
+{
+    static const char * const verdict_names[] = {
+        [VERDICT_SAME] = "same",
+        [VERDICT_FASTER] = "faster",
+        [VERDICT_SLOWER] = "REGRESSION",
+        [VERDICT_NEW] = "new",
+    };
+    size_t regressions = 0;
+
+    printf("%-12s %-22s %12s %12s %8s %9s  %s\n", "group", "case",
+            "baseline ns", "now ns", "change", "p", "verdict");
+    for(size_t i = 0; i < run->num_cases; i++)
+    {
+        const case_result * now = &run->cases[i];
+        const case_result * was = find_case(baseline, now);
+        double now_median = median_of(now);
+        if(was == NULL)
+        {
+            printf("%-12s %-22s %12s %12.0f %8s %9s  %s\n", now->group,
+                    now->name, "-", now_median, "-", "-",
+                    verdict_names[VERDICT_NEW]);
+            continue;
+        }
+
+        double was_median = median_of(was);
+        double change = was_median > 0 ? now_median / was_median - 1 : 0;
+        double p = mann_whitney_p(was->samples_ns, was->num_samples,
+                    now->samples_ns, now->num_samples);
+        verdict v = VERDICT_SAME;
+        if(p < alpha && change > threshold)
+            v = VERDICT_SLOWER;
+        else if(p < alpha && change < -threshold)
+            v = VERDICT_FASTER;
+        regressions += v == VERDICT_SLOWER;
+
+        printf("%-12s %-22s %12.0f %12.0f %+7.1f%% %9.2g  %s\n",
+                now->group, now->name, was_median, now_median,
+                change * 100, p, verdict_names[v]);
+    }
+
+    /* dropped or renamed since the baseline */
+    for(size_t i = 0; i < baseline->num_cases; i++)
+        if(find_case(run, &baseline->cases[i]) == NULL)
+            printf("%-12s %-22s %12.0f %12s %8s %9s  %s\n",
+                    baseline->cases[i].group, baseline->cases[i].name,
+                    median_of(&baseline->cases[i]), "-", "-", "-", "gone");
+    return regressions;
+}
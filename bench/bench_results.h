@@ -0,0 +1,51 @@
+#ifndef BENCH_RESULTS_H
+#define BENCH_RESULTS_H
+
+#include <stddef.h> /* size_t */
+
+/* every timed run of one case */
+typedef struct _case_result {
+    char * group;
+    char * name;
+    double * samples_ns;
+    size_t num_samples;
+} case_result;
+
+typedef struct _suite_results {
+    char * compiler;        /* __VERSION__ of the build that ran it */
+    long timestamp;         /* time(NULL) when it ran */
+    case_result * cases;
+    size_t num_cases;
+} suite_results;
+
+/* as JSON. 0, or -1 with errno set */
+int results_save(const suite_results * results, const char * path);
+
+/* reads back what results_save wrote. 0, or -1 with errno set (EINVAL when
+ * the file isn't a results file) */
+int results_load(suite_results * results, const char * path);
+
+void results_free(suite_results * results);
+
+/* median of the samples, they get sorted */
+double results_median(double * samples, size_t n);
+
+/* two sided p value of the Mann-Whitney U test that a and b come from the
+ * same distribution, normal approximation with the tie correction */
+double mann_whitney_p(const double * a, size_t na, const double * b,
+        size_t nb);
+
+/* what came of comparing a case against the baseline */
+typedef enum _verdict {
+    VERDICT_SAME,
+    VERDICT_FASTER,
+    VERDICT_SLOWER,     /* a regression */
+    VERDICT_NEW,        /* not in the baseline */
+} verdict;
+
+/* prints a row per case of run and returns how many regressed: slower by
+ * more than threshold (0.05 is 5%) on the median with p below alpha */
+size_t results_compare(const suite_results * baseline,
+        const suite_results * run, double threshold, double alpha);
+
+#endif /* BENCH_RESULTS_H */
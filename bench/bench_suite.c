@@ -0,0 +1,231 @@
+/* Benchmark suite
+ *
+ * libc_notes --bench times whole demos, output and all, which is good for
+ * seeing where a run goes but too coarse to notice one code path getting
+ * slower. This runs the cases in bench_cases.c on their own, each
+ * --warmup times untimed and --runs times timed, and saves every sample as
+ * JSON (see bench_results.c). A sample is at least SUITE_MIN_SAMPLE_NS long,
+ * the short cases are called as many times as that takes.
+ *
+ * Given a --baseline saved the same way it also compares the two, case by
+ * case, and exits with 1 when something regressed, so a Makefile target or
+ * a hook can run it before a change goes in:
+ *
+ *      make bench_baseline     # on the commit to compare against
+ *      make bench_check        # on the change
+ *
+ * Both runs need the same machine and build flags to mean anything, and the
+ * fewer other things running the better. Nothing here touches the network.
+ * */
+#include "bench_cases.h"
+#include "bench_results.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf, fprintf */
+#include <stdlib.h>     /* malloc, free, strtol, strtod, exit */
+#include <string.h>     /* strstr, strdup, memcpy */
+#include <time.h>       /* time */
+#include <argp.h>       /* argp functions */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+
+/* a case that takes less than this is run several times per sample, and
+ * the sample is the time per call */
+#ifndef SUITE_MIN_SAMPLE_NS
+#define SUITE_MIN_SAMPLE_NS 10000000.0
+#endif
+
+typedef struct _suite_config {
+    int runs;
+    int warmup;
+    const char * out;       /* where the results go, NULL for nowhere */
+    const char * baseline;  /* to compare against, NULL for no comparison */
+    double threshold;       /* a fraction, --threshold is in percent */
+    double alpha;
+    const char * filter;    /* only cases whose group/name contains it */
+} suite_config;
+
+static suite_config suite_settings = {
+    .runs = 20,
+    .warmup = 2,
+    .out = NULL,
+    .baseline = NULL,
+    .threshold = 0.05,
+    .alpha = 0.01,
+    .filter = NULL,
+};
+
+static const char suite_doc[] = "bench_suite -- times the libc_notes "
+                    "benchmark cases, saves the samples as JSON and compares "
+                    "them against a baseline";
+
+static error_t suite_parser(int key, char * arg, struct argp_state * state);
+
+static struct argp_option options[] = {
+        {"runs", 'r', "N", 0, "timed runs of each case (default 20)", 0},
+        {"warmup", 'w', "N", 0,
+            "untimed runs of each case before those (default 2)", 0},
+        {"out", 'o', "FILE", 0, "save the results to FILE as JSON", 0},
+        {"baseline", 'b', "FILE", 0,
+            "compare against results saved earlier, exit with 1 on a "
+            "regression", 0},
+        {"threshold", 't', "PCT", 0,
+            "how much slower the median has to get to count (default 5)", 0},
+        {"alpha", 'a', "P", 0,
+            "the p value a difference has to be below (default 0.01)", 0},
+        {"filter", 'f', "TEXT", 0,
+            "only the cases whose group/name contains TEXT", 0},
+        { 0 }
+    };
+
+static struct argp parser = { options, suite_parser, 0, suite_doc, 0, 0, 0 };
+
+static error_t suite_parser(int key, char * arg, struct argp_state * state)
+{
+    if(key == 'r' || key == 'w')
+    {
+        char * end;
+        errno = 0;
+        long n = strtol(arg, &end, 10);
+        if(errno != 0 || end == arg || *end != '\0' || n < (key == 'r')
+                || n > 1000000)
+            argp_error(state, "bad count for --%s: %s", key == 'r' ? "runs"
+                        : "warmup", arg);
+        if(key == 'r')
+            suite_settings.runs = n;
+        else
+            suite_settings.warmup = n;
+    }
+    else if(key == 't' || key == 'a')
+    {
+        char * end;
+        double d = strtod(arg, &end);
+        if(end == arg || *end != '\0' || !(d >= 0)
+                || (key == 'a' && d > 1))
+            argp_error(state, "bad value for --%s: %s", key == 't' ?
+                        "threshold" : "alpha", arg);
+        if(key == 't')
+            suite_settings.threshold = d / 100;
+        else
+            suite_settings.alpha = d;
+    }
+    else if(key == 'o')
+        suite_settings.out = arg;
+    else if(key == 'b')
+        suite_settings.baseline = arg;
+    else if(key == 'f')
+        suite_settings.filter = arg;
+    else
+        return ARGP_ERR_UNKNOWN;
+    return 0;
+}
+
+static int selected(const bench_case * c)
+{
+    if(suite_settings.filter == NULL)
+        return 1;
+    char full[128];
+    snprintf(full, sizeof(full), "%s/%s", c->group, c->name);
+    return strstr(full, suite_settings.filter) != NULL;
+}
+
+/* the samples of one case, in nanoseconds */
+static void run_case(const bench_case * c, case_result * result)
+{
+    result->group = strdup(c->group);
+    result->name = strdup(c->name);
+    result->samples_ns = malloc(suite_settings.runs * sizeof(double));
+    if(result->group == NULL || result->name == NULL
+            || result->samples_ns == NULL)
+        error(EXIT_FAILURE, errno, "result allocation failed");
+
+    /* the warmup also says how many calls make a sample long enough that
+     * a timer interrupt or two doesn't decide it */
+    double call_ns = 0;
+    for(int i = 0; i < suite_settings.warmup || i == 0; i++)
+    {
+        struct timespec start = bench_now();
+        c->run();
+        call_ns = bench_elapsed(start, bench_now()) * 1e9;
+    }
+    long calls = call_ns > 0 ? SUITE_MIN_SAMPLE_NS / call_ns : 1;
+    if(calls < 1)
+        calls = 1;
+
+    for(int i = 0; i < suite_settings.runs; i++)
+    {
+        struct timespec start = bench_now();
+        for(long j = 0; j < calls; j++)
+            c->run();
+        result->samples_ns[i] = bench_elapsed(start, bench_now()) * 1e9
+                                / calls;
+    }
+    result->num_samples = suite_settings.runs;
+}
+
+int main(int argc, char * argv[])
+{
+    argp_parse(&parser, argc, argv, 0, 0, 0);
+
+    /* the baseline first, so a bad path doesn't waste a whole run */
+    suite_results baseline;
+    if(suite_settings.baseline != NULL
+            && results_load(&baseline, suite_settings.baseline) != 0)
+        error(EXIT_FAILURE, errno, "can't read the baseline %s",
+                suite_settings.baseline);
+
+    suite_results results = {
+        .compiler = strdup(__VERSION__),
+        .timestamp = time(NULL),
+        .cases = malloc(bench_num_cases * sizeof(case_result)),
+        .num_cases = 0,
+    };
+    if(results.compiler == NULL || results.cases == NULL)
+        error(EXIT_FAILURE, errno, "result allocation failed");
+
+    bench_cases_init();
+    printf("%-12s %-22s %12s %12s %12s\n", "group", "case", "min ns",
+            "median ns", "max ns");
+    for(size_t i = 0; i < bench_num_cases; i++)
+    {
+        if(!selected(&bench_cases[i]))
+            continue;
+        case_result * result = &results.cases[results.num_cases++];
+        run_case(&bench_cases[i], result);
+
+        /* results_median sorts, the saved samples stay in run order */
+        double sorted[result->num_samples];
+        memcpy(sorted, result->samples_ns, sizeof(sorted));
+        double median = results_median(sorted, result->num_samples);
+        printf("%-12s %-22s %12.0f %12.0f %12.0f\n", result->group,
+                result->name, sorted[0], median,
+                sorted[result->num_samples - 1]);
+    }
+    bench_cases_release();
+    if(results.num_cases == 0)
+        error(EXIT_FAILURE, 0, "no case matches %s", suite_settings.filter);
+
+    if(suite_settings.out != NULL)
+    {
+        if(results_save(&results, suite_settings.out) != 0)
+            error(EXIT_FAILURE, errno, "can't save the results to %s",
+                    suite_settings.out);
+        printf("\nsaved to %s\n", suite_settings.out);
+    }
+
+    size_t regressions = 0;
+    if(suite_settings.baseline != NULL)
+    {
+        printf("\nagainst %s (%s), slower by more than %.1f%% with p < %g "
+                "is a regression:\n", suite_settings.baseline,
+                baseline.compiler ? baseline.compiler : "unknown compiler",
+                suite_settings.threshold * 100, suite_settings.alpha);
+        regressions = results_compare(&baseline, &results,
+                        suite_settings.threshold, suite_settings.alpha);
+        printf("\n%zu regression%s\n", regressions,
+                regressions == 1 ? "" : "s");
+        results_free(&baseline);
+    }
+    results_free(&results);
+    exit(regressions > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
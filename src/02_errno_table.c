@@ -0,0 +1,239 @@
+/* Section 2.3 continued -- looking errors up once
+ *
+ * Each of the ways to turn an errno into text has a catch on a hot path:
+ *  - strerror translates through the current locale (LC_MESSAGES) and for an
+ *    unknown number writes into a static buffer, so it's MT-Unsafe.
+ *  - strerror_r is the thread safe one. The GNU version returns a pointer
+ *    that may or may not be the buffer you handed it. It also still goes
+ *    through gettext for the translation.
+ *  - strerrorname_np and strerrordesc_np are plain array lookups, but
+ *    they're glibc 2.32 and later, and there's no way back from "ENOENT" to
+ *    the number at all.
+ *
+ * The table here asks strerrorname_np and strerrordesc_np about every
+ * number once and keeps the pointers (they point at string constants inside
+ * libc, so nothing is copied). After that a lookup is an index into an
+ * array that never changes again, so any number of threads can read it
+ * without locks. pthread_once makes sure it is built exactly once,
+ * whichever thread gets there first.
+ *
+ * For the way back, the names go into an array sorted with qsort and
+ * searched with bsearch (section 9), together with the three aliases
+ * errno.h defines on top of glibc's names:
+ *      EWOULDBLOCK = EAGAIN, EDEADLOCK = EDEADLK, ENOTSUP = EOPNOTSUPP
+ * */
+
+#include "02_errno_table.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* qsort, bsearch */
+#include <string.h>     /* strerror, strerror_r, strerrorname_np, strcmp */
+#include <pthread.h>    /* pthread_once */
+#include <stdatomic.h>  /* atomic_int */
+#include <errno.h>      /* EAGAIN, EDEADLK, EOPNOTSUPP */
+
+/* rounds over every errno value in the benchmark */
+#ifndef ERRNO_BENCH_ROUNDS
+#define ERRNO_BENCH_ROUNDS 20000
+#endif
+
+typedef struct _errno_entry {
+    const char * name;
+    int errnum;
+} errno_entry;
+
+/* names errno.h has that strerrorname_np never returns */
+static const errno_entry aliases[] = {
+    { "EWOULDBLOCK", EAGAIN },
+    { "EDEADLOCK", EDEADLK },
+    { "ENOTSUP", EOPNOTSUPP },
+};
+#define NUM_ALIASES (sizeof(aliases) / sizeof(aliases[0]))
+
+static const char * names[ERRNO_TABLE_LEN];
+static const char * descs[ERRNO_TABLE_LEN];
+static errno_entry by_name[ERRNO_TABLE_LEN + NUM_ALIASES];
+static size_t num_names;
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+/* set once the table is done, so a lookup is one load before pthread_once */
+static atomic_int table_ready;
+
+static int compare_entries(const void * a, const void * b)
+{
+    return strcmp(((const errno_entry *)a)->name,
+                  ((const errno_entry *)b)->name);
+}
+
+static void build_table(void)
+{
+    for(int e = 0; e < ERRNO_TABLE_LEN; e++)
+    {
+        names[e] = strerrorname_np(e);
+        descs[e] = strerrordesc_np(e);
+        if(names[e] != NULL)
+            by_name[num_names++] = (errno_entry){ names[e], e };
+    }
+    for(size_t i = 0; i < NUM_ALIASES; i++)
+        by_name[num_names++] = aliases[i];
+    qsort(by_name, num_names, sizeof(errno_entry), compare_entries);
+    atomic_store_explicit(&table_ready, 1, memory_order_release);
+}
+
+void errno_table_init(void)
+{
+    if(!atomic_load_explicit(&table_ready, memory_order_acquire))
+        pthread_once(&table_once, build_table);
+}
+
+const char * errno_name(int errnum)
+{
+    errno_table_init();
+    if(errnum < 0 || errnum >= ERRNO_TABLE_LEN)
+        return NULL;
+    return names[errnum];
+}
+
+const char * errno_desc(int errnum)
+{
+    errno_table_init();
+    if(errnum < 0 || errnum >= ERRNO_TABLE_LEN)
+        return NULL;
+    return descs[errnum];
+}
+
+int errno_from_name(const char * name)
+{
+    errno_table_init();
+    errno_entry key = { name, 0 };
+    errno_entry * found = bsearch(&key, by_name, num_names,
+                                sizeof(errno_entry), compare_entries);
+    return found ? found->errnum : -1;
+}
+
+/* what the reverse lookup is without the table */
+static int errno_from_name_slow(const char * name)
+{
+    for(int e = 0; e < ERRNO_TABLE_LEN; e++)
+    {
+        const char * n = strerrorname_np(e);
+        if(n != NULL && strcmp(n, name) == 0)
+            return e;
+    }
+    return -1;
+}
+
+/* the ways of turning a number into text, timed */
+typedef enum _lookup {
+    LOOKUP_STRERROR,
+    LOOKUP_STRERROR_R,
+    LOOKUP_NP,
+    LOOKUP_TABLE,
+    LOOKUP_NAME_SCAN,
+    LOOKUP_NAME_TABLE,
+    NUM_LOOKUPS
+} lookup;
+
+static const char * const lookup_names[NUM_LOOKUPS] = {
+    "strerror",
+    "strerror_r",
+    "strerrorname_np + desc_np",
+    "errno_name + errno_desc",
+    "name -> number, scan",
+    "name -> number, bsearch",
+};
+
+/* ns per lookup, every errno value ERRNO_BENCH_ROUNDS times */
+static double bench_lookup(lookup how, int max_errno)
+{
+    char buf[256];
+    size_t total = 0;   /* so none of it can be skipped */
+    struct timespec start = bench_now();
+    for(int round = 0; round < ERRNO_BENCH_ROUNDS; round++)
+    {
+        for(int e = 1; e <= max_errno; e++)
+        {
+            switch(how)
+            {
+            case LOOKUP_STRERROR:
+                total += strerror(e)[0];
+                break;
+            case LOOKUP_STRERROR_R:
+                total += strerror_r(e, buf, sizeof(buf))[0];
+                break;
+            case LOOKUP_NP:
+                total += (size_t)strerrorname_np(e)
+                       + (size_t)strerrordesc_np(e);
+                break;
+            case LOOKUP_TABLE:
+                total += (size_t)errno_name(e) + (size_t)errno_desc(e);
+                break;
+            case LOOKUP_NAME_SCAN:
+                if(names[e] != NULL)
+                    total += errno_from_name_slow(names[e]);
+                break;
+            case LOOKUP_NAME_TABLE:
+                if(names[e] != NULL)
+                    total += errno_from_name(names[e]);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    double seconds = bench_elapsed(start, bench_now());
+    if(total == 0)
+        printf("(nothing looked up)\n");
+    return seconds * 1e9 / ((double)ERRNO_BENCH_ROUNDS * max_errno);
+}
+
+void errno_table_demo(void)
+{
+    printf( "\t==================================\n"
+            "\t== Section 2.3 errno table =======\n"
+            "\t==================================\n\n");
+
+    struct timespec start = bench_now();
+    errno_table_init();
+    double build = bench_elapsed(start, bench_now());
+
+    /* it has to agree with libc, both ways */
+    int max_errno = 0;
+    size_t known = 0;
+    size_t mismatches = 0;
+    for(int e = 0; e < ERRNO_TABLE_LEN; e++)
+    {
+        if(errno_name(e) != strerrorname_np(e)
+                || errno_desc(e) != strerrordesc_np(e))
+            mismatches++;
+        if(errno_name(e) == NULL)
+            continue;
+        known++;
+        max_errno = e;
+        if(errno_from_name(errno_name(e)) != e)
+            mismatches++;
+    }
+    for(size_t i = 0; i < NUM_ALIASES; i++)
+    {
+        if(errno_from_name(aliases[i].name) != aliases[i].errnum)
+            mismatches++;
+    }
+    if(errno_from_name("ENOTANERROR") != -1)
+        mismatches++;
+    printf("built in %.1f us: %zu errno values up to %s (%d), %zu names "
+           "with aliases, %zu mismatches with libc\n", build * 1e6, known,
+           errno_name(max_errno), max_errno, num_names, mismatches);
+    printf("errno_from_name(\"EWOULDBLOCK\") = %d (%s), "
+           "errno_from_name(\"ENOTSUP\") = %d (%s)\n\n",
+           errno_from_name("EWOULDBLOCK"),
+           errno_name(errno_from_name("EWOULDBLOCK")),
+           errno_from_name("ENOTSUP"),
+           errno_name(errno_from_name("ENOTSUP")));
+
+    printf("every errno value %d times:\n", ERRNO_BENCH_ROUNDS);
+    printf("\t%-28s %12s\n", "lookup", "ns/lookup");
+    for(lookup how = LOOKUP_STRERROR; how < NUM_LOOKUPS; how++)
+        printf("\t%-28s %12.1f\n", lookup_names[how],
+                bench_lookup(how, max_errno));
+    printf("\n");
+}
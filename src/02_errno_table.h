@@ -0,0 +1,28 @@
+#ifndef ERRNO_TABLE_H
+#define ERRNO_TABLE_H
+
+/* errno values the table covers, 0 to ERRNO_TABLE_LEN - 1. glibc on Linux
+ * stops at EHWPOISON, 133 */
+#ifndef ERRNO_TABLE_LEN
+#define ERRNO_TABLE_LEN 256
+#endif
+
+/* fills the table from strerrorname_np and strerrordesc_np. The lookups
+ * below call it themselves the first time, calling it early just moves
+ * that cost to a time of your choosing */
+void errno_table_init(void);
+
+/* "ENOENT" for ENOENT, NULL if glibc has no name for it */
+const char * errno_name(int errnum);
+
+/* "No such file or directory", untranslated like strerrordesc_np. NULL if
+ * glibc has nothing for it */
+const char * errno_desc(int errnum);
+
+/* ENOENT for "ENOENT", aliases like "EWOULDBLOCK" included. -1 if it isn't
+ * an errno name */
+int errno_from_name(const char * name);
+
+void errno_table_demo(void);
+
+#endif /* ERRNO_TABLE_H */
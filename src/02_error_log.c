@@ -0,0 +1,523 @@
+/* Section 2 continued -- errors that aren't the end of the world
+ *
+ * error and error_at_line are made for command line tools that give up on
+ * the first problem. Each call formats the message, writes it to stderr
+ * right then (holding the stderr lock, so threads take turns), and a non
+ * zero STATUS means exit. Something that keeps running through errors, say
+ * a server that can't open one client's file, wants the opposite: note
+ * that it happened, cheaply, and carry on. If the same error happens a
+ * hundred thousand times a second, it wants a few of them and a count.
+ *
+ * So err_report(errno, "what") saves the errno, its name from the errno
+ * table (02_errno_table.c), __FILE__, __LINE__ and the time in a record,
+ * and that's all. Nothing is formatted or written on the reporting thread.
+ * Each thread has a ring of ERR_RING_LEN records that only it writes to and
+ * only the flusher reads from. With one writer and one reader, a ring needs
+ * no lock. The writer owns head and the reader owns tail, and each only
+ * reads the other's with acquire ordering. The writer stores head with
+ * release ordering after filling the slot, so the reader never sees a half
+ * written record. When the ring is full the record is dropped and counted,
+ * because waiting for the flusher would defeat the point.
+ *
+ * A flusher thread wakes every ERR_FLUSH_MS, formats whatever the rings
+ * hold like error_at_line would and writes it out in big chunks.
+ * err_log_flush does the same on demand.
+ *
+ * error_one_per_line (see 02_error_reporting.c) only skips an error when it
+ * comes from the same line as the one just before it. Here each err_report
+ * call site gets a static err_site that allows err_log_rate_limit records
+ * per second. The next record that gets through says how many were turned
+ * away in between. A site that never gets another one through would keep
+ * its count to itself, so the first time a site turns a report away it goes
+ * on a list, and err_log_flush (and err_log_stop) write a line for every
+ * site on it with a count still pending.
+ * */
+
+#include "02_error_log.h"
+#include "02_errno_table.h"
+#include "bench.h"
+
+#include <stdio.h>      /* snprintf, printf, fflush */
+#include <stdlib.h>     /* calloc, EXIT_FAILURE */
+#include <unistd.h>     /* write, dup, dup2, close, STDERR_FILENO */
+#include <fcntl.h>      /* open */
+#include <pthread.h>    /* pthread_create, mutexes, conditions, keys */
+#include <errno.h>      /* errno, program_invocation_short_name */
+#include <error.h>      /* error, error_at_line, error_message_count */
+
+/* the flusher formats into this much before each write */
+#ifndef ERR_WRITE_LEN
+#define ERR_WRITE_LEN 16384
+#endif
+
+/* longest line it writes, longer ones get cut */
+#define ERR_LINE_LEN 512
+
+/* reports per run and threads for the benchmark in the demo */
+#ifndef ERR_BENCH_REPORTS
+#define ERR_BENCH_REPORTS 100000
+#endif
+#ifndef ERR_BENCH_THREADS
+#define ERR_BENCH_THREADS 4
+#endif
+
+unsigned int err_log_rate_limit = ERR_RATE_LIMIT;
+
+typedef struct _err_ring {
+    err_record slots[ERR_RING_LEN];
+    atomic_size_t head;         /* next slot the thread fills */
+    atomic_size_t tail;         /* next slot the flusher reads */
+    atomic_size_t recorded;     /* only the owner changes these two */
+    atomic_size_t dropped;
+    atomic_int in_use;          /* a live thread owns it */
+    struct _err_ring * next;
+} err_ring;
+
+/* every ring there is. Rings are only ever added, a thread that exits
+ * leaves its ring for the next new thread */
+static _Atomic(err_ring *) rings;
+/* every site that has turned a report away. Only ever added to as well */
+static _Atomic(err_site *) limited_sites;
+static __thread err_ring * my_ring;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+static struct {
+    pthread_mutex_t lock;       /* one drain at a time, and the fields below */
+    pthread_cond_t wake;
+    pthread_t thread;
+    int running;
+    int stopping;
+    int fd;
+    struct timespec start;      /* timestamps are printed relative to this */
+    size_t written;
+    atomic_size_t suppressed;
+} logger = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .fd = STDERR_FILENO,
+};
+
+/* runs when a thread that reported something exits */
+static void ring_release(void * ring)
+{
+    atomic_store_explicit(&((err_ring *)ring)->in_use, 0,
+            memory_order_release);
+}
+
+static void ring_make_key(void)
+{
+    pthread_key_create(&ring_key, ring_release);
+}
+
+/* a ring for this thread, an old one if there's one going spare */
+static err_ring * ring_claim(void)
+{
+    pthread_once(&ring_key_once, ring_make_key);
+
+    err_ring * ring;
+    for(ring = atomic_load(&rings); ring != NULL; ring = ring->next)
+    {
+        int unused = 0;
+        if(atomic_compare_exchange_strong(&ring->in_use, &unused, 1))
+            break;
+    }
+    if(ring == NULL)
+    {
+        ring = calloc(1, sizeof(err_ring));
+        if(ring == NULL)
+            return NULL;
+        atomic_init(&ring->in_use, 1);
+        ring->next = atomic_load(&rings);
+        while(!atomic_compare_exchange_weak(&rings, &ring->next, ring))
+            ;
+    }
+    pthread_setspecific(ring_key, ring);
+    my_ring = ring;
+    return ring;
+}
+
+/* counters only the owning thread writes, so a load and a store will do */
+static void count(atomic_size_t * counter)
+{
+    atomic_store_explicit(counter,
+            atomic_load_explicit(counter, memory_order_relaxed) + 1,
+            memory_order_relaxed);
+}
+
+/* 1 if site may make another record this second */
+static int rate_allows(err_site * site, time_t now)
+{
+    unsigned int limit = err_log_rate_limit;
+    if(limit == 0)
+        return 1;
+    long window = atomic_load_explicit(&site->window, memory_order_relaxed);
+    if(window != now
+            && atomic_compare_exchange_strong(&site->window, &window, now))
+        atomic_store_explicit(&site->count, 0, memory_order_relaxed);
+    if(atomic_fetch_add_explicit(&site->count, 1, memory_order_relaxed)
+            < limit)
+        return 1;
+    atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&logger.suppressed, 1, memory_order_relaxed);
+    if(atomic_exchange(&site->listed, 1) == 0)
+    {
+        site->next = atomic_load(&limited_sites);
+        while(!atomic_compare_exchange_weak(&limited_sites, &site->next,
+                    site))
+            ;
+    }
+    return 0;
+}
+
+void err_log_record(err_site * site, int errnum, const char * what)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if(!rate_allows(site, now.tv_sec))
+        return;
+
+    err_ring * ring = my_ring;
+    if(ring == NULL && (ring = ring_claim()) == NULL)
+        return;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if(head - tail == ERR_RING_LEN)
+    {
+        count(&ring->dropped);
+        return;
+    }
+
+    err_record * rec = &ring->slots[head & (ERR_RING_LEN - 1)];
+    rec->errnum = errnum;
+    rec->name = errno_name(errnum);
+    rec->file = site->file;
+    rec->line = site->line;
+    rec->what = what;
+    rec->suppressed = atomic_exchange_explicit(&site->suppressed, 0,
+                        memory_order_relaxed);
+    rec->when = now;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    count(&ring->recorded);
+}
+
+static void write_all(int fd, const char * buf, size_t len)
+{
+    while(len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)     /* nowhere left to report that */
+            return;
+        buf += n;
+        len -= n;
+    }
+}
+
+/* program:file:line: what: ENOENT (No such file or directory) +0.001234s */
+static size_t format_record(char * buf, size_t size, const err_record * rec)
+{
+    long sec = rec->when.tv_sec - logger.start.tv_sec;
+    long nsec = rec->when.tv_nsec - logger.start.tv_nsec;
+    if(nsec < 0)
+    {
+        sec--;
+        nsec += 1000000000L;
+    }
+    const char * desc = errno_desc(rec->errnum);
+    int n = snprintf(buf, size, "%s:%s:%u: %s: %s (%s) +%ld.%06lds",
+                program_invocation_short_name, rec->file, rec->line,
+                rec->what, rec->name ? rec->name : "E?",
+                desc ? desc : "Unknown error", sec, nsec / 1000);
+    if(n >= 0 && (size_t)n < size && rec->suppressed > 0)
+        n += snprintf(buf + n, size - n, " [%u more suppressed]",
+                rec->suppressed);
+    if(n < 0)
+        n = 0;
+    if((size_t)n >= size - 1)
+        n = size - 2;
+    buf[n++] = '\n';
+    return n;
+}
+
+/* program:file:line: [40 suppressed], for a site with a count that no
+ * record has carried out yet */
+static size_t format_suppressed(char * buf, size_t size, const err_site * site,
+        unsigned int suppressed)
+{
+    int n = snprintf(buf, size, "%s:%s:%u: [%u suppressed]\n",
+                program_invocation_short_name, site->file, site->line,
+                suppressed);
+    if(n < 0)
+        return 0;
+    return (size_t)n < size ? (size_t)n : size - 1;
+}
+
+/* everything in every ring out to logger.fd, and with sites_too the pending
+ * suppressed counts. Called with logger.lock held */
+static void drain(int sites_too)
+{
+    char buf[ERR_WRITE_LEN];
+    size_t len = 0;
+    for(err_ring * ring = atomic_load(&rings); ring != NULL; ring = ring->next)
+    {
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for(; tail != head; tail++)
+        {
+            if(len + ERR_LINE_LEN > sizeof(buf))
+            {
+                write_all(logger.fd, buf, len);
+                len = 0;
+            }
+            len += format_record(buf + len, ERR_LINE_LEN,
+                    &ring->slots[tail & (ERR_RING_LEN - 1)]);
+            logger.written++;
+        }
+        /* the slots can be reused once this is stored */
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    /* after the records, which may have carried some of the counts already */
+    for(err_site * site = sites_too ? atomic_load(&limited_sites) : NULL;
+            site != NULL; site = site->next)
+    {
+        unsigned int suppressed = atomic_exchange_explicit(&site->suppressed,
+                                    0, memory_order_relaxed);
+        if(suppressed == 0)
+            continue;
+        if(len + ERR_LINE_LEN > sizeof(buf))
+        {
+            write_all(logger.fd, buf, len);
+            len = 0;
+        }
+        len += format_suppressed(buf + len, ERR_LINE_LEN, site, suppressed);
+        logger.written++;
+    }
+    write_all(logger.fd, buf, len);
+}
+
+static void * flusher(void * unused)
+{
+    (void)unused;
+    pthread_mutex_lock(&logger.lock);
+    while(!logger.stopping)
+    {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += ERR_FLUSH_MS * 1000000L;
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&logger.wake, &logger.lock, &until);
+        /* the counts wait for a record, or the next err_log_flush */
+        drain(0);
+    }
+    pthread_mutex_unlock(&logger.lock);
+    return NULL;
+}
+
+int err_log_start(int fd)
+{
+    int err = 0;
+    /* so the first report doesn't build it */
+    errno_table_init();
+    pthread_mutex_lock(&logger.lock);
+    logger.fd = fd;
+    if(logger.start.tv_sec == 0)
+        clock_gettime(CLOCK_REALTIME, &logger.start);
+    if(!logger.running)
+    {
+        logger.stopping = 0;
+        err = pthread_create(&logger.thread, NULL, flusher, NULL);
+        logger.running = err == 0;
+    }
+    pthread_mutex_unlock(&logger.lock);
+    return err;
+}
+
+void err_log_flush(void)
+{
+    /* like error(), so what was printed before comes out before */
+    fflush(stdout);
+    pthread_mutex_lock(&logger.lock);
+    if(logger.start.tv_sec == 0)
+        clock_gettime(CLOCK_REALTIME, &logger.start);
+    drain(1);
+    pthread_mutex_unlock(&logger.lock);
+}
+
+void err_log_stop(void)
+{
+    pthread_mutex_lock(&logger.lock);
+    int running = logger.running;
+    logger.stopping = 1;
+    pthread_cond_signal(&logger.wake);
+    pthread_mutex_unlock(&logger.lock);
+    if(running)
+        pthread_join(logger.thread, NULL);
+    logger.running = 0;
+    err_log_flush();
+}
+
+err_log_stats err_log_get_stats(void)
+{
+    err_log_stats stats = { 0, 0, 0, 0 };
+    for(err_ring * ring = atomic_load(&rings); ring != NULL; ring = ring->next)
+    {
+        stats.recorded += atomic_load(&ring->recorded);
+        stats.dropped += atomic_load(&ring->dropped);
+    }
+    stats.suppressed = atomic_load(&logger.suppressed);
+    pthread_mutex_lock(&logger.lock);
+    stats.written = logger.written;
+    pthread_mutex_unlock(&logger.lock);
+    return stats;
+}
+
+/* the benchmark: ERR_BENCH_REPORTS errors, split over some threads, through
+ * one of these */
+typedef enum _reporter {
+    REPORT_ERROR,
+    REPORT_ERROR_ONE_PER_LINE,
+    REPORT_RING,
+    REPORT_RING_LIMITED,
+    NUM_REPORTERS
+} reporter;
+
+static const char * const reporter_names[NUM_REPORTERS] = {
+    "error",
+    "error_at_line, one per line",
+    "err_report, no limit",
+    "err_report, 10/s",
+};
+
+/* the benchmark's site, so every run can start it over */
+static err_site bench_site = { __FILE__, __LINE__, 0, 0, 0, 0, NULL };
+
+typedef struct _bench_job {
+    reporter how;
+    size_t reports;
+} bench_job;
+
+static void * report_errors(void * arg)
+{
+    bench_job * job = arg;
+    for(size_t i = 0; i < job->reports; i++)
+    {
+        switch(job->how)
+        {
+        case REPORT_ERROR:
+            error(0, ENOENT, "opening %s failed", "some_file");
+            break;
+        case REPORT_ERROR_ONE_PER_LINE:
+            error_at_line(0, ENOENT, __FILE__, __LINE__,
+                    "opening %s failed", "some_file");
+            break;
+        default:
+            err_log_record(&bench_site, ENOENT, "opening some_file failed");
+        }
+    }
+    return NULL;
+}
+
+/* ns per report on the reporting threads and lines that came out */
+static void bench_reporter(reporter how, int threads, int null_fd)
+{
+    pthread_t tids[ERR_BENCH_THREADS];
+    bench_job job = { how, ERR_BENCH_REPORTS / threads };
+
+    error_one_per_line = how == REPORT_ERROR_ONE_PER_LINE;
+    err_log_rate_limit = how == REPORT_RING_LIMITED ? 10 : 0;
+    atomic_store(&bench_site.window, 0);
+    atomic_store(&bench_site.count, 0);
+    atomic_store(&bench_site.suppressed, 0);
+
+    /* error writes to stderr, so for its turn stderr is /dev/null */
+    fflush(stderr);
+    int saved_err = dup(STDERR_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    /* error_at_line remembers the last line it printed for, make it another
+     * one so the first report of this run isn't skipped */
+    if(how == REPORT_ERROR_ONE_PER_LINE)
+        error_at_line(0, 0, "", 0, " ");
+    unsigned int messages_before = error_message_count;
+    err_log_stats before = err_log_get_stats();
+    if(how >= REPORT_RING)
+        err_log_start(null_fd);
+
+    struct timespec start = bench_now();
+    for(int t = 0; t < threads; t++)
+    {
+        if(pthread_create(&tids[t], NULL, report_errors, &job) != 0)
+            error(EXIT_FAILURE, errno, "pthread_create failed");
+    }
+    for(int t = 0; t < threads; t++)
+        pthread_join(tids[t], NULL);
+    double reporting = bench_elapsed(start, bench_now());
+    if(how >= REPORT_RING)
+        err_log_stop();
+    double total = bench_elapsed(start, bench_now());
+
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_err);
+    error_one_per_line = 0;
+    err_log_rate_limit = ERR_RATE_LIMIT;
+
+    err_log_stats after = err_log_get_stats();
+    size_t reports = job.reports * threads;
+    size_t lines = how < REPORT_RING ? error_message_count - messages_before
+                                     : after.written - before.written;
+    printf("\t%-28s %7d %10.1f %10.2f %8zu %8zu %10zu\n",
+            reporter_names[how], threads, reporting * 1e9 / reports,
+            total * 1e3, lines, after.dropped - before.dropped,
+            after.suppressed - before.suppressed);
+}
+
+void error_log_demo(void)
+{
+    printf( "\t==================================\n"
+            "\t== Section 2 non-fatal errors ====\n"
+            "\t==================================\n\n");
+
+    /* a few real ones first, through the flusher onto stderr. The heading
+     * goes out before the flusher starts, or it could come out after */
+    printf("three opens that fail, reported and carried on from:\n");
+    fflush(stdout);
+    err_log_start(STDERR_FILENO);
+    const char * const paths[] = { "/nonexistent/file", "/", "/proc/1/mem" };
+    for(size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+    {
+        int fd = open(paths[i], O_RDWR);
+        if(fd < 0)
+            err_report(errno, "open failed");
+        else
+            close(fd);
+    }
+    err_log_stop();
+
+    /* and one site failing over and over, 10 a second gets through and the
+     * flush says how many didn't */
+    printf("\n50 reports from one site with a limit of %u a second:\n",
+            err_log_rate_limit);
+    for(int i = 0; i < 50; i++)
+        err_report(EAGAIN, "still busy");
+    err_log_flush();
+
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if(null_fd < 0)
+        error(EXIT_FAILURE, errno, "opening /dev/null failed");
+    printf("\n%d errors reported, messages going to /dev/null:\n",
+            ERR_BENCH_REPORTS);
+    printf("\t%-28s %7s %10s %10s %8s %8s %10s\n", "reporter", "threads",
+            "ns/report", "total ms", "lines", "dropped", "suppressed");
+    for(reporter how = REPORT_ERROR; how < NUM_REPORTERS; how++)
+    {
+        bench_reporter(how, 1, null_fd);
+        bench_reporter(how, ERR_BENCH_THREADS, null_fd);
+    }
+    close(null_fd);
+    printf("\nerror formats and writes every message on the spot, under the "
+           "stderr lock.\nerr_report only fills in a record, and drops it "
+           "(counted) when the flusher\ncan't keep up; \"total ms\" "
+           "includes the final flush.\n\n");
+}
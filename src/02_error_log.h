@@ -0,0 +1,83 @@
+#ifndef ERROR_LOG_H
+#define ERROR_LOG_H
+
+#include <stddef.h>     /* size_t */
+#include <stdatomic.h>  /* atomic_long, atomic_uint */
+#include <time.h>       /* struct timespec */
+
+/* slots in each thread's ring, a power of two */
+#ifndef ERR_RING_LEN
+#define ERR_RING_LEN 4096
+#endif
+
+/* how often the flusher thread empties the rings */
+#ifndef ERR_FLUSH_MS
+#define ERR_FLUSH_MS 10
+#endif
+
+/* default for err_log_rate_limit */
+#ifndef ERR_RATE_LIMIT
+#define ERR_RATE_LIMIT 10
+#endif
+
+/* one place in the code that reports errors, err_report makes these */
+typedef struct _err_site {
+    const char * file;
+    unsigned int line;
+    atomic_long window;         /* second the count is for */
+    atomic_uint count;          /* records this second */
+    atomic_uint suppressed;     /* turned away since the last record */
+    atomic_int listed;          /* on the list err_log_flush goes through */
+    struct _err_site * next;
+} err_site;
+
+/* what goes in the ring. file and what have to be string literals, only the
+ * pointers are kept */
+typedef struct _err_record {
+    int errnum;
+    const char * name;          /* errno_name, "E2BIG" */
+    const char * file;
+    unsigned int line;
+    const char * what;
+    unsigned int suppressed;    /* from the same site before this one */
+    struct timespec when;
+} err_record;
+
+typedef struct _err_log_stats {
+    size_t recorded;    /* made it into a ring */
+    size_t suppressed;  /* turned away by the rate limit */
+    size_t dropped;     /* ring was full */
+    size_t written;     /* lines the flusher wrote */
+} err_log_stats;
+
+/* records a site may make per second, 0 for no limit. Like
+ * error_one_per_line, but by the clock instead of by repeats */
+extern unsigned int err_log_rate_limit;
+
+/* starts the flusher thread writing to fd. 0, or an errno value */
+int err_log_start(int fd);
+
+/* writes out everything recorded so far, from any thread, and a line for
+ * each site with reports turned away since its last record */
+void err_log_flush(void);
+
+/* flushes and stops the flusher. Anything reported after waits in the rings
+ * for the next err_log_flush or err_log_start */
+void err_log_stop(void);
+
+err_log_stats err_log_get_stats(void);
+
+/* never blocks or allocates, except for a thread's first report */
+void err_log_record(err_site * site, int errnum, const char * what);
+
+/* err_report(errno, "fopen failed") records where it's called from */
+#define err_report(errnum, what)                                        \
+    do {                                                                \
+        static err_site err_site_ = { __FILE__, __LINE__, 0, 0, 0, 0,   \
+                                        NULL };                         \
+        err_log_record(&err_site_, (errnum), (what));                   \
+    } while(0)
+
+void error_log_demo(void);
+
+#endif /* ERROR_LOG_H */
@@ -0,0 +1,435 @@
+/* Section 4.1 & 4.2 continued -- classifying and converting whole buffers
+ *
+ * char_classification_demo and char_case_conversion_demo call the ctype.h
+ * functions one byte at a time. Each call is cheap (glibc's are a lookup in a
+ * per-locale table found through __ctype_b_loc), but it is still a call, a
+ * thread-local lookup and a table load per byte, and the compiler can't
+ * vectorize across it.
+ *
+ * For big buffers we can do better by taking a snapshot of the locale once:
+ *      - ctype_bulk_init runs toupper, tolower and every is* function over
+ *        all 256 byte values and keeps the answers in tables, so the result
+ *        is exactly what the per-byte calls would have said for that locale
+ *      - case conversion of ASCII is just flipping bit 0x20 of 'a'..'z' or
+ *        'A'..'Z', which SSE2 can do 16 bytes at a time. Any block with a
+ *        byte >= 0x80 in it goes through the snapshot tables instead, as does
+ *        everything if the locale maps ASCII letters some other way
+ *      - class membership of a 7-bit byte can be answered for 32 bytes at a
+ *        time with two AVX2 shuffles (vpshufb): one 16 entry table indexed by
+ *        the low nibble gives a bit per high nibble that is in the class, the
+ *        other indexed by the high nibble selects that bit. Bytes >= 0x80
+ *        come out as 0 and get patched from the snapshot
+ *      - counting every class at once is a 256 bucket histogram followed by
+ *        adding each bucket into the classes its byte belongs to
+ *
+ * Like the ctype functions themselves the tables follow LC_CTYPE, so call
+ * ctype_bulk_init again after a setlocale. The first snapshot is taken under
+ * pthread_once, so any number of threads can start using these at once, but
+ * ctype_bulk_init rewrites the tables in place: no other thread may be in a
+ * ctype_bulk_* call while it runs, the same as with setlocale itself.
+ * */
+
+#include "04_bulk_ctype.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* malloc, free */
+#include <string.h>     /* memset, strlen */
+#include <ctype.h>      /* is*, toupper, tolower */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+#include <pthread.h>    /* pthread_once */
+#ifdef __SSE2__
+#include <immintrin.h>  /* SSE2 and AVX2 intrinsics */
+#endif
+
+/* size of the benchmark buffer */
+#ifndef CTYPE_BENCH_BYTES
+#define CTYPE_BENCH_BYTES (32UL << 20)
+#endif
+
+const char * const ctype_class_names[CTYPE_NUM_CLASSES] = {
+    "lower", "upper", "alpha", "digit", "alnum", "xdigit",
+    "punct", "space", "blank", "graph", "print", "cntrl"
+};
+
+static struct {
+    int ascii_case_standard;    /* the locale maps a-z <-> A-Z and that's it */
+    int has_avx2;
+    unsigned char upper[256];
+    unsigned char lower[256];
+    uint16_t classes[256];
+    /* for each class, indexed by low nibble: bit h set if (h << 4 | low) is
+     * in the class, for h < 8 */
+    unsigned char nibble_lut[CTYPE_NUM_CLASSES][16];
+} tables;
+
+static int byte_in_class(int c, ctype_class cls)
+{
+    switch(cls)
+    {
+        case CTYPE_LOWER:   return islower(c);
+        case CTYPE_UPPER:   return isupper(c);
+        case CTYPE_ALPHA:   return isalpha(c);
+        case CTYPE_DIGIT:   return isdigit(c);
+        case CTYPE_ALNUM:   return isalnum(c);
+        case CTYPE_XDIGIT:  return isxdigit(c);
+        case CTYPE_PUNCT:   return ispunct(c);
+        case CTYPE_SPACE:   return isspace(c);
+        case CTYPE_BLANK:   return isblank(c);
+        case CTYPE_GRAPH:   return isgraph(c);
+        case CTYPE_PRINT:   return isprint(c);
+        case CTYPE_CNTRL:   return iscntrl(c);
+        default:            return 0;
+    }
+}
+
+static void tables_fill(void)
+{
+    tables.ascii_case_standard = 1;
+    memset(tables.nibble_lut, 0, sizeof(tables.nibble_lut));
+
+    for(int c = 0; c < 256; c++)
+    {
+        tables.upper[c] = toupper(c);
+        tables.lower[c] = tolower(c);
+
+        int ascii_upper = (c >= 'a' && c <= 'z') ? c - 0x20 : c;
+        int ascii_lower = (c >= 'A' && c <= 'Z') ? c + 0x20 : c;
+        if(c < 0x80 && (tables.upper[c] != ascii_upper ||
+                        tables.lower[c] != ascii_lower))
+            tables.ascii_case_standard = 0;
+
+        tables.classes[c] = 0;
+        for(int cls = 0; cls < CTYPE_NUM_CLASSES; cls++)
+        {
+            if(!byte_in_class(c, cls))
+                continue;
+            tables.classes[c] |= 1U << cls;
+            if(c < 0x80)
+                tables.nibble_lut[cls][c & 0x0f] |= 1U << (c >> 4);
+        }
+    }
+
+#ifdef __SSE2__
+    tables.has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+}
+
+/* the snapshot for whatever locale is current on first use */
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void tables_taken(void)
+{
+}
+
+void ctype_bulk_init(void)
+{
+    tables_fill();
+    /* first use mustn't take a snapshot of its own over this one */
+    pthread_once(&tables_once, tables_taken);
+}
+
+static void convert_scalar(unsigned char * dst, const unsigned char * src,
+        size_t len, const unsigned char * table)
+{
+    for(size_t i = 0; i < len; i++)
+        dst[i] = table[src[i]];
+}
+
+/* flip 0x20 on every byte in [first, last], table handles the rest */
+static void convert_case(unsigned char * dst, const unsigned char * src,
+        size_t len, char first, char last, const unsigned char * table)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    if(tables.ascii_case_standard)
+    {
+        __m128i below = _mm_set1_epi8(first - 1);
+        __m128i above = _mm_set1_epi8(last + 1);
+        __m128i flip = _mm_set1_epi8(0x20);
+        for(; i + 16 <= len; i += 16)
+        {
+            __m128i c = _mm_loadu_si128((const __m128i *)(src + i));
+            if(_mm_movemask_epi8(c) != 0)
+            {
+                convert_scalar(dst + i, src + i, 16, table);
+                continue;
+            }
+            /* bytes >= 0x80 would be negative here, which is why blocks
+             * holding them were sent to the table above */
+            __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(c, below),
+                                                _mm_cmplt_epi8(c, above));
+            _mm_storeu_si128((__m128i *)(dst + i),
+                    _mm_xor_si128(c, _mm_and_si128(in_range, flip)));
+        }
+    }
+#else
+    (void)first;
+    (void)last;
+#endif
+
+    convert_scalar(dst + i, src + i, len - i, table);
+}
+
+void ctype_bulk_toupper(char * dst, const char * src, size_t len)
+{
+    pthread_once(&tables_once, tables_fill);
+    convert_case((unsigned char *)dst, (const unsigned char *)src, len,
+            'a', 'z', tables.upper);
+}
+
+void ctype_bulk_tolower(char * dst, const char * src, size_t len)
+{
+    pthread_once(&tables_once, tables_fill);
+    convert_case((unsigned char *)dst, (const unsigned char *)src, len,
+            'A', 'Z', tables.lower);
+}
+
+void ctype_bulk_classify(const char * src, size_t len, uint16_t * masks)
+{
+    const unsigned char * s = (const unsigned char *)src;
+    pthread_once(&tables_once, tables_fill);
+    for(size_t i = 0; i < len; i++)
+        masks[i] = tables.classes[s[i]];
+}
+
+#ifdef __SSE2__
+/* whole 64 byte words only, returns how many bytes it did */
+__attribute__((target("avx2,popcnt")))
+static size_t class_bits_avx2(const unsigned char * s, size_t len,
+        ctype_class cls, uint64_t * bits, size_t * count)
+{
+    __m256i lut_lo = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *)tables.nibble_lut[cls]));
+    /* high nibbles 8-15 select nothing, those bytes get patched below */
+    __m256i lut_hi = _mm256_setr_epi8(
+            1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+            1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m256i nibble = _mm256_set1_epi8(0x0f);
+    __m256i zero = _mm256_setzero_si256();
+    uint16_t cls_bit = 1U << cls;
+    size_t i = 0;
+
+    for(; i + 64 <= len; i += 64)
+    {
+        uint64_t word = 0;
+        for(int half = 0; half < 2; half++)
+        {
+            const unsigned char * p = s + i + 32 * half;
+            __m256i c = _mm256_loadu_si256((const __m256i *)p);
+            __m256i lo = _mm256_and_si256(c, nibble);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(c, 4), nibble);
+            __m256i hit = _mm256_and_si256(_mm256_shuffle_epi8(lut_lo, lo),
+                                            _mm256_shuffle_epi8(lut_hi, hi));
+            uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(
+                                _mm256_cmpeq_epi8(hit, zero));
+
+            uint32_t high = _mm256_movemask_epi8(c);
+            while(high != 0)
+            {
+                int b = __builtin_ctz(high);
+                if(tables.classes[p[b]] & cls_bit)
+                    mask |= 1U << b;
+                high &= high - 1;
+            }
+            word |= (uint64_t)mask << (32 * half);
+        }
+        bits[i / 64] = word;
+        *count += __builtin_popcountll(word);
+    }
+    return i;
+}
+#endif /* __SSE2__ */
+
+size_t ctype_bulk_class_bits(const char * src, size_t len, ctype_class cls,
+        uint64_t * bits)
+{
+    const unsigned char * s = (const unsigned char *)src;
+    size_t count = 0;
+    size_t i = 0;
+    pthread_once(&tables_once, tables_fill);
+
+#ifdef __SSE2__
+    if(tables.has_avx2)
+        i = class_bits_avx2(s, len, cls, bits, &count);
+#endif
+
+    uint16_t cls_bit = 1U << cls;
+    for(; i < len; i += 64)
+    {
+        uint64_t word = 0;
+        size_t n = len - i < 64 ? len - i : 64;
+        for(size_t b = 0; b < n; b++)
+            if(tables.classes[s[i + b]] & cls_bit)
+                word |= 1ULL << b;
+        bits[i / 64] = word;
+        count += __builtin_popcountll(word);
+    }
+    return count;
+}
+
+void ctype_bulk_count(const char * src, size_t len,
+        size_t counts[CTYPE_NUM_CLASSES])
+{
+    const unsigned char * s = (const unsigned char *)src;
+    /* four histograms so runs of the same byte don't all wait on one
+     * counter */
+    size_t hist[4][256] = { { 0 } };
+    size_t i = 0;
+    pthread_once(&tables_once, tables_fill);
+
+    for(; i + 4 <= len; i += 4)
+    {
+        hist[0][s[i]]++;
+        hist[1][s[i + 1]]++;
+        hist[2][s[i + 2]]++;
+        hist[3][s[i + 3]]++;
+    }
+    for(; i < len; i++)
+        hist[0][s[i]]++;
+
+    for(int cls = 0; cls < CTYPE_NUM_CLASSES; cls++)
+        counts[cls] = 0;
+    for(int c = 0; c < 256; c++)
+    {
+        size_t n = hist[0][c] + hist[1][c] + hist[2][c] + hist[3][c];
+        if(n == 0)
+            continue;
+        for(int cls = 0; cls < CTYPE_NUM_CLASSES; cls++)
+            if(tables.classes[c] & (1U << cls))
+                counts[cls] += n;
+    }
+}
+
+static void ctype_benchmark(void)
+{
+    size_t len = CTYPE_BENCH_BYTES;
+    char * src = malloc(len);
+    char * dst = malloc(len);
+    uint64_t * bits = malloc((len + 63) / 64 * sizeof(uint64_t));
+    if(src == NULL || dst == NULL || bits == NULL)
+        error(EXIT_FAILURE, errno, "benchmark buffer allocation failed");
+
+    /* printable ASCII with the odd tab, newline and high byte */
+    unsigned long state = 1;
+    for(size_t i = 0; i < len; i++)
+    {
+        state = state * 1103515245UL + 12345UL;
+        unsigned r = (state >> 16) & 0x7fff;
+        if(r % 97 == 0)
+            src[i] = (char)(0x80 + r % 0x80);
+        else if(r % 61 == 0)
+            src[i] = (r & 1) ? '\t' : '\n';
+        else
+            src[i] = ' ' + r % 95;
+    }
+    printf("%zu bytes, current LC_CTYPE:\n", len);
+
+    struct timespec start = bench_now();
+    for(size_t i = 0; i < len; i++)
+        dst[i] = toupper((unsigned char)src[i]);
+    bench_print_throughput("toupper per byte", len,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    ctype_bulk_toupper(dst, src, len);
+    bench_print_throughput("ctype_bulk_toupper", len,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    ctype_bulk_tolower(dst, dst, len);
+    bench_print_throughput("ctype_bulk_tolower in-place", len,
+            bench_elapsed(start, bench_now()));
+
+    /* every class, the way char_classification_demo does it */
+    size_t slow_counts[CTYPE_NUM_CLASSES] = { 0 };
+    start = bench_now();
+    for(size_t i = 0; i < len; i++)
+    {
+        unsigned char c = src[i];
+        slow_counts[CTYPE_LOWER] += islower(c) != 0;
+        slow_counts[CTYPE_UPPER] += isupper(c) != 0;
+        slow_counts[CTYPE_ALPHA] += isalpha(c) != 0;
+        slow_counts[CTYPE_DIGIT] += isdigit(c) != 0;
+        slow_counts[CTYPE_ALNUM] += isalnum(c) != 0;
+        slow_counts[CTYPE_XDIGIT] += isxdigit(c) != 0;
+        slow_counts[CTYPE_PUNCT] += ispunct(c) != 0;
+        slow_counts[CTYPE_SPACE] += isspace(c) != 0;
+        slow_counts[CTYPE_BLANK] += isblank(c) != 0;
+        slow_counts[CTYPE_GRAPH] += isgraph(c) != 0;
+        slow_counts[CTYPE_PRINT] += isprint(c) != 0;
+        slow_counts[CTYPE_CNTRL] += iscntrl(c) != 0;
+    }
+    bench_print_throughput("12 is* calls per byte", len,
+            bench_elapsed(start, bench_now()));
+
+    size_t counts[CTYPE_NUM_CLASSES];
+    start = bench_now();
+    ctype_bulk_count(src, len, counts);
+    bench_print_throughput("ctype_bulk_count (all 12)", len,
+            bench_elapsed(start, bench_now()));
+
+    size_t isalpha_count = 0;
+    start = bench_now();
+    for(size_t i = 0; i < len; i++)
+        isalpha_count += isalpha((unsigned char)src[i]) != 0;
+    bench_print_throughput("isalpha per byte", len,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    size_t alpha_bits = ctype_bulk_class_bits(src, len, CTYPE_ALPHA, bits);
+    bench_print_throughput("ctype_bulk_class_bits alpha", len,
+            bench_elapsed(start, bench_now()));
+
+    int mismatches = 0;
+    for(int cls = 0; cls < CTYPE_NUM_CLASSES; cls++)
+        mismatches += counts[cls] != slow_counts[cls];
+    printf( "\tclass counts mismatching the is* calls: %d, "
+            "alpha %zu vs %zu\n",
+            mismatches, alpha_bits, isalpha_count);
+
+    free(bits);
+    free(dst);
+    free(src);
+}
+
+void ctype_bulk_demo(void)
+{
+    /* pick up whatever locale the demos before this one left behind */
+    ctype_bulk_init();
+
+    char * some_chars = "Here \xc3\x83rE s\xc3\xb5m\xc3\xa9 chAracters, "
+                        "and enough more of them to fill a vector or two";
+    size_t len = strlen(some_chars);
+    char * converted = malloc(len + 1);
+    if(converted == NULL)
+        error(EXIT_FAILURE, errno, "converted allocation failed");
+    converted[len] = '\0';
+
+    printf("bulk case conversion of a %zu byte string:\n\t%s\n", len,
+            some_chars);
+    ctype_bulk_toupper(converted, some_chars, len);
+    printf("\tupper: %s\n", converted);
+    ctype_bulk_tolower(converted, converted, len);
+    printf("\tlower: %s\n", converted);
+    free(converted);
+
+    /* one bitmap per class for the string char_classification_demo walks */
+    char * test_string = "UPPER lower alph4num3r1c 0xDEADbeef1337";
+    size_t test_len = strlen(test_string);
+    uint64_t bits[1];
+    printf("bulk classification bitmaps:\n\t%-7s %s\n", "", test_string);
+    for(int cls = 0; cls < CTYPE_NUM_CLASSES; cls++)
+    {
+        size_t n = ctype_bulk_class_bits(test_string, test_len, cls, bits);
+        printf("\t%-7s ", ctype_class_names[cls]);
+        for(size_t i = 0; i < test_len; i++)
+            putchar((bits[0] >> i) & 1 ? '^' : ' ');
+        printf(" %zu\n", n);
+    }
+
+    ctype_benchmark();
+    printf("\n");
+}
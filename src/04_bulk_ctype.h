@@ -0,0 +1,49 @@
+#ifndef BULK_CTYPE_H
+#define BULK_CTYPE_H
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint16_t, uint64_t */
+
+/* the classes from char_classification_demo, in the same order */
+typedef enum _ctype_class {
+    CTYPE_LOWER,
+    CTYPE_UPPER,
+    CTYPE_ALPHA,
+    CTYPE_DIGIT,
+    CTYPE_ALNUM,
+    CTYPE_XDIGIT,
+    CTYPE_PUNCT,
+    CTYPE_SPACE,
+    CTYPE_BLANK,
+    CTYPE_GRAPH,
+    CTYPE_PRINT,
+    CTYPE_CNTRL,
+    CTYPE_NUM_CLASSES
+} ctype_class;
+
+extern const char * const ctype_class_names[CTYPE_NUM_CLASSES];
+
+/* snapshot the current LC_CTYPE into lookup tables. Everything below takes
+ * one on first use, call this yourself after changing the locale, while no
+ * other thread is using them */
+void ctype_bulk_init(void);
+
+/* dst may be the same buffer as src for in-place conversion */
+void ctype_bulk_toupper(char * dst, const char * src, size_t len);
+void ctype_bulk_tolower(char * dst, const char * src, size_t len);
+
+/* masks[i] gets bit (1 << class) set for every class src[i] is in */
+void ctype_bulk_classify(const char * src, size_t len, uint16_t * masks);
+
+/* bit i of bits (bits[i / 64] >> (i % 64)) is set when src[i] is in cls,
+ * bits needs room for (len + 63) / 64 words. Returns how many were set */
+size_t ctype_bulk_class_bits(const char * src, size_t len, ctype_class cls,
+        uint64_t * bits);
+
+/* counts[class] = number of bytes of src in that class */
+void ctype_bulk_count(const char * src, size_t len,
+        size_t counts[CTYPE_NUM_CLASSES]);
+
+void ctype_bulk_demo(void);
+
+#endif /* BULK_CTYPE_H */
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <locale.h>
 #include <stdbool.h>
+#include "07_locale_manager.h"
 
 /* Section 4.1 -- Classification of Characters
  * All of the functions in this demo are from ctype.h, and they take an int
@@ -266,20 +267,24 @@ void char_case_conversion_demo(void)
 void wchar_classification_demo(void)
 {
     /* I don't know why yet but I need to set the locale before I can use wide
-     * chars */
-    setlocale(LC_ALL, "C.UTF-8");
+     * chars (the program starts in "C", which only knows ASCII). This only
+     * switches this thread, see 07_locale_manager.c */
+    locale_t previous = locale_push("C.UTF-8");
 
     wchar_t * wide_chars = L"Here ÃrE sõmé chAracters";
     wchar_t upper[30];
     wchar_t lower[30];
     size_t ucntr = 0;
     size_t lcntr = 0;
+    /* wctype looks the class up by name, so do it once instead of once per
+     * character (see 04_wctype_cache.c for taking this a lot further) */
+    wctype_t upper_desc = wctype("upper");
 
     /* size_t wcslen(const wchar_t * WS) is the equivalent of strlen */
     for(size_t i = 0; i < wcslen(wide_chars); i++)
     {
         /* show how to do it using iswctype */
-        if(iswctype(wide_chars[i], wctype("upper")))
+        if(iswctype(wide_chars[i], upper_desc))
             upper[ucntr++] = wide_chars[i];
 
         /* show how to do it using the iswlower function */
@@ -294,6 +299,7 @@ void wchar_classification_demo(void)
             upper,
             lower);
 
+    locale_pop(previous);
     return;
 }
 
@@ -322,15 +328,17 @@ void wchar_usage_demo(void)
 /* here we show the two methods you can use to map with wide characters */
 void wchar_mapping_demo(void)
 {
-    setlocale(LC_ALL, "C.UTF-8");
+    locale_t previous = locale_push("C.UTF-8");
     wchar_t * wide_chars = L"Here ÃrE sõmé chAracters";
     printf("wchar mapping demo string: %ls\n", wide_chars);
 
     printf("Converting to upper: ");
+    /* same deal as wctype, look the mapping up once */
+    wctrans_t toupper_desc = wctrans("toupper");
     for(size_t i = 0; i < wcslen(wide_chars); i++)
     {
         /* demo of how to do it for any class conversion */
-        printf("%lc", towctrans(wide_chars[i], wctrans("toupper")));
+        printf("%lc", towctrans(wide_chars[i], toupper_desc));
     }
     printf("\n");
 
@@ -342,6 +350,7 @@ void wchar_mapping_demo(void)
     }
     printf("\n");
 
+    locale_pop(previous);
     return;
 }
 
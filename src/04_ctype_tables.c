@@ -0,0 +1,290 @@
+/* Section 4.1 & 4.2 continued -- classification without the global locale
+ *
+ * Every ctype.h call goes through the global (well, per-thread) LC_CTYPE:
+ * isalpha(c) is really (*__ctype_b_loc())[c] & _ISalpha, a call to find the
+ * thread's locale tables and then the lookup. That's why the demos in this
+ * section and section 5 keep calling setlocale, and why the answer for a
+ * given byte can change underneath a loop if something else calls it.
+ *
+ * POSIX 2008 added a locale_t version of everything:
+ *      locale_t newlocale(int CATEGORY_MASK, const char *LOCALE, locale_t BASE)
+ *      locale_t uselocale(locale_t NEWLOC)
+ *      void freelocale(locale_t LOCOBJ)
+ *      int isalpha_l(int C, locale_t LOCALE)   ... and so on
+ * newlocale builds a locale object without touching the global one, and
+ * uselocale switches just the calling thread to it (uselocale(0) asks which
+ * one is in use). The _l functions take the locale explicitly, no lookup.
+ *
+ * Here that goes one step further:
+ *      - ctype_tables_c is the C/POSIX locale written out by the preprocessor,
+ *        256 entries each for the classes and both case maps, as plain const
+ *        data. Nothing to initialise, and the inline ct_is* functions are a
+ *        single load the compiler can see through
+ *      - ctype_tables_fill does the same for any locale_t by asking the _l
+ *        functions about every byte once
+ *
+ * The C locale is pinned down by POSIX: the classes only cover 7-bit ASCII and
+ * every byte >= 0x80 is in none of them, so the tables can't disagree with a
+ * conforming libc. The demo checks all 256 values (and EOF) anyway.
+ * */
+
+#include "04_ctype_tables.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* malloc, free */
+#include <ctype.h>      /* is*, is*_l, toupper, tolower */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+
+/* size of the benchmark buffer */
+#ifndef CTYPE_TABLES_BENCH_BYTES
+#define CTYPE_TABLES_BENCH_BYTES (32UL << 20)
+#endif
+
+/* the C locale's definitions of each class */
+#define C_LOWER(c)  ((c) >= 'a' && (c) <= 'z')
+#define C_UPPER(c)  ((c) >= 'A' && (c) <= 'Z')
+#define C_ALPHA(c)  (C_LOWER(c) || C_UPPER(c))
+#define C_DIGIT(c)  ((c) >= '0' && (c) <= '9')
+#define C_ALNUM(c)  (C_ALPHA(c) || C_DIGIT(c))
+#define C_XDIGIT(c) (C_DIGIT(c) || ((c) >= 'a' && (c) <= 'f') \
+                        || ((c) >= 'A' && (c) <= 'F'))
+#define C_GRAPH(c)  ((c) > ' ' && (c) < 0x7f)
+#define C_PRINT(c)  ((c) >= ' ' && (c) < 0x7f)
+#define C_PUNCT(c)  (C_GRAPH(c) && !C_ALNUM(c))
+#define C_SPACE(c)  ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+#define C_BLANK(c)  ((c) == ' ' || (c) == '\t')
+#define C_CNTRL(c)  ((c) < ' ' || (c) == 0x7f)
+
+#define C_CLASSES(c) (uint16_t)(                \
+        C_LOWER(c)  << CTYPE_LOWER  |           \
+        C_UPPER(c)  << CTYPE_UPPER  |           \
+        C_ALPHA(c)  << CTYPE_ALPHA  |           \
+        C_DIGIT(c)  << CTYPE_DIGIT  |           \
+        C_ALNUM(c)  << CTYPE_ALNUM  |           \
+        C_XDIGIT(c) << CTYPE_XDIGIT |           \
+        C_PUNCT(c)  << CTYPE_PUNCT  |           \
+        C_SPACE(c)  << CTYPE_SPACE  |           \
+        C_BLANK(c)  << CTYPE_BLANK  |           \
+        C_GRAPH(c)  << CTYPE_GRAPH  |           \
+        C_PRINT(c)  << CTYPE_PRINT  |           \
+        C_CNTRL(c)  << CTYPE_CNTRL)
+#define C_TOUPPER(c) (unsigned char)(C_LOWER(c) ? (c) - 'a' + 'A' : (c))
+#define C_TOLOWER(c) (unsigned char)(C_UPPER(c) ? (c) - 'A' + 'a' : (c))
+
+/* F(0), F(1), ... F(255) */
+#define REP4(F, c)   F(c), F((c) + 1), F((c) + 2), F((c) + 3)
+#define REP16(F, c)  REP4(F, c), REP4(F, (c) + 4), REP4(F, (c) + 8), \
+                        REP4(F, (c) + 12)
+#define REP64(F, c)  REP16(F, c), REP16(F, (c) + 16), REP16(F, (c) + 32), \
+                        REP16(F, (c) + 48)
+#define REP256(F)    REP64(F, 0), REP64(F, 64), REP64(F, 128), REP64(F, 192)
+
+const ctype_tables ctype_tables_c = {
+    .classes = { REP256(C_CLASSES) },
+    .upper = { REP256(C_TOUPPER) },
+    .lower = { REP256(C_TOLOWER) },
+};
+
+static int byte_in_class_l(int c, ctype_class cls, locale_t loc)
+{
+    switch(cls)
+    {
+        case CTYPE_LOWER:   return islower_l(c, loc);
+        case CTYPE_UPPER:   return isupper_l(c, loc);
+        case CTYPE_ALPHA:   return isalpha_l(c, loc);
+        case CTYPE_DIGIT:   return isdigit_l(c, loc);
+        case CTYPE_ALNUM:   return isalnum_l(c, loc);
+        case CTYPE_XDIGIT:  return isxdigit_l(c, loc);
+        case CTYPE_PUNCT:   return ispunct_l(c, loc);
+        case CTYPE_SPACE:   return isspace_l(c, loc);
+        case CTYPE_BLANK:   return isblank_l(c, loc);
+        case CTYPE_GRAPH:   return isgraph_l(c, loc);
+        case CTYPE_PRINT:   return isprint_l(c, loc);
+        case CTYPE_CNTRL:   return iscntrl_l(c, loc);
+        default:            return 0;
+    }
+}
+
+/* the same through the plain functions, which use the thread's locale */
+static int byte_in_class(int c, ctype_class cls)
+{
+    switch(cls)
+    {
+        case CTYPE_LOWER:   return islower(c);
+        case CTYPE_UPPER:   return isupper(c);
+        case CTYPE_ALPHA:   return isalpha(c);
+        case CTYPE_DIGIT:   return isdigit(c);
+        case CTYPE_ALNUM:   return isalnum(c);
+        case CTYPE_XDIGIT:  return isxdigit(c);
+        case CTYPE_PUNCT:   return ispunct(c);
+        case CTYPE_SPACE:   return isspace(c);
+        case CTYPE_BLANK:   return isblank(c);
+        case CTYPE_GRAPH:   return isgraph(c);
+        case CTYPE_PRINT:   return isprint(c);
+        case CTYPE_CNTRL:   return iscntrl(c);
+        default:            return 0;
+    }
+}
+
+void ctype_tables_fill(ctype_tables * t, locale_t loc)
+{
+    for(int c = 0; c < 256; c++)
+    {
+        uint16_t classes = 0;
+        for(int cls = 0; cls < CTYPE_NUM_CLASSES; cls++)
+            if(byte_in_class_l(c, cls, loc))
+                classes |= 1U << cls;
+        t->classes[c] = classes;
+        t->upper[c] = toupper_l(c, loc);
+        t->lower[c] = tolower_l(c, loc);
+    }
+}
+
+/* number of (byte, class) pairs plus case mappings where t disagrees with
+ * the _l functions for loc, over every byte value and EOF */
+static int count_mismatches(const ctype_tables * t, locale_t loc)
+{
+    int mismatches = 0;
+    for(int c = EOF; c < 256; c++)
+    {
+        for(int cls = 0; cls < CTYPE_NUM_CLASSES; cls++)
+            mismatches += !ct_is(t, c, cls) != !byte_in_class_l(c, cls, loc);
+        mismatches += ct_toupper(t, c) != toupper_l(c, loc);
+        mismatches += ct_tolower(t, c) != tolower_l(c, loc);
+    }
+    return mismatches;
+}
+
+/* and the same against the plain ctype.h functions in the thread's locale */
+static int count_global_mismatches(const ctype_tables * t)
+{
+    int mismatches = 0;
+    for(int c = EOF; c < 256; c++)
+    {
+        for(int cls = 0; cls < CTYPE_NUM_CLASSES; cls++)
+            mismatches += !ct_is(t, c, cls) != !byte_in_class(c, cls);
+        mismatches += ct_toupper(t, c) != toupper(c);
+        mismatches += ct_tolower(t, c) != tolower(c);
+    }
+    return mismatches;
+}
+
+static void ctype_tables_benchmark(locale_t c_locale, const ctype_tables * utf8)
+{
+    size_t len = CTYPE_TABLES_BENCH_BYTES;
+    unsigned char * src = malloc(len);
+    unsigned char * dst = malloc(len);
+    if(src == NULL || dst == NULL)
+        error(EXIT_FAILURE, errno, "benchmark buffer allocation failed");
+
+    /* printable ASCII with the odd control character and high byte */
+    unsigned long state = 1;
+    for(size_t i = 0; i < len; i++)
+    {
+        state = state * 1103515245UL + 12345UL;
+        unsigned r = (state >> 16) & 0x7fff;
+        src[i] = r % 89 == 0 ? 0x80 + r % 0x80 : (r % 53 == 0 ? r % 32 :
+                    ' ' + r % 95);
+    }
+    printf("%zu bytes:\n", len);
+
+    size_t counts[4] = { 0 };
+    struct timespec start = bench_now();
+    for(size_t i = 0; i < len; i++)
+        counts[0] += isalnum(src[i]) != 0;
+    bench_print_throughput("isalnum (thread locale)", len,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    for(size_t i = 0; i < len; i++)
+        counts[1] += isalnum_l(src[i], c_locale) != 0;
+    bench_print_throughput("isalnum_l", len,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    for(size_t i = 0; i < len; i++)
+        counts[2] += ct_isalnum(src[i]);
+    bench_print_throughput("ct_isalnum (static C tables)", len,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    for(size_t i = 0; i < len; i++)
+        counts[3] += ct_is(utf8, src[i], CTYPE_ALNUM);
+    bench_print_throughput("ct_is (C.UTF-8 tables)", len,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    for(size_t i = 0; i < len; i++)
+        dst[i] = toupper(src[i]);
+    bench_print_throughput("toupper (thread locale)", len,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    for(size_t i = 0; i < len; i++)
+        dst[i] = ct_toupper(&ctype_tables_c, src[i]);
+    bench_print_throughput("ct_toupper (static C tables)", len,
+            bench_elapsed(start, bench_now()));
+
+    printf("\talnum counts: %zu %zu %zu %zu\n",
+            counts[0], counts[1], counts[2], counts[3]);
+
+    free(dst);
+    free(src);
+}
+
+void ctype_tables_demo(void)
+{
+    locale_t c_locale = newlocale(LC_CTYPE_MASK, "C", (locale_t)0);
+    if(c_locale == (locale_t)0)
+        error(EXIT_FAILURE, errno, "newlocale C failed");
+    locale_t utf8_locale = newlocale(LC_CTYPE_MASK, "C.UTF-8", (locale_t)0);
+    if(utf8_locale == (locale_t)0)
+    {
+        printf("\tC.UTF-8 is not installed, skipping\n\n");
+        freelocale(c_locale);
+        return;
+    }
+
+    ctype_tables utf8;
+    ctype_tables_fill(&utf8, utf8_locale);
+
+    /* the static tables against every way libc has of saying the same. The
+     * plain is*() calls get the C locale from uselocale, the global one is
+     * left alone for whatever else is running */
+    int c_l = count_mismatches(&ctype_tables_c, c_locale);
+    locale_t previous = uselocale(c_locale);
+    int c_global = count_global_mismatches(&ctype_tables_c);
+    uselocale(previous);
+    int utf8_l = count_mismatches(&utf8, utf8_locale);
+    printf( "ctype_tables_c mismatches over all 256 bytes and EOF:\n"
+            "\tvs is*_l(C) %d, vs is*() under uselocale C %d\n", c_l,
+            c_global);
+    printf( "ctype_tables_fill(C.UTF-8) mismatches vs is*_l(C.UTF-8): %d\n",
+            utf8_l);
+    /* any mismatch is a bug in the tables, not something to read past */
+    int mismatches = c_l + c_global + utf8_l;
+    printf("ctype tables check: %s\n", mismatches == 0 ? "PASS" : "FAIL");
+    if(mismatches != 0)
+        error(0, 0, "ctype tables disagree with libc in %d places",
+                mismatches);
+
+    /* uselocale switches only this thread, and hands back what it replaced */
+    previous = uselocale(utf8_locale);
+    printf( "after uselocale(C.UTF-8) the global LC_CTYPE is still %s, "
+            "the thread's is %s\n",
+            setlocale(LC_CTYPE, NULL),
+            uselocale((locale_t)0) == utf8_locale ? "C.UTF-8" : "unchanged");
+    uselocale(previous);
+
+    /* the plain calls in the benchmark count in C too, so the four alnum
+     * counts can be compared */
+    previous = uselocale(c_locale);
+    ctype_tables_benchmark(c_locale, &utf8);
+    uselocale(previous);
+
+    freelocale(utf8_locale);
+    freelocale(c_locale);
+    printf("\n");
+}
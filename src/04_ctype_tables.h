@@ -0,0 +1,56 @@
+#ifndef CTYPE_TABLES_H
+#define CTYPE_TABLES_H
+
+#include <stdint.h>         /* uint16_t */
+#include <locale.h>         /* locale_t */
+#include "04_bulk_ctype.h"  /* ctype_class */
+
+/* everything the ctype.h functions know about each byte value, for one
+ * locale. classes[c] has bit (1 << class) set for every class c is in */
+typedef struct _ctype_tables {
+    uint16_t classes[256];
+    unsigned char upper[256];
+    unsigned char lower[256];
+} ctype_tables;
+
+/* the C (and POSIX) locale, filled in by the compiler rather than at run time
+ * so it can't depend on what setlocale has been up to */
+extern const ctype_tables ctype_tables_c;
+
+/* fill t for loc (from newlocale, or uselocale(0) for the thread's current
+ * one) using the *_l functions, which never look at the global locale */
+void ctype_tables_fill(ctype_tables * t, locale_t loc);
+
+/* c is an unsigned char value or EOF, like the ctype.h functions take */
+static inline int ct_is(const ctype_tables * t, int c, ctype_class cls)
+{
+    return (unsigned)c < 256 && ((t->classes[c] >> cls) & 1);
+}
+
+static inline int ct_toupper(const ctype_tables * t, int c)
+{
+    return (unsigned)c < 256 ? t->upper[c] : c;
+}
+
+static inline int ct_tolower(const ctype_tables * t, int c)
+{
+    return (unsigned)c < 256 ? t->lower[c] : c;
+}
+
+/* C locale shortcuts */
+static inline int ct_islower(int c)  { return ct_is(&ctype_tables_c, c, CTYPE_LOWER); }
+static inline int ct_isupper(int c)  { return ct_is(&ctype_tables_c, c, CTYPE_UPPER); }
+static inline int ct_isalpha(int c)  { return ct_is(&ctype_tables_c, c, CTYPE_ALPHA); }
+static inline int ct_isdigit(int c)  { return ct_is(&ctype_tables_c, c, CTYPE_DIGIT); }
+static inline int ct_isalnum(int c)  { return ct_is(&ctype_tables_c, c, CTYPE_ALNUM); }
+static inline int ct_isxdigit(int c) { return ct_is(&ctype_tables_c, c, CTYPE_XDIGIT); }
+static inline int ct_ispunct(int c)  { return ct_is(&ctype_tables_c, c, CTYPE_PUNCT); }
+static inline int ct_isspace(int c)  { return ct_is(&ctype_tables_c, c, CTYPE_SPACE); }
+static inline int ct_isblank(int c)  { return ct_is(&ctype_tables_c, c, CTYPE_BLANK); }
+static inline int ct_isgraph(int c)  { return ct_is(&ctype_tables_c, c, CTYPE_GRAPH); }
+static inline int ct_isprint(int c)  { return ct_is(&ctype_tables_c, c, CTYPE_PRINT); }
+static inline int ct_iscntrl(int c)  { return ct_is(&ctype_tables_c, c, CTYPE_CNTRL); }
+
+void ctype_tables_demo(void);
+
+#endif /* CTYPE_TABLES_H */
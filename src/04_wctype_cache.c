@@ -0,0 +1,313 @@
+/* Section 4.3 - 4.5 continued -- caching wide character classes
+ *
+ * wchar_classification_demo shows the generic interface:
+ *      wctype_t wctype(const char *PROPERTY)
+ *      int iswctype(wint_t WC, wctype_t DESC)
+ * and wchar_mapping_demo the matching pair for conversions:
+ *      wctrans_t wctrans(const char *PROPERTY)
+ *      wint_t towctrans(wint_t WC, wctrans_t DESC)
+ *
+ * wctype and wctrans look the property name up by string compare in the
+ * locale data, so they belong outside any loop. Even with them hoisted out,
+ * every iswctype call still has to walk glibc's multi-level table for the
+ * current locale to find the bit it's after.
+ *
+ * The cache below resolves every standard class and both case maps once, and
+ * asks libc about every code point up front:
+ *      - the BMP (U+0000 - U+FFFF), where nearly all real text lives, gets
+ *        dense tables: a 16 bit class mask per code point (128 KB) and the
+ *        mapped character for each map (256 KB each)
+ *      - everything above is split into 256 code point blocks, and a top
+ *        level index picks the block. Most of those planes are unassigned or
+ *        private use, so most blocks are identical and share one copy. The
+ *        maps are stored as "add this to the code point" so blocks with the
+ *        same case pairing pattern look identical too
+ *
+ * After that a lookup is one or two loads with no calls at all, and the bulk
+ * functions over wchar_t buffers are tight loops. Like the snapshot in
+ * 04_bulk_ctype.c the tables belong to the LC_CTYPE that was current when
+ * the cache was created.
+ * */
+
+#include "04_wctype_cache.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* malloc, realloc, free */
+#include <string.h>     /* strcmp, memcmp, memset */
+#include <wctype.h>     /* wctype, iswctype, wctrans, towctrans */
+#include <locale.h>     /* setlocale */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+
+/* number of wide characters in the benchmark buffer */
+#ifndef WCACHE_BENCH_CHARS
+#define WCACHE_BENCH_CHARS (8UL << 20)
+#endif
+
+static const char * const wclass_names[WCLASS_NUM_CLASSES] = {
+    "alnum", "alpha", "blank", "cntrl", "digit", "graph",
+    "lower", "print", "punct", "space", "upper", "xdigit"
+};
+
+static const char * const wmap_names[WMAP_NUM_MAPS] = {
+    "toupper", "tolower"
+};
+
+int wctype_cache_class(const char * name)
+{
+    for(int i = 0; i < WCLASS_NUM_CLASSES; i++)
+        if(strcmp(name, wclass_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+int wctype_cache_map(const char * name)
+{
+    for(int i = 0; i < WMAP_NUM_MAPS; i++)
+        if(strcmp(name, wmap_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+static uint16_t classes_of(wint_t wc, const wctype_t * desc)
+{
+    uint16_t classes = 0;
+    for(int cls = 0; cls < WCLASS_NUM_CLASSES; cls++)
+        if(iswctype(wc, desc[cls]))
+            classes |= 1U << cls;
+    return classes;
+}
+
+wctype_cache * wctype_cache_create(void)
+{
+    wctype_t desc[WCLASS_NUM_CLASSES];
+    wctrans_t trans[WMAP_NUM_MAPS];
+
+    /* the only calls to wctype and wctrans */
+    for(int cls = 0; cls < WCLASS_NUM_CLASSES; cls++)
+    {
+        desc[cls] = wctype(wclass_names[cls]);
+        if(desc[cls] == 0)
+        {
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+    for(int map = 0; map < WMAP_NUM_MAPS; map++)
+    {
+        trans[map] = wctrans(wmap_names[map]);
+        if(trans[map] == 0)
+        {
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+
+    wctype_cache * cache = malloc(sizeof(wctype_cache));
+    if(cache == NULL)
+        error(EXIT_FAILURE, errno, "wctype cache allocation failed");
+
+    for(wint_t wc = 0; wc < WCACHE_BMP_LEN; wc++)
+    {
+        cache->bmp_classes[wc] = classes_of(wc, desc);
+        for(int map = 0; map < WMAP_NUM_MAPS; map++)
+            cache->bmp_map[map][wc] = towctrans(wc, trans[map]);
+    }
+
+    /* block 0 is the empty block: no classes, maps to itself */
+    size_t blocks_cap = 64;
+    cache->blocks = calloc(blocks_cap, sizeof(wcache_block));
+    if(cache->blocks == NULL)
+        error(EXIT_FAILURE, errno, "wctype cache block allocation failed");
+    cache->num_blocks = 1;
+
+    wcache_block block;
+    for(size_t b = 0; b < WCACHE_NUM_BLOCKS; b++)
+    {
+        wint_t base = WCACHE_BMP_LEN + b * WCACHE_BLOCK_LEN;
+        for(wint_t i = 0; i < WCACHE_BLOCK_LEN; i++)
+        {
+            block.classes[i] = classes_of(base + i, desc);
+            for(int map = 0; map < WMAP_NUM_MAPS; map++)
+                block.delta[map][i] = (int32_t)towctrans(base + i, trans[map])
+                                        - (int32_t)(base + i);
+        }
+
+        /* share with the empty block or the one before it when possible,
+         * that catches the long unassigned and private use stretches */
+        size_t last = cache->num_blocks - 1;
+        if(memcmp(&block, &cache->blocks[0], sizeof(block)) == 0)
+        {
+            cache->block_index[b] = 0;
+            continue;
+        }
+        if(memcmp(&block, &cache->blocks[last], sizeof(block)) == 0)
+        {
+            cache->block_index[b] = last;
+            continue;
+        }
+
+        if(cache->num_blocks == blocks_cap)
+        {
+            blocks_cap *= 2;
+            wcache_block * blocks = reallocarray(cache->blocks, blocks_cap,
+                                                    sizeof(wcache_block));
+            if(blocks == NULL)
+                error(EXIT_FAILURE, errno,
+                        "wctype cache block allocation failed");
+            cache->blocks = blocks;
+        }
+        cache->blocks[cache->num_blocks] = block;
+        cache->block_index[b] = cache->num_blocks++;
+    }
+
+    return cache;
+}
+
+void wctype_cache_destroy(wctype_cache * cache)
+{
+    if(cache == NULL)
+        return;
+    free(cache->blocks);
+    free(cache);
+}
+
+void wcache_classify(const wctype_cache * cache, const wchar_t * src,
+        size_t len, uint16_t * masks)
+{
+    for(size_t i = 0; i < len; i++)
+        masks[i] = wcache_classes(cache, src[i]);
+}
+
+size_t wcache_count(const wctype_cache * cache, const wchar_t * src,
+        size_t len, wclass cls)
+{
+    size_t count = 0;
+    for(size_t i = 0; i < len; i++)
+        count += (wcache_classes(cache, src[i]) >> cls) & 1;
+    return count;
+}
+
+void wcache_map_buf(const wctype_cache * cache, wchar_t * dst,
+        const wchar_t * src, size_t len, wmap map)
+{
+    for(size_t i = 0; i < len; i++)
+        dst[i] = wcache_map(cache, src[i], map);
+}
+
+static void wcache_benchmark(const wctype_cache * cache)
+{
+    /* ASCII, Latin-1, Greek, CJK, and a few from past the BMP: Deseret
+     * capital long I (which has a lower case), mathematical bold A, a frog */
+    static const wchar_t sample[] = L"Here ÃrE sõmé chAracters "
+        L"Αβγ 日本 123 \U00010400\U0001D400\U0001F438";
+    size_t sample_len = wcslen(sample);
+    size_t len = WCACHE_BENCH_CHARS;
+    wchar_t * src = malloc(len * sizeof(wchar_t));
+    wchar_t * dst = malloc(len * sizeof(wchar_t));
+    wchar_t * check = malloc(len * sizeof(wchar_t));
+    if(src == NULL || dst == NULL || check == NULL)
+        error(EXIT_FAILURE, errno, "benchmark buffer allocation failed");
+    for(size_t i = 0; i < len; i++)
+        src[i] = sample[i % sample_len];
+    size_t bytes = len * sizeof(wchar_t);
+    printf("%zu wide characters:\n", len);
+
+    /* the way wchar_classification_demo used to do it */
+    size_t slow_count = 0;
+    struct timespec start = bench_now();
+    for(size_t i = 0; i < len; i++)
+        slow_count += iswctype(src[i], wctype("upper")) != 0;
+    bench_print_throughput("iswctype(wctype()) per char", bytes,
+            bench_elapsed(start, bench_now()));
+
+    size_t hoisted_count = 0;
+    wctype_t upper = wctype("upper");
+    start = bench_now();
+    for(size_t i = 0; i < len; i++)
+        hoisted_count += iswctype(src[i], upper) != 0;
+    bench_print_throughput("iswctype, hoisted wctype", bytes,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    size_t cached_count = wcache_count(cache, src, len, WCLASS_UPPER);
+    bench_print_throughput("wcache_count", bytes,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    for(size_t i = 0; i < len; i++)
+        check[i] = towctrans(src[i], wctrans("toupper"));
+    bench_print_throughput("towctrans, wctrans per char", bytes,
+            bench_elapsed(start, bench_now()));
+
+    wctrans_t toupper_desc = wctrans("toupper");
+    start = bench_now();
+    for(size_t i = 0; i < len; i++)
+        check[i] = towctrans(src[i], toupper_desc);
+    bench_print_throughput("towctrans, hoisted wctrans", bytes,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    wcache_map_buf(cache, dst, src, len, WMAP_TOUPPER);
+    bench_print_throughput("wcache_map_buf", bytes,
+            bench_elapsed(start, bench_now()));
+
+    printf( "\tupper counts: %zu %zu %zu, mapped buffers %s\n",
+            slow_count, hoisted_count, cached_count,
+            memcmp(dst, check, bytes) == 0 ? "match" : "DIFFER");
+
+    free(check);
+    free(dst);
+    free(src);
+}
+
+void wchar_cache_demo(void)
+{
+    char * saved = strdup(setlocale(LC_CTYPE, NULL));
+    if(saved == NULL)
+        error(EXIT_FAILURE, errno, "locale name allocation failed");
+    /* a cache for "C" would only know ASCII, and print the wrong answers */
+    if(setlocale(LC_CTYPE, "C.UTF-8") == NULL)
+    {
+        printf("\tC.UTF-8 is not installed, skipping the wctype cache\n\n");
+        free(saved);
+        return;
+    }
+
+    struct timespec start = bench_now();
+    wctype_cache * cache = wctype_cache_create();
+    if(cache == NULL)
+        error(EXIT_FAILURE, errno, "wctype_cache_create failed");
+    printf( "wctype cache for %s built in %.4f s, %zu shared blocks past "
+            "the BMP (%zu KB)\n",
+            setlocale(LC_CTYPE, NULL),
+            bench_elapsed(start, bench_now()),
+            cache->num_blocks,
+            (sizeof(wctype_cache) + cache->num_blocks * sizeof(wcache_block))
+                >> 10);
+
+    wchar_t * wide_chars = L"Here ÃrE sõmé chAracters "
+                            L"\U00010400\U00010428";
+    wchar_t upper[40];
+    size_t len = wcslen(wide_chars);
+    size_t ucntr = 0;
+    int upper_cls = wctype_cache_class("upper");
+    for(size_t i = 0; i < len; i++)
+        if(wcache_is(cache, wide_chars[i], upper_cls))
+            upper[ucntr++] = wide_chars[i];
+    upper[ucntr] = L'\0';
+    printf("Original String: %ls\n\tUpper: %ls\n", wide_chars, upper);
+
+    wchar_t mapped[40];
+    wcache_map_buf(cache, mapped, wide_chars, len + 1,
+                    wctype_cache_map("tolower"));
+    printf("\tLower: %ls\n", mapped);
+
+    wcache_benchmark(cache);
+    wctype_cache_destroy(cache);
+
+    setlocale(LC_CTYPE, saved);
+    free(saved);
+    printf("\n");
+}
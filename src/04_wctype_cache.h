@@ -0,0 +1,103 @@
+#ifndef WCTYPE_CACHE_H
+#define WCTYPE_CACHE_H
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint16_t, int32_t */
+#include <wchar.h>  /* wchar_t, wint_t */
+
+/* the classes every locale has to define, plus blank */
+typedef enum _wclass {
+    WCLASS_ALNUM,
+    WCLASS_ALPHA,
+    WCLASS_BLANK,
+    WCLASS_CNTRL,
+    WCLASS_DIGIT,
+    WCLASS_GRAPH,
+    WCLASS_LOWER,
+    WCLASS_PRINT,
+    WCLASS_PUNCT,
+    WCLASS_SPACE,
+    WCLASS_UPPER,
+    WCLASS_XDIGIT,
+    WCLASS_NUM_CLASSES
+} wclass;
+
+typedef enum _wmap {
+    WMAP_TOUPPER,
+    WMAP_TOLOWER,
+    WMAP_NUM_MAPS
+} wmap;
+
+#define WCACHE_BMP_LEN      0x10000
+#define WCACHE_MAX_CHAR     0x110000
+#define WCACHE_BLOCK_BITS   8
+#define WCACHE_BLOCK_LEN    (1 << WCACHE_BLOCK_BITS)
+#define WCACHE_NUM_BLOCKS   ((WCACHE_MAX_CHAR - WCACHE_BMP_LEN) / WCACHE_BLOCK_LEN)
+
+/* 256 code points above the BMP, maps are stored as deltas so identical
+ * blocks can be shared */
+typedef struct _wcache_block {
+    uint16_t classes[WCACHE_BLOCK_LEN];
+    int32_t delta[WMAP_NUM_MAPS][WCACHE_BLOCK_LEN];
+} wcache_block;
+
+/* dense tables for the BMP, a two-level table for everything past it */
+typedef struct _wctype_cache {
+    uint16_t bmp_classes[WCACHE_BMP_LEN];
+    wchar_t bmp_map[WMAP_NUM_MAPS][WCACHE_BMP_LEN];
+    uint16_t block_index[WCACHE_NUM_BLOCKS];
+    wcache_block * blocks;
+    size_t num_blocks;
+} wctype_cache;
+
+/* snapshot the current LC_CTYPE, NULL if a class or map can't be resolved */
+wctype_cache * wctype_cache_create(void);
+void wctype_cache_destroy(wctype_cache * cache);
+
+/* name ("upper", "toupper") to index, or -1, like wctype and wctrans */
+int wctype_cache_class(const char * name);
+int wctype_cache_map(const char * name);
+
+static inline uint16_t wcache_classes(const wctype_cache * cache, wint_t wc)
+{
+    if(wc < WCACHE_BMP_LEN)
+        return cache->bmp_classes[wc];
+    if(wc < WCACHE_MAX_CHAR)
+    {
+        wint_t off = wc - WCACHE_BMP_LEN;
+        return cache->blocks[cache->block_index[off >> WCACHE_BLOCK_BITS]]
+                    .classes[off & (WCACHE_BLOCK_LEN - 1)];
+    }
+    return 0;
+}
+
+static inline int wcache_is(const wctype_cache * cache, wint_t wc, wclass cls)
+{
+    return (wcache_classes(cache, wc) >> cls) & 1;
+}
+
+static inline wint_t wcache_map(const wctype_cache * cache, wint_t wc,
+        wmap map)
+{
+    if(wc < WCACHE_BMP_LEN)
+        return cache->bmp_map[map][wc];
+    if(wc < WCACHE_MAX_CHAR)
+    {
+        wint_t off = wc - WCACHE_BMP_LEN;
+        return wc + cache->blocks[cache->block_index[off >> WCACHE_BLOCK_BITS]]
+                        .delta[map][off & (WCACHE_BLOCK_LEN - 1)];
+    }
+    return wc;
+}
+
+/* bulk versions over wchar_t buffers */
+void wcache_classify(const wctype_cache * cache, const wchar_t * src,
+        size_t len, uint16_t * masks);
+size_t wcache_count(const wctype_cache * cache, const wchar_t * src,
+        size_t len, wclass cls);
+void wcache_map_buf(const wctype_cache * cache, wchar_t * dst,
+        const wchar_t * src, size_t len, wmap map);
+
+void wchar_cache_demo(void);
+
+#endif /* WCTYPE_CACHE_H */
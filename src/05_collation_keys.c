@@ -0,0 +1,276 @@
+/* Section 5.8 continued -- collating lots of strings
+ *
+ * string_collate_demo sorts with qsort and compare_elements, so strcoll runs
+ * once per comparison, or about n*log2(n) times. Every one of those calls
+ * walks the locale's collation tables for both strings from scratch, which is
+ * a lot of repeated work when n is in the millions.
+ *
+ * strxfrm is the manual's answer to that:
+ *      size_t strxfrm(char *restrict TO, const char *restrict FROM,
+ *                     size_t SIZE)
+ *
+ * It rewrites FROM into a key such that strcmp on two keys gives the same
+ * answer strcoll would have given on the originals. So we pay for the
+ * collation tables once per string and then compare plain bytes. The return
+ * value is the length of the whole key even when SIZE was too small, in which
+ * case the contents of TO are garbage and you try again with more room.
+ *
+ * collate_sort below:
+ *      1) transforms every string once into one pooled key buffer (no malloc
+ *         per key, the pool just doubles when it runs out)
+ *      2) radix sorts (LSD, one byte per pass) on the first 8 bytes of each
+ *         key, which are packed big-endian into an integer so they compare
+ *         the same way memcmp would
+ *      3) finishes each run of equal prefixes with qsort_r and memcmp
+ *
+ * Both the radix sort and the tie-break on the original index keep equal
+ * strings in their original order.
+ * */
+
+#include "05_collation_keys.h"
+#include "05_string_utils.h"    /* compare_elements */
+#include "bench.h"
+
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* malloc, free, qsort, qsort_r */
+#include <string.h>     /* strxfrm, strcoll, memcmp */
+#include <stdint.h>     /* uint64_t */
+#include <locale.h>     /* setlocale */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+
+/* number of strings sorted by the benchmark. The point of strxfrm only shows
+ * with millions of them, build with something like
+ * make CFLAGS+=-DCOLLATE_BENCH_STRINGS=10000000UL for a longer run */
+#ifndef COLLATE_BENCH_STRINGS
+#define COLLATE_BENCH_STRINGS 1000000UL
+#endif
+
+typedef struct _collate_key {
+    uint64_t prefix;    /* first 8 bytes of the key, big-endian */
+    size_t offset;      /* where the key starts in the pool */
+    size_t len;         /* key length without the null terminator */
+    size_t index;       /* position in the caller's array */
+} collate_key;
+
+static uint64_t key_prefix(const unsigned char * key, size_t len)
+{
+    uint64_t prefix = 0;
+    for(size_t i = 0; i < 8; i++)
+        prefix = (prefix << 8) | (i < len ? key[i] : 0);
+    return prefix;
+}
+
+/* qsort_r comparison for the keys left tied after the radix passes */
+static int compare_keys(const void * a, const void * b, void * pool)
+{
+    const collate_key * ka = a;
+    const collate_key * kb = b;
+    size_t min_len = ka->len < kb->len ? ka->len : kb->len;
+    int ret = memcmp((char *)pool + ka->offset, (char *)pool + kb->offset,
+                        min_len);
+    if(ret != 0)
+        return ret;
+    if(ka->len != kb->len)
+        return ka->len < kb->len ? -1 : 1;
+    return (ka->index > kb->index) - (ka->index < kb->index);
+}
+
+/* stable LSD radix sort on the prefix, keys ends up sorted */
+static void radix_sort_prefixes(collate_key * keys, collate_key * tmp,
+        size_t n)
+{
+    for(int shift = 0; shift < 64; shift += 8)
+    {
+        size_t count[256] = { 0 };
+        for(size_t i = 0; i < n; i++)
+            count[(keys[i].prefix >> shift) & 0xff]++;
+
+        /* every key has the same byte here, nothing would move */
+        if(count[(keys[0].prefix >> shift) & 0xff] == n)
+            continue;
+
+        size_t pos = 0;
+        for(int b = 0; b < 256; b++)
+        {
+            size_t c = count[b];
+            count[b] = pos;
+            pos += c;
+        }
+        for(size_t i = 0; i < n; i++)
+            tmp[count[(keys[i].prefix >> shift) & 0xff]++] = keys[i];
+        memcpy(keys, tmp, n * sizeof(collate_key));
+    }
+}
+
+void collate_sort(char * const * strs, size_t n, size_t * order)
+{
+    if(n == 0)
+        return;
+
+    collate_key * keys = malloc(n * sizeof(collate_key));
+    collate_key * tmp = malloc(n * sizeof(collate_key));
+    if(keys == NULL || tmp == NULL)
+        error(EXIT_FAILURE, errno, "collate key allocation failed");
+
+    /* keys tend to be a few times longer than the strings, start there */
+    size_t pool_cap = 64;
+    for(size_t i = 0; i < n; i++)
+        pool_cap += 4 * strlen(strs[i]);
+    size_t pool_used = 0;
+    char * pool = malloc(pool_cap);
+    if(pool == NULL)
+        error(EXIT_FAILURE, errno, "collate key pool allocation failed");
+
+    for(size_t i = 0; i < n; i++)
+    {
+        size_t avail = pool_cap - pool_used;
+        size_t len = strxfrm(pool + pool_used, strs[i], avail);
+        if(len >= avail)
+        {
+            /* didn't fit, grow and transform this one again */
+            while(pool_cap - pool_used <= len)
+                pool_cap *= 2;
+            char * new_pool = realloc(pool, pool_cap);
+            if(new_pool == NULL)
+                error(EXIT_FAILURE, errno, "collate key pool allocation failed");
+            pool = new_pool;
+            strxfrm(pool + pool_used, strs[i], pool_cap - pool_used);
+        }
+        keys[i].offset = pool_used;
+        keys[i].len = len;
+        keys[i].index = i;
+        keys[i].prefix = key_prefix((unsigned char *)pool + pool_used, len);
+        pool_used += len + 1;
+    }
+
+    radix_sort_prefixes(keys, tmp, n);
+
+    /* runs with the same prefix are only tied if some key is longer than the
+     * prefix, otherwise they really are equal and already in index order */
+    size_t run_start = 0;
+    for(size_t i = 1; i <= n; i++)
+    {
+        if(i < n && keys[i].prefix == keys[run_start].prefix)
+            continue;
+        if(i - run_start > 1)
+            qsort_r(keys + run_start, i - run_start, sizeof(collate_key),
+                    compare_keys, pool);
+        run_start = i;
+    }
+
+    for(size_t i = 0; i < n; i++)
+        order[i] = keys[i].index;
+
+    free(pool);
+    free(tmp);
+    free(keys);
+}
+
+/* deterministic word soup with some upper case and accented letters */
+static char ** make_bench_strings(size_t n, char ** storage)
+{
+    static const char * letters[] = {
+        "a", "b", "c", "d", "e", "f", "g", "h", "i", "l", "m", "n", "o", "r",
+        "s", "t", "u", "A", "E", "H", "S", "\xc3\xa9", "\xc3\xb6", "\xc3\x83"
+    };
+    size_t num_letters = sizeof(letters) / sizeof(letters[0]);
+    char ** strs = malloc(n * sizeof(char *));
+    /* 12 letters of at most 2 bytes plus the terminator */
+    char * buf = malloc(n * 25);
+    if(strs == NULL || buf == NULL)
+        error(EXIT_FAILURE, errno, "benchmark string allocation failed");
+
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    char * p = buf;
+    for(size_t i = 0; i < n; i++)
+    {
+        strs[i] = p;
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t len = 4 + (state >> 60) % 9;
+        for(size_t j = 0; j < len; j++)
+        {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            p = stpcpy(p, letters[(state >> 33) % num_letters]);
+        }
+        p++;
+    }
+
+    *storage = buf;
+    return strs;
+}
+
+static void collate_benchmark(const char * locale_name, char ** strs,
+        size_t n)
+{
+    if(setlocale(LC_COLLATE, locale_name) == NULL)
+    {
+        printf("\t%s is not installed, skipping\n", locale_name);
+        return;
+    }
+    printf("LC_COLLATE=%s, %zu strings:\n", locale_name, n);
+
+    /* baseline, strcoll on every comparison */
+    char ** sorted = malloc(n * sizeof(char *));
+    size_t * order = malloc(n * sizeof(size_t));
+    if(sorted == NULL || order == NULL)
+        error(EXIT_FAILURE, errno, "benchmark allocation failed");
+    memcpy(sorted, strs, n * sizeof(char *));
+    struct timespec start = bench_now();
+    qsort(sorted, n, sizeof(char *), compare_elements);
+    double strcoll_secs = bench_elapsed(start, bench_now());
+
+    start = bench_now();
+    collate_sort(strs, n, order);
+    double strxfrm_secs = bench_elapsed(start, bench_now());
+
+    /* strcoll ties may land in either order, so check the result is sorted
+     * instead of comparing the two arrays */
+    size_t out_of_order = 0;
+    for(size_t i = 1; i < n; i++)
+        if(strcoll(strs[order[i - 1]], strs[order[i]]) > 0)
+            out_of_order++;
+
+    printf( "\tqsort + strcoll:      %8.4f s\n"
+            "\tstrxfrm keys + radix: %8.4f s (%.1fx)\n"
+            "\tout of order pairs:   %zu\n",
+            strcoll_secs,
+            strxfrm_secs,
+            strxfrm_secs > 0.0 ? strcoll_secs / strxfrm_secs : 0.0,
+            out_of_order);
+
+    free(order);
+    free(sorted);
+}
+
+void string_collate_keys_demo(void)
+{
+    printf( "\t=====================================\n"
+            "\t=== Section 5.8 strxfrm sort keys ===\n"
+            "\t=====================================\n\n");
+
+    char * saved = strdup(setlocale(LC_COLLATE, NULL));
+    if(saved == NULL)
+        error(EXIT_FAILURE, errno, "locale name allocation failed");
+
+    /* the same four strings string_collate_demo sorts */
+    char * str_array[4] = { "Hello", "hello", "friday", "blurb" };
+    size_t order[4];
+    setlocale(LC_COLLATE, "C.UTF-8");
+    collate_sort(str_array, 4, order);
+    printf( "collate_sort order in C.UTF-8, str_array is left alone:\n"
+            "\t\"%s\" \"%s\" \"%s\" \"%s\"\n",
+            str_array[order[0]], str_array[order[1]],
+            str_array[order[2]], str_array[order[3]]);
+
+    char * storage;
+    char ** strs = make_bench_strings(COLLATE_BENCH_STRINGS, &storage);
+    collate_benchmark("en_US.UTF-8", strs, COLLATE_BENCH_STRINGS);
+    collate_benchmark("C.UTF-8", strs, COLLATE_BENCH_STRINGS);
+    free(strs);
+    free(storage);
+
+    setlocale(LC_COLLATE, saved);
+    free(saved);
+    printf("\n");
+}
@@ -0,0 +1,13 @@
+#ifndef COLLATION_KEYS_H
+#define COLLATION_KEYS_H
+
+#include <stddef.h> /* size_t */
+
+/* sort strs[0..n) by the current LC_COLLATE without touching strs. order[i]
+ * receives the index into strs of the i-th string in collated order, equal
+ * strings keep their original relative order */
+void collate_sort(char * const * strs, size_t n, size_t * order);
+
+void string_collate_keys_demo(void);
+
+#endif /* COLLATION_KEYS_H */
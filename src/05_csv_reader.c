@@ -0,0 +1,486 @@
+/* Section 5.10 continued -- splitting CSV at scale
+ *
+ * string_split_demo walks a handful of tokens with strtok, strtok_r and
+ * strsep, and custom_parser in 25_program_arguments.c splits --sections the
+ * same way. That is fine for a command line, but all three:
+ *      - need a null terminated string, so you first have to read a whole line
+ *        (getline) before you can start splitting it
+ *      - know nothing about quoting, "a, b" is two tokens to strsep
+ *      - rescan every byte once per delimiter character you pass them
+ *
+ * The reader below pulls the input in big blocks with read(2) (or maps the
+ * whole file with mmap(2), see chapter 13), and hands each row to a callback
+ * as an array of (pointer, length) slices into the block buffer. Nothing is
+ * allocated per field, the only allocations are the block buffer and the
+ * field array, and both only grow when a row doesn't fit.
+ *
+ * Parsing is done in two passes over each row while it is hot in cache:
+ *      1) find the end of the row, which is the first '\n' that is not inside
+ *         quotes. This is where the SSE2 search below is used, it looks for
+ *         '\n' and '"' 16 bytes at a time
+ *      2) split the row on the separator with the same search, and unescape
+ *         quoted fields in place, "" -> ". Inside quotes only '"' matters so
+ *         that part is plain memchr (glibc already ships a vectorized one)
+ *
+ * Doing the unescaping only after the whole row is in the buffer matters for
+ * the streaming case: a row cut in half by a block boundary is left untouched
+ * and re-parsed once the rest of it has been read.
+ * */
+
+#include "05_csv_reader.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf, snprintf */
+#include <stdlib.h>     /* malloc, realloc, free */
+#include <string.h>     /* memchr, memmove, strsep */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+#include <fcntl.h>      /* open */
+#include <unistd.h>     /* read, write, close, unlink */
+#include <sys/mman.h>   /* mmap, madvise */
+#include <sys/stat.h>   /* fstat */
+#ifdef __SSE2__
+#include <emmintrin.h>  /* _mm_cmpeq_epi8, _mm_movemask_epi8 */
+#endif
+
+/* size of the first read(2) block, doubled whenever a single row is larger */
+#ifndef CSV_BLOCK_LEN
+#define CSV_BLOCK_LEN (1UL << 20)
+#endif
+
+/* size of the generated benchmark file, build with something like
+ * make CFLAGS+=-DCSV_BENCH_BYTES=4294967296UL for a multi-GB run */
+#ifndef CSV_BENCH_BYTES
+#define CSV_BENCH_BYTES (16UL << 20)
+#endif
+
+/* per-call state, the field array is reused for every row */
+typedef struct _csv_reader {
+    char sep;
+    csv_row_fn row_fn;
+    void * user;
+    csv_field * fields;
+    size_t fields_cap;
+    csv_stats * stats;
+} csv_reader;
+
+/* first occurrence of a or b in [p, end), or end if there is neither */
+static char * csv_find2(char * p, char * end, char a, char b)
+{
+#ifdef __SSE2__
+    __m128i va = _mm_set1_epi8(a);
+    __m128i vb = _mm_set1_epi8(b);
+    while(end - p >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128( _mm_cmpeq_epi8(chunk, va),
+                                                    _mm_cmpeq_epi8(chunk, vb)));
+        if(mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while(p < end && *p != a && *p != b)
+        p++;
+    return p;
+}
+
+/* pointer to the '\n' that ends the row starting at p, or NULL if the row
+ * isn't complete yet. Like csv_split_row, a quote only starts a quoted field
+ * when it is the field's first byte, the inch mark in 32" screen is just a
+ * character and must not swallow the rest of the file */
+static char * csv_row_end(char * p, char * end, char sep)
+{
+    char * row = p;
+    for(;;)
+    {
+        p = csv_find2(p, end, '\n', '"');
+        if(p == end)
+            return NULL;
+        if(*p == '\n')
+            return p;
+        if(p != row && p[-1] != sep)
+        {
+            p++;
+            continue;
+        }
+
+        /* inside quotes only a quote can get us out, "" is an escaped one */
+        for(p++;; p += 2)
+        {
+            p = memchr(p, '"', end - p);
+            if(p == NULL || p + 1 == end)
+                return NULL;
+            if(p[1] != '"')
+                break;
+        }
+        p++;
+    }
+}
+
+/* split [p, row_end) into r->fields, returns the number of fields */
+static size_t csv_split_row(csv_reader * r, char * p, char * row_end)
+{
+    size_t n = 0;
+
+    /* CRLF line endings */
+    if(row_end > p && row_end[-1] == '\r')
+        row_end--;
+
+    for(;;)
+    {
+        if(n == r->fields_cap)
+        {
+            size_t new_cap = r->fields_cap * 2;
+            csv_field * new_fields = reallocarray(r->fields, new_cap,
+                                                    sizeof(csv_field));
+            if(new_fields == NULL)
+                error(EXIT_FAILURE, errno, "csv field array allocation failed");
+            r->fields = new_fields;
+            r->fields_cap = new_cap;
+        }
+
+        if(p < row_end && *p == '"')
+        {
+            /* quoted field, shift the contents left over each "" pair */
+            char * start = ++p;
+            char * out = p;
+            for(;;)
+            {
+                char * q = memchr(p, '"', row_end - p);
+                if(q == NULL)
+                    q = row_end; /* unterminated quote, take the rest */
+                if(out != p)
+                    memmove(out, p, q - p);
+                out += q - p;
+                if(q == row_end)
+                {
+                    p = row_end;
+                    break;
+                }
+                if(q + 1 < row_end && q[1] == '"')
+                {
+                    *out++ = '"';
+                    p = q + 2;
+                    continue;
+                }
+                p = q + 1;
+                break;
+            }
+            r->fields[n].data = start;
+            r->fields[n].len = out - start;
+
+            /* anything between the closing quote and the separator is
+             * dropped */
+            char * q = memchr(p, r->sep, row_end - p);
+            p = (q == NULL) ? row_end : q;
+        }
+        else
+        {
+            char * q = csv_find2(p, row_end, r->sep, r->sep);
+            r->fields[n].data = p;
+            r->fields[n].len = q - p;
+            p = q;
+        }
+        n++;
+
+        if(p >= row_end)
+            break;
+        p++; /* step over the separator */
+    }
+
+    return n;
+}
+
+/* hand every complete row in [buf, end) to the callback. At eof a trailing
+ * row without a newline counts as complete. Returns the number of bytes
+ * consumed, *stop is set to the callback's return value if it was non-zero */
+static size_t csv_parse_rows(csv_reader * r, char * buf, char * end,
+        int at_eof, int * stop)
+{
+    char * p = buf;
+    while(p < end)
+    {
+        char * row_end = csv_row_end(p, end, r->sep);
+        if(row_end == NULL)
+        {
+            if(!at_eof)
+                break;
+            row_end = end;
+        }
+
+        size_t n = csv_split_row(r, p, row_end);
+        if(r->stats != NULL)
+        {
+            r->stats->rows++;
+            r->stats->fields += n;
+        }
+        p = (row_end < end) ? row_end + 1 : end;
+
+        int ret = r->row_fn(r->fields, n, r->user);
+        if(ret != 0)
+        {
+            *stop = ret;
+            break;
+        }
+    }
+    return p - buf;
+}
+
+static void csv_reader_init(csv_reader * r, char sep, csv_row_fn row_fn,
+        void * user, csv_stats * stats)
+{
+    r->sep = sep;
+    r->row_fn = row_fn;
+    r->user = user;
+    r->fields_cap = 16;
+    r->fields = malloc(r->fields_cap * sizeof(csv_field));
+    if(r->fields == NULL)
+        error(EXIT_FAILURE, errno, "csv field array allocation failed");
+    r->stats = stats;
+    if(stats != NULL)
+    {
+        stats->rows = 0;
+        stats->fields = 0;
+        stats->bytes = 0;
+    }
+}
+
+int csv_read_buffer(char * buf, size_t len, char sep, csv_row_fn row_fn,
+        void * user, csv_stats * stats)
+{
+    csv_reader r;
+    int stop = 0;
+    csv_reader_init(&r, sep, row_fn, user, stats);
+    if(stats != NULL)
+        stats->bytes = len;
+    csv_parse_rows(&r, buf, buf + len, 1, &stop);
+    free(r.fields);
+    return stop;
+}
+
+int csv_read_fd(int fd, char sep, csv_row_fn row_fn, void * user,
+        csv_stats * stats)
+{
+    csv_reader r;
+    int stop = 0;
+    int ret = 0;
+    int at_eof = 0;
+    size_t buf_len = CSV_BLOCK_LEN;
+    size_t have = 0;
+    char * buf = malloc(buf_len);
+    if(buf == NULL)
+        error(EXIT_FAILURE, errno, "csv block allocation failed");
+    csv_reader_init(&r, sep, row_fn, user, stats);
+
+    while(!at_eof)
+    {
+        /* a single row is bigger than the whole block */
+        if(have == buf_len)
+        {
+            char * new_buf = realloc(buf, buf_len * 2);
+            if(new_buf == NULL)
+                error(EXIT_FAILURE, errno, "csv block allocation failed");
+            buf = new_buf;
+            buf_len *= 2;
+        }
+
+        ssize_t got = read(fd, buf + have, buf_len - have);
+        if(got < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            ret = -1;
+            break;
+        }
+        if(got == 0)
+            at_eof = 1;
+        have += got;
+        if(stats != NULL)
+            stats->bytes += got;
+
+        /* keep the partial row at the end for the next read */
+        size_t used = csv_parse_rows(&r, buf, buf + have, at_eof, &stop);
+        if(stop != 0)
+        {
+            ret = stop;
+            break;
+        }
+        memmove(buf, buf + used, have - used);
+        have -= used;
+    }
+
+    free(r.fields);
+    free(buf);
+    return ret;
+}
+
+int csv_read_mmap(const char * path, char sep, csv_row_fn row_fn, void * user,
+        csv_stats * stats)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return -1;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if(st.st_size == 0)
+    {
+        close(fd);
+        return csv_read_buffer(NULL, 0, sep, row_fn, user, stats);
+    }
+
+    /* MAP_PRIVATE with PROT_WRITE is copy-on-write, the in-place unescaping
+     * of quoted fields only dirties the pages it touches and never makes it
+     * back to the file */
+    char * map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                        fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return -1;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    int ret = csv_read_buffer(map, st.st_size, sep, row_fn, user, stats);
+    munmap(map, st.st_size);
+    return ret;
+}
+
+/* demo callback, prints every field of every row */
+static int print_row(const csv_field * fields, size_t num_fields, void * user)
+{
+    size_t * row_num = user;
+    printf("\trow %zu:", (*row_num)++);
+    for(size_t i = 0; i < num_fields; i++)
+        printf(" [%.*s]", (int)fields[i].len, fields[i].data);
+    printf("\n");
+    return 0;
+}
+
+/* benchmark callback, touches every field so the work can't be skipped */
+static int sum_field_lengths(const csv_field * fields, size_t num_fields,
+        void * user)
+{
+    size_t * total = user;
+    for(size_t i = 0; i < num_fields; i++)
+        *total += fields[i].len;
+    return 0;
+}
+
+/* fill a temporary file with roughly num_bytes of CSV, some of it quoted */
+static void csv_generate_file(char * path_template, size_t num_bytes)
+{
+    int fd = mkstemp(path_template);
+    if(fd < 0)
+        error(EXIT_FAILURE, errno, "mkstemp failed for %s", path_template);
+
+    size_t chunk_len = 1UL << 20;
+    char * chunk = malloc(chunk_len);
+    if(chunk == NULL)
+        error(EXIT_FAILURE, errno, "csv chunk allocation failed");
+
+    size_t written = 0;
+    size_t row = 0;
+    while(written < num_bytes)
+    {
+        size_t used = 0;
+        while(used + 128 < chunk_len)
+        {
+            used += snprintf(chunk + used, chunk_len - used,
+                    "%zu,\"Lastname, Firstname %zu\",%zu.%02zu,"
+                    "plain text field,\"said \"\"hi\"\"\"\n",
+                    row, row % 997, row % 100000, row % 100);
+            row++;
+        }
+        char * p = chunk;
+        while(used > 0)
+        {
+            ssize_t n = write(fd, p, used);
+            if(n < 0)
+                error(EXIT_FAILURE, errno, "writing %s failed", path_template);
+            p += n;
+            used -= n;
+            written += n;
+        }
+    }
+
+    free(chunk);
+    close(fd);
+}
+
+void string_csv_demo(void)
+{
+    printf( "\t==================================\n"
+            "\t=== Section 5.10 CSV splitting ===\n"
+            "\t==================================\n\n");
+
+    /* quoted separators, escaped quotes, a quoted newline, CRLF, a bare quote
+     * inside an unquoted field, and an empty last field */
+    char * sample = strdupa( "id,name,comment\r\n"
+                            "1,\"Kermit, the\",\"says \"\"hi\"\"\"\r\n"
+                            "2,Piggy,\"two\nlines\"\n"
+                            "3,Fozzie,32\" screen\n"
+                            "4,Gonzo,");
+    size_t row_num = 0;
+    csv_stats stats;
+    printf("Parsing an in-memory sample:\n");
+    csv_read_buffer(sample, strlen(sample), ',', print_row, &row_num, &stats);
+    printf("\t%zu rows, %zu fields, %zu bytes\n", stats.rows, stats.fields,
+            stats.bytes);
+
+    /* throughput on a generated file */
+    char path[] = "/tmp/libc_notes_csv_XXXXXX";
+    csv_generate_file(path, CSV_BENCH_BYTES);
+    printf("Generated %lu MB of CSV in %s\n", CSV_BENCH_BYTES >> 20, path);
+
+    /* baseline: getline + strsep like string_split_demo, which doesn't even
+     * handle the quotes */
+    FILE * file = fopen(path, "r");
+    if(file == NULL)
+        error(EXIT_FAILURE, errno, "fopen %s failed", path);
+    char * line = NULL;
+    size_t line_cap = 0;
+    ssize_t line_len;
+    size_t strsep_bytes = 0;
+    size_t strsep_rows = 0;
+    size_t total = 0;
+    struct timespec start = bench_now();
+    while((line_len = getline(&line, &line_cap, file)) > 0)
+    {
+        char * rest = line;
+        char * token;
+        while((token = strsep(&rest, ",")) != NULL)
+            total += strlen(token);
+        strsep_bytes += line_len;
+        strsep_rows++;
+    }
+    bench_print_throughput("getline + strsep", strsep_bytes,
+            bench_elapsed(start, bench_now()));
+    free(line);
+    fclose(file);
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        error(EXIT_FAILURE, errno, "open %s failed", path);
+    start = bench_now();
+    if(csv_read_fd(fd, ',', sum_field_lengths, &total, &stats) < 0)
+        error(EXIT_FAILURE, errno, "csv_read_fd failed");
+    bench_print_throughput("csv_read_fd (read blocks)", stats.bytes,
+            bench_elapsed(start, bench_now()));
+    close(fd);
+
+    start = bench_now();
+    if(csv_read_mmap(path, ',', sum_field_lengths, &total, &stats) < 0)
+        error(EXIT_FAILURE, errno, "csv_read_mmap failed");
+    bench_print_throughput("csv_read_mmap", stats.bytes,
+            bench_elapsed(start, bench_now()));
+
+    printf( "\trows: strsep %zu, csv reader %zu (fields %zu)\n",
+            strsep_rows, stats.rows, stats.fields);
+
+    unlink(path);
+    printf("\n");
+}
@@ -0,0 +1,35 @@
+#ifndef CSV_READER_H
+#define CSV_READER_H
+
+#include <stddef.h> /* size_t */
+
+/* a field is a slice of the reader's block buffer, it is NOT null terminated
+ * and is only valid until the row callback returns */
+typedef struct _csv_field {
+    const char * data;
+    size_t len;
+} csv_field;
+
+/* return non-zero to stop reading */
+typedef int (*csv_row_fn)(const csv_field * fields, size_t num_fields,
+        void * user);
+
+typedef struct _csv_stats {
+    size_t rows;
+    size_t fields;
+    size_t bytes;
+} csv_stats;
+
+/* all three return 0 once the input is exhausted, the callback's non-zero
+ * value if it asked to stop, or -1 with errno set on failure. stats may be
+ * NULL */
+int csv_read_buffer(char * buf, size_t len, char sep, csv_row_fn row_fn,
+        void * user, csv_stats * stats);
+int csv_read_fd(int fd, char sep, csv_row_fn row_fn, void * user,
+        csv_stats * stats);
+int csv_read_mmap(const char * path, char sep, csv_row_fn row_fn, void * user,
+        csv_stats * stats);
+
+void string_csv_demo(void);
+
+#endif /* CSV_READER_H */
@@ -0,0 +1,385 @@
+/* Section 5.4 & 5.5 continued -- building big strings
+ *
+ * string_concat_demo shows why the manual is so grumpy about strcat: every
+ * call has to find the end of the destination again, so building a string out
+ * of n pieces with strcat costs O(n^2) bytes of scanning. string_copying_demo
+ * chains stpcpy instead, which fixes the scanning since stpcpy hands back the
+ * new end, but it writes into a fixed 20 byte buffer and nothing stops it from
+ * running off the end.
+ *
+ * strbuf keeps both halves of that lesson:
+ *      - it remembers its length, so appending is a mempcpy to a known spot
+ *      - it remembers its capacity and doubles it when it runs out, so n
+ *        appends cost O(n) copies in total (amortized)
+ *      - short strings live in a small buffer inside the struct itself, so
+ *        lots of little strings don't mean lots of little mallocs
+ *      - it is always null terminated, so strbuf_str can go straight to printf
+ *
+ * Doubling still copies the whole string on every grow, and needs one block
+ * as big as the final output. For very large outputs the rope below keeps a
+ * list of fixed size chunks instead. Appends never move old data, and the
+ * chunks can go straight to a file descriptor with writev (chapter 13.6)
+ * without ever being flattened.
+ * */
+
+#include "05_string_builder.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf, vsnprintf */
+#include <stdlib.h>     /* malloc, realloc, free */
+#include <string.h>     /* memcpy, mempcpy, memmove, strcat, stpcpy */
+#include <stdarg.h>     /* va_list */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+#include <fcntl.h>      /* open */
+#include <limits.h>     /* IOV_MAX */
+#include <unistd.h>     /* close */
+#include <sys/uio.h>    /* writev, struct iovec */
+
+/* size of each rope chunk, bigger appends get a chunk of their own */
+#ifndef ROPE_CHUNK_LEN
+#define ROPE_CHUNK_LEN (64UL << 10)
+#endif
+
+/* number of pieces appended in the small benchmark, which includes strcat,
+ * and in the large one which doesn't */
+#ifndef STRBUF_BENCH_PIECES
+#define STRBUF_BENCH_PIECES 20000UL
+#endif
+#ifndef STRBUF_BENCH_BIG_PIECES
+#define STRBUF_BENCH_BIG_PIECES 2000000UL
+#endif
+
+struct _rope_chunk {
+    rope_chunk * next;
+    size_t len;
+    size_t cap;
+    char data[];
+};
+
+void strbuf_init(strbuf * sb)
+{
+    sb->heap = NULL;
+    sb->len = 0;
+    sb->cap = STRBUF_INLINE_LEN;
+    sb->inline_buf[0] = '\0';
+}
+
+void strbuf_free(strbuf * sb)
+{
+    free(sb->heap);
+    strbuf_init(sb);
+}
+
+/* make room for len more bytes plus the terminator */
+void strbuf_reserve(strbuf * sb, size_t len)
+{
+    if(sb->len + len <= sb->cap)
+        return;
+
+    size_t new_cap = sb->cap * 2;
+    if(new_cap < sb->len + len)
+        new_cap = sb->len + len;
+
+    if(sb->heap == NULL)
+    {
+        /* moving out of the inline buffer */
+        char * heap = malloc(new_cap + 1);
+        if(heap == NULL)
+            error(EXIT_FAILURE, errno, "strbuf allocation failed");
+        memcpy(heap, sb->inline_buf, sb->len + 1);
+        sb->heap = heap;
+    }
+    else
+    {
+        char * heap = realloc(sb->heap, new_cap + 1);
+        if(heap == NULL)
+            error(EXIT_FAILURE, errno, "strbuf allocation failed");
+        sb->heap = heap;
+    }
+    sb->cap = new_cap;
+}
+
+void strbuf_append(strbuf * sb, const char * s, size_t len)
+{
+    strbuf_reserve(sb, len);
+    char * end = mempcpy(strbuf_str(sb) + sb->len, s, len);
+    *end = '\0';
+    sb->len += len;
+}
+
+void strbuf_append_str(strbuf * sb, const char * s)
+{
+    strbuf_append(sb, s, strlen(s));
+}
+
+void strbuf_appendf(strbuf * sb, const char * format, ...)
+{
+    va_list ap;
+
+    /* try to format straight into the space we already have */
+    va_start(ap, format);
+    int needed = vsnprintf(strbuf_str(sb) + sb->len, sb->cap - sb->len + 1,
+                            format, ap);
+    va_end(ap);
+    if(needed < 0)
+        error(EXIT_FAILURE, errno, "strbuf_appendf formatting failed");
+
+    if((size_t)needed > sb->cap - sb->len)
+    {
+        /* it got cut off, now we know how much room it needs */
+        strbuf_reserve(sb, needed);
+        va_start(ap, format);
+        vsnprintf(strbuf_str(sb) + sb->len, needed + 1, format, ap);
+        va_end(ap);
+    }
+    sb->len += needed;
+}
+
+void strbuf_insert(strbuf * sb, size_t pos, const char * s, size_t len)
+{
+    if(pos > sb->len)
+        pos = sb->len;
+    strbuf_reserve(sb, len);
+    char * str = strbuf_str(sb);
+    /* memmove because the old tail and its new spot overlap, + 1 moves the
+     * terminator along with it */
+    memmove(str + pos + len, str + pos, sb->len - pos + 1);
+    memcpy(str + pos, s, len);
+    sb->len += len;
+}
+
+void strbuf_clear(strbuf * sb)
+{
+    sb->len = 0;
+    strbuf_str(sb)[0] = '\0';
+}
+
+void rope_init(rope * r)
+{
+    r->head = NULL;
+    r->tail = NULL;
+    r->len = 0;
+}
+
+void rope_free(rope * r)
+{
+    rope_chunk * chunk = r->head;
+    while(chunk != NULL)
+    {
+        rope_chunk * next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    rope_init(r);
+}
+
+void rope_append(rope * r, const char * s, size_t len)
+{
+    r->len += len;
+    while(len > 0)
+    {
+        rope_chunk * tail = r->tail;
+        if(tail == NULL || tail->len == tail->cap)
+        {
+            size_t cap = len > ROPE_CHUNK_LEN ? len : ROPE_CHUNK_LEN;
+            tail = malloc(sizeof(rope_chunk) + cap);
+            if(tail == NULL)
+                error(EXIT_FAILURE, errno, "rope chunk allocation failed");
+            tail->next = NULL;
+            tail->len = 0;
+            tail->cap = cap;
+            if(r->tail == NULL)
+                r->head = tail;
+            else
+                r->tail->next = tail;
+            r->tail = tail;
+        }
+
+        /* fill what's left of the tail, then carry on into a new chunk */
+        size_t n = tail->cap - tail->len;
+        if(n > len)
+            n = len;
+        memcpy(tail->data + tail->len, s, n);
+        tail->len += n;
+        s += n;
+        len -= n;
+    }
+}
+
+void rope_flatten(const rope * r, char * out)
+{
+    for(rope_chunk * chunk = r->head; chunk != NULL; chunk = chunk->next)
+        out = mempcpy(out, chunk->data, chunk->len);
+    *out = '\0';
+}
+
+ssize_t rope_write(const rope * r, int fd)
+{
+    struct iovec iov[IOV_MAX];
+    ssize_t total = 0;
+    rope_chunk * chunk = r->head;
+    while(chunk != NULL)
+    {
+        int iovcnt = 0;
+        for(; chunk != NULL && iovcnt < IOV_MAX; chunk = chunk->next)
+        {
+            iov[iovcnt].iov_base = chunk->data;
+            iov[iovcnt].iov_len = chunk->len;
+            iovcnt++;
+        }
+
+        /* writev may stop short just like write, so walk the iovecs forward
+         * by whatever it managed */
+        struct iovec * vec = iov;
+        while(iovcnt > 0)
+        {
+            ssize_t n = writev(fd, vec, iovcnt);
+            if(n < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                return -1;
+            }
+            total += n;
+            while(iovcnt > 0 && (size_t)n >= vec->iov_len)
+            {
+                n -= vec->iov_len;
+                vec++;
+                iovcnt--;
+            }
+            if(iovcnt > 0)
+            {
+                vec->iov_base = (char *)vec->iov_base + n;
+                vec->iov_len -= n;
+            }
+        }
+    }
+    return total;
+}
+
+/* build the same string out of pieces every way, checking the outputs match */
+static void builder_benchmark(char ** pieces, size_t * piece_lens,
+        size_t num_pieces, int with_strcat)
+{
+    size_t total_len = 0;
+    for(size_t i = 0; i < num_pieces; i++)
+        total_len += piece_lens[i];
+    printf("%zu pieces, %zu bytes total:\n", num_pieces, total_len);
+
+    char * flat = malloc(total_len + 1);
+    if(flat == NULL)
+        error(EXIT_FAILURE, errno, "benchmark buffer allocation failed");
+    struct timespec start;
+
+    if(with_strcat)
+    {
+        /* the lazy and reckless way */
+        start = bench_now();
+        flat[0] = '\0';
+        for(size_t i = 0; i < num_pieces; i++)
+            strcat(flat, pieces[i]);
+        bench_print_throughput("strcat", total_len,
+                bench_elapsed(start, bench_now()));
+    }
+    else
+    {
+        printf("\t%-28s skipped, it is O(n^2)\n", "strcat");
+    }
+
+    /* stpcpy chain into a buffer we had to size up front */
+    start = bench_now();
+    char * p = flat;
+    for(size_t i = 0; i < num_pieces; i++)
+        p = stpcpy(p, pieces[i]);
+    bench_print_throughput("stpcpy chain (presized)", total_len,
+            bench_elapsed(start, bench_now()));
+
+    /* strbuf starting from nothing */
+    strbuf sb;
+    strbuf_init(&sb);
+    start = bench_now();
+    for(size_t i = 0; i < num_pieces; i++)
+        strbuf_append(&sb, pieces[i], piece_lens[i]);
+    bench_print_throughput("strbuf_append", sb.len,
+            bench_elapsed(start, bench_now()));
+    if(sb.len != total_len || memcmp(strbuf_str(&sb), flat, total_len) != 0)
+        printf("\tstrbuf output does not match!\n");
+    strbuf_free(&sb);
+
+    /* rope, then flattened so the comparison is fair */
+    rope r;
+    rope_init(&r);
+    start = bench_now();
+    for(size_t i = 0; i < num_pieces; i++)
+        rope_append(&r, pieces[i], piece_lens[i]);
+    bench_print_throughput("rope_append", r.len,
+            bench_elapsed(start, bench_now()));
+    char * flattened = malloc(r.len + 1);
+    if(flattened == NULL)
+        error(EXIT_FAILURE, errno, "flatten buffer allocation failed");
+    start = bench_now();
+    rope_flatten(&r, flattened);
+    bench_print_throughput("rope_flatten", r.len,
+            bench_elapsed(start, bench_now()));
+    if(r.len != total_len || memcmp(flattened, flat, total_len) != 0)
+        printf("\trope output does not match!\n");
+
+    int fd = open("/dev/null", O_WRONLY);
+    if(fd >= 0)
+    {
+        start = bench_now();
+        ssize_t written = rope_write(&r, fd);
+        bench_print_throughput("rope_write to /dev/null",
+                written < 0 ? 0 : (size_t)written,
+                bench_elapsed(start, bench_now()));
+        close(fd);
+    }
+
+    free(flattened);
+    rope_free(&r);
+    free(flat);
+}
+
+void string_builder_demo(void)
+{
+    printf( "\t==================================\n"
+            "\t=== Section 5.5 string builder ===\n"
+            "\t==================================\n\n");
+
+    strbuf sb;
+    strbuf_init(&sb);
+    strbuf_append_str(&sb, "Hello");
+    printf( "after append: \"%s\" len = %zu, on the heap: %s\n",
+            strbuf_str(&sb), sb.len, sb.heap != NULL ? "yes" : "no");
+    strbuf_appendf(&sb, ", world! %d + %d = %d", 2, 2, 4);
+    strbuf_insert(&sb, 5, " there", 6);
+    printf( "after appendf and insert: \"%s\" len = %zu, on the heap: %s\n",
+            strbuf_str(&sb), sb.len, sb.heap != NULL ? "yes" : "no");
+    strbuf_free(&sb);
+
+    /* the pieces are formatted once up front so the benchmark only measures
+     * the concatenation */
+    size_t max_pieces = STRBUF_BENCH_BIG_PIECES > STRBUF_BENCH_PIECES ?
+                        STRBUF_BENCH_BIG_PIECES : STRBUF_BENCH_PIECES;
+    char ** pieces = malloc(max_pieces * sizeof(char *));
+    size_t * piece_lens = malloc(max_pieces * sizeof(size_t));
+    char * storage = malloc(max_pieces * 24);
+    if(pieces == NULL || piece_lens == NULL || storage == NULL)
+        error(EXIT_FAILURE, errno, "benchmark piece allocation failed");
+    char * p = storage;
+    for(size_t i = 0; i < max_pieces; i++)
+    {
+        pieces[i] = p;
+        piece_lens[i] = sprintf(p, "item %zu, ", i);
+        p += piece_lens[i] + 1;
+    }
+
+    builder_benchmark(pieces, piece_lens, STRBUF_BENCH_PIECES, 1);
+    builder_benchmark(pieces, piece_lens, STRBUF_BENCH_BIG_PIECES, 0);
+
+    free(storage);
+    free(piece_lens);
+    free(pieces);
+    printf("\n");
+}
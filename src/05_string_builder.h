@@ -0,0 +1,55 @@
+#ifndef STRING_BUILDER_H
+#define STRING_BUILDER_H
+
+#include <stddef.h>     /* size_t */
+#include <sys/types.h>  /* ssize_t */
+
+/* strings up to this many bytes (plus the terminator) never touch the heap */
+#ifndef STRBUF_INLINE_LEN
+#define STRBUF_INLINE_LEN 31
+#endif
+
+/* length-tracked, always null terminated, growable string. heap is NULL while
+ * the contents still fit in inline_buf, use strbuf_str to get at them */
+typedef struct _strbuf {
+    char * heap;
+    size_t len;
+    size_t cap;
+    char inline_buf[STRBUF_INLINE_LEN + 1];
+} strbuf;
+
+void strbuf_init(strbuf * sb);
+void strbuf_free(strbuf * sb);
+void strbuf_reserve(strbuf * sb, size_t len);
+void strbuf_append(strbuf * sb, const char * s, size_t len);
+void strbuf_append_str(strbuf * sb, const char * s);
+void strbuf_appendf(strbuf * sb, const char * format, ...)
+    __attribute__((format(printf, 2, 3)));
+void strbuf_insert(strbuf * sb, size_t pos, const char * s, size_t len);
+void strbuf_clear(strbuf * sb);
+
+static inline char * strbuf_str(strbuf * sb)
+{
+    return sb->heap != NULL ? sb->heap : sb->inline_buf;
+}
+
+/* a rope is a list of fixed-size chunks, appends never move what is already
+ * there, so it suits outputs too big to keep reallocating */
+typedef struct _rope_chunk rope_chunk;
+typedef struct _rope {
+    rope_chunk * head;
+    rope_chunk * tail;
+    size_t len;
+} rope;
+
+void rope_init(rope * r);
+void rope_free(rope * r);
+void rope_append(rope * r, const char * s, size_t len);
+/* out needs room for r->len + 1 bytes */
+void rope_flatten(const rope * r, char * out);
+/* writes every chunk to fd with writev, returns bytes written or -1 */
+ssize_t rope_write(const rope * r, int fd);
+
+void string_builder_demo(void);
+
+#endif /* STRING_BUILDER_H */
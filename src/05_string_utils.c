@@ -39,6 +39,11 @@
  * */
 
 #include "05_string_utils.h"    
+#include "05_csv_reader.h"
+#include "05_collation_keys.h"
+#include "05_string_builder.h"
+#include "05_utf8.h"
+#include "07_locale_manager.h"
 
 #include "stdio.h"  /* printf */
 #include "string.h" /* most other functions used here for char strings */
@@ -55,24 +60,6 @@
 #define MAX_BUFF_LEN 4
 #endif
 
-/* run all of the subsections in order */
-void string_run_demos(void)
-{
-    string_length_demo();
-    string_copying_demo();
-    string_concat_demo();
-    string_truncate_demo();
-    string_compare_demo();
-    string_collate_demo();
-    string_search_demo();
-    string_split_demo();
-    string_erasing_demo();
-    string_shuffle_demo();
-    string_obfuscate_demo();
-    string_encode_demo();
-    string_argz_envz_demo();
-}
-
 /* Section 5.3 Notes 
  * The main thing to remember here is to not accidentally set it up to where
  * you try to read the length of something with no null terminator */
@@ -372,8 +359,48 @@ void string_concat_demo(void)
  * */
 void string_truncate_demo(void)
 {
-    /* not demo'd because I don't plan on using them */
-    /* These include functions like strncpy or strndup/strndupa */
+    printf( "\t===================\n"
+            "\t=== Section 5.6 ===\n"
+            "\t===================\n\n");
+
+    /* "résumé ⇒ 🐸" spelled out byte by byte so the lengths are obvious */
+    char * utf8_string = "r\xc3\xa9sum\xc3\xa9 \xe2\x87\x92 \xf0\x9f\x90\xb8";
+    size_t len = strlen(utf8_string);
+    printf( "\"%s\"\n"
+            "\tstrlen = %zu bytes, utf8_count = %zu code points\n",
+            utf8_string,
+            len,
+            utf8_count(utf8_string, len));
+
+    /* here is the problem, strndup happily cuts the second é in half */
+    char * cut = strndup(utf8_string, 7);
+    if(cut == NULL)
+        error(EXIT_FAILURE, errno, "cut allocation failed");
+    printf( "strndup(s, 7) = \"%s\", utf8_validate says %zu of %zu bytes "
+            "are valid\n",
+            cut,
+            utf8_validate(cut, strlen(cut)),
+            strlen(cut));
+    free(cut);
+
+    /* backing up to the start of the character fixes it */
+    size_t safe = utf8_truncate_bytes(utf8_string, len, 7);
+    printf( "utf8_truncate_bytes(s, 7) = %zu -> \"%.*s\"\n",
+            safe, (int)safe, utf8_string);
+
+    /* or cut on code points instead of bytes */
+    safe = utf8_truncate_chars(utf8_string, len, 8);
+    printf( "utf8_truncate_chars(s, 8) = %zu bytes -> \"%.*s\"\n",
+            safe, (int)safe, utf8_string);
+
+    /* 0xc0 0xaf is an overlong '/', a classic way to sneak past filters */
+    char * overlong = "a/b\xc0\xaf" "c";
+    printf( "utf8_validate on an overlong '/' stops at byte %zu of %zu\n",
+            utf8_validate(overlong, strlen(overlong)),
+            strlen(overlong));
+
+    utf8_benchmark();
+    printf("\n");
 }
 
 /* Section 5.7 Notes */
@@ -458,7 +485,7 @@ void string_collate_demo(void)
 
     /* run them with the en_US.UTF-8 locale */
     printf("setting locale to en_US.UTF-8\n");
-    setlocale(LC_ALL, "en_US.UTF-8");
+    locale_t previous = locale_push("en_US.UTF-8");
     printf("strcoll(\"h\",\"H\") = %d\n",strcoll("h","H"));
     qsort(str_array, 4, sizeof(char *), compare_elements);
     printf( "Array order after collated sort:\n"
@@ -469,8 +496,9 @@ void string_collate_demo(void)
             str_array[0],str_array[1],str_array[2],str_array[3]);
 
     /* running again with C.UTF-8 */
+    locale_pop(previous);
     printf("setting locale to C.UTF-8\n");
-    setlocale(LC_ALL, "C.UTF-8");
+    previous = locale_push("C.UTF-8");
     printf("strcoll(\"h\",\"H\") = %d\n",strcoll("h","H"));
     qsort(str_array, 4, sizeof(char *), compare_elements);
     printf( "Array order after collated sort:\n"
@@ -482,20 +510,30 @@ void string_collate_demo(void)
     
     /* strxfrm demo */
 
-    /* I appear to be experiencing a UTF-8 bug like what is described here 
+    /* I appeared to be experiencing a UTF-8 bug like what is described here 
      * https://stackoverflow.com/questions/51943128/how-to-use-strxfrm-in-c-language
-     */
+     * but really it was two mistakes of mine: the return value doesn't count
+     * the null terminator so the buffer needs len + 1 (and SIZE too, not
+     * len - 1), and the transformed key isn't text so printing it with %s
+     * shows garbage. Dumping the bytes works fine */
     /* if you pass size of 0 it'll return what size it would have needed for a
      * transformed string */
-    // setlocale(LC_ALL, "en_US.UTF-8");
-    // int len = strxfrm(NULL, "hello", 0);
-    // char * transformed_hello = malloc(len);
-    // if(transformed_hello == NULL)
-    //     error(EXIT_FAILURE, errno, "xfrm_hello allocation failed");
-    // strxfrm(transformed_hello, "hello", len-1);
-    // printf( "%s transformed into %s with strxfrm\n",
-    //         "hello",
-    //         transformed_hello);
+    size_t len = strxfrm(NULL, "hello", 0);
+    char * transformed_hello = malloc(len + 1);
+    if(transformed_hello == NULL)
+        error(EXIT_FAILURE, errno, "xfrm_hello allocation failed");
+    strxfrm(transformed_hello, "hello", len + 1);
+    printf("\"%s\" transformed into a %zu byte key with strxfrm:\n\t",
+            "hello",
+            len);
+    for(size_t i = 0; i < len; i++)
+        printf("%02x ", (unsigned char)transformed_hello[i]);
+    printf("\n");
+    free(transformed_hello);
+    locale_pop(previous);
+
+    /* sorting a lot of strings by their strxfrm keys is in
+     * 05_collation_keys.c */
     printf("\n");
 }
 
@@ -505,7 +543,7 @@ void string_collate_demo(void)
  * careful with multibyte strings */
 void string_search_demo(void)
 {
-    setlocale(LC_ALL, "en_US.UTF-8");
+    locale_t previous = locale_push("en_US.UTF-8");
     printf( "\t===================\n"
             "\t=== Section 5.9 ===\n"
             "\t===================\n\n");
@@ -571,6 +609,7 @@ void string_search_demo(void)
             result,
             num_matches);
 
+    locale_pop(previous);
     printf("\n");
 }
 
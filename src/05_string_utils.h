@@ -1,9 +1,7 @@
 #ifndef STRING_UTILS_H
 #define STRING_UTILS_H
 
-/* run all of the subsections in order */
-void string_run_demos(void);
-
+/* the subsections, string_demos in section_registry.c runs them in order */
 void string_length_demo(void);
 void string_copying_demo(void);
 void string_concat_demo(void);
@@ -18,4 +16,7 @@ void string_obfuscate_demo(void);
 void string_encode_demo(void);
 void string_argz_envz_demo(void);
 
+/* qsort comparison for an array of char * using strcoll */
+int compare_elements(const void * s1, const void * s2);
+
 #endif /* STRING_UTILS_H */
@@ -0,0 +1,359 @@
+/* Section 5.3 & 5.6 continued -- UTF-8 aware lengths and truncation
+ *
+ * strlen counts bytes, and strncpy/strndup cut at a byte count, so with UTF-8
+ * input you get the wrong length and can slice a character in half. The
+ * locale aware fix in libc is the chapter 6 machinery (mbrlen, mbstowcs),
+ * which works but goes through the LC_CTYPE conversion functions one
+ * character at a time.
+ *
+ * UTF-8 itself is simple enough to handle directly:
+ *
+ *      U+0000   - U+007F    0xxxxxxx
+ *      U+0080   - U+07FF    110xxxxx 10xxxxxx
+ *      U+0800   - U+FFFF    1110xxxx 10xxxxxx 10xxxxxx
+ *      U+10000  - U+10FFFF  11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
+ *
+ * so:
+ *      - counting code points is counting the bytes that are NOT 10xxxxxx
+ *      - a safe cut point is any byte that is not 10xxxxxx, so truncating is
+ *        backing up over at most 3 continuation bytes
+ *      - validating is a small state machine, and the only bytes that need it
+ *        at all are the ones with the top bit set
+ *
+ * Real text is mostly ASCII, so the validator checks 16 (SSE2) or 32 (AVX2)
+ * bytes at a time for any byte with the top bit set and only drops into the
+ * scalar state machine when it finds one. Counting is done the same width,
+ * comparing every byte against 0xBF as a signed char: continuation bytes are
+ * the only ones that are <= -65.
+ * */
+
+#include "05_utf8.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* malloc, free, mbstowcs */
+#include <string.h>     /* memcpy, strdup */
+#include <wchar.h>      /* mbrlen, mbstate_t */
+#include <locale.h>     /* setlocale */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+#include <pthread.h>    /* pthread_once */
+#ifdef __SSE2__
+#include <immintrin.h>  /* SSE2 and AVX2 intrinsics */
+#endif
+
+/* size of the generated benchmark text */
+#ifndef UTF8_BENCH_BYTES
+#define UTF8_BENCH_BYTES (32UL << 20)
+#endif
+
+static int is_continuation(unsigned char c)
+{
+    return (c & 0xc0) == 0x80;
+}
+
+/* length of the valid sequence starting at s[0], or 0 if it is invalid or
+ * runs past the end */
+static size_t utf8_sequence_len(const unsigned char * s, size_t avail)
+{
+    unsigned char c = s[0];
+    unsigned char lo = 0x80;
+    unsigned char hi = 0xbf;
+    size_t need;
+
+    if(c < 0x80)
+        return 1;
+    else if(c >= 0xc2 && c <= 0xdf)
+        need = 1;
+    else if(c >= 0xe0 && c <= 0xef)
+    {
+        need = 2;
+        if(c == 0xe0)
+            lo = 0xa0;  /* overlong */
+        else if(c == 0xed)
+            hi = 0x9f;  /* surrogates U+D800 - U+DFFF */
+    }
+    else if(c >= 0xf0 && c <= 0xf4)
+    {
+        need = 3;
+        if(c == 0xf0)
+            lo = 0x90;  /* overlong */
+        else if(c == 0xf4)
+            hi = 0x8f;  /* past U+10FFFF */
+    }
+    else
+        return 0;       /* stray continuation byte, 0xc0, 0xc1, 0xf5+ */
+
+    if(avail <= need)
+        return 0;
+    if(s[1] < lo || s[1] > hi)
+        return 0;
+    for(size_t i = 2; i <= need; i++)
+        if(!is_continuation(s[i]))
+            return 0;
+    return need + 1;
+}
+
+/* how many bytes from the start of s are plain ASCII, roughly: these only
+ * report whole blocks and the scalar loop finishes the rest */
+static size_t ascii_prefix_scalar(const unsigned char * s, size_t len)
+{
+    (void)s;
+    (void)len;
+    return 0;
+}
+
+#ifdef __SSE2__
+static size_t ascii_prefix_sse2(const unsigned char * s, size_t len)
+{
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(s + i));
+        if(_mm_movemask_epi8(chunk) != 0)
+            break;
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t ascii_prefix_avx2(const unsigned char * s, size_t len)
+{
+    size_t i = 0;
+    for(; i + 32 <= len; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(s + i));
+        if(_mm256_movemask_epi8(chunk) != 0)
+            break;
+    }
+    return i;
+}
+
+static size_t count_leads_sse2(const unsigned char * s, size_t len,
+        size_t * done)
+{
+    size_t count = 0;
+    size_t i = 0;
+    __m128i limit = _mm_set1_epi8(-65);
+    for(; i + 16 <= len; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(s + i));
+        count += __builtin_popcount(_mm_movemask_epi8(
+                    _mm_cmpgt_epi8(chunk, limit)));
+    }
+    *done = i;
+    return count;
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t count_leads_avx2(const unsigned char * s, size_t len,
+        size_t * done)
+{
+    size_t count = 0;
+    size_t i = 0;
+    __m256i limit = _mm256_set1_epi8(-65);
+    for(; i + 32 <= len; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(s + i));
+        count += __builtin_popcount((unsigned)_mm256_movemask_epi8(
+                    _mm256_cmpgt_epi8(chunk, limit)));
+    }
+    *done = i;
+    return count;
+}
+#endif /* __SSE2__ */
+
+static size_t count_leads_scalar(const unsigned char * s, size_t len,
+        size_t * done)
+{
+    (void)s;
+    (void)len;
+    *done = 0;
+    return 0;
+}
+
+/* picked once, the first time either is needed. pthread_once because the
+ * demos and the benchmark suite call these from several threads at once */
+static size_t (*ascii_prefix)(const unsigned char *, size_t) = NULL;
+static size_t (*count_leads)(const unsigned char *, size_t, size_t *) = NULL;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static void utf8_pick_kernels(void)
+{
+    ascii_prefix = ascii_prefix_scalar;
+    count_leads = count_leads_scalar;
+#ifdef __SSE2__
+    ascii_prefix = ascii_prefix_sse2;
+    count_leads = count_leads_sse2;
+    if(__builtin_cpu_supports("avx2"))
+    {
+        ascii_prefix = ascii_prefix_avx2;
+        count_leads = count_leads_avx2;
+    }
+#endif
+}
+
+size_t utf8_validate(const char * str, size_t len)
+{
+    const unsigned char * s = (const unsigned char *)str;
+    size_t i = 0;
+
+    pthread_once(&kernels_once, utf8_pick_kernels);
+
+    while(i < len)
+    {
+        i += ascii_prefix(s + i, len - i);
+        if(i >= len)
+            break;
+
+        /* the block that stopped the ASCII scan goes through the state
+         * machine, then try the fast path again */
+        size_t block_end = i + 32 < len ? i + 32 : len;
+        while(i < block_end)
+        {
+            if(s[i] < 0x80)
+            {
+                i++;
+                continue;
+            }
+            size_t n = utf8_sequence_len(s + i, len - i);
+            if(n == 0)
+                return i;
+            i += n;
+        }
+    }
+    return len;
+}
+
+size_t utf8_count(const char * str, size_t len)
+{
+    const unsigned char * s = (const unsigned char *)str;
+    size_t done;
+
+    pthread_once(&kernels_once, utf8_pick_kernels);
+
+    size_t count = count_leads(s, len, &done);
+    for(size_t i = done; i < len; i++)
+        count += !is_continuation(s[i]);
+    return count;
+}
+
+size_t utf8_truncate_bytes(const char * str, size_t len, size_t max_bytes)
+{
+    const unsigned char * s = (const unsigned char *)str;
+    if(max_bytes >= len)
+        return len;
+
+    /* s[max_bytes] is the first byte we'd drop, if it continues a sequence
+     * then back up to that sequence's lead byte and drop it too */
+    size_t cut = max_bytes;
+    while(cut > 0 && is_continuation(s[cut]))
+        cut--;
+    return cut;
+}
+
+size_t utf8_truncate_chars(const char * str, size_t len, size_t max_chars)
+{
+    const unsigned char * s = (const unsigned char *)str;
+    size_t i = 0;
+    while(i < len && max_chars > 0)
+    {
+        i++;
+        while(i < len && is_continuation(s[i]))
+            i++;
+        max_chars--;
+    }
+    return i;
+}
+
+char * utf8_bench_text(size_t len)
+{
+    static const char * words[] = {
+        "the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ",
+        "dog\n", "caf\xc3\xa9 ", "na\xc3\xafve ", "\xe2\x87\x92 ",
+        "\xe6\x97\xa5\xe6\x9c\xac ", "\xf0\x9f\x90\xb8 ", "r\xc3\xa9sum\xc3\xa9 "
+    };
+    size_t num_words = sizeof(words) / sizeof(words[0]);
+    char * text = malloc(len + 1);
+    if(text == NULL)
+        error(EXIT_FAILURE, errno, "benchmark text allocation failed");
+
+    unsigned long state = 12345;
+    char * p = text;
+    char * end = text + len;
+    for(;;)
+    {
+        state = state * 1103515245UL + 12345UL;
+        /* mostly plain words, the multibyte ones a quarter of the time */
+        size_t w = (state >> 16) % num_words;
+        if(w >= 8 && ((state >> 8) & 3) != 0)
+            w &= 7;
+        size_t wlen = strlen(words[w]);
+        if(p + wlen > end)
+            break;
+        p = mempcpy(p, words[w], wlen);
+    }
+    /* pad with spaces so the length is exactly len */
+    while(p < end)
+        *p++ = ' ';
+    *p = '\0';
+    return text;
+}
+
+void utf8_benchmark(void)
+{
+    char * saved = strdup(setlocale(LC_CTYPE, NULL));
+    if(saved == NULL)
+        error(EXIT_FAILURE, errno, "locale name allocation failed");
+    if(setlocale(LC_CTYPE, "C.UTF-8") == NULL)
+    {
+        printf("\tC.UTF-8 is not installed, skipping the benchmark\n");
+        free(saved);
+        return;
+    }
+
+    size_t len = UTF8_BENCH_BYTES;
+    char * text = utf8_bench_text(len);
+    struct timespec start;
+    printf("%zu bytes of mostly ASCII text:\n", len);
+
+    /* one character at a time the chapter 6 way */
+    start = bench_now();
+    mbstate_t state = { 0 };
+    size_t mbrlen_count = 0;
+    for(size_t i = 0; i < len; )
+    {
+        size_t n = mbrlen(text + i, len - i, &state);
+        if(n == (size_t)-1 || n == (size_t)-2)
+            break;
+        i += n;
+        mbrlen_count++;
+    }
+    bench_print_throughput("mbrlen loop", len,
+            bench_elapsed(start, bench_now()));
+
+    /* a NULL destination makes mbstowcs just count, it also validates */
+    start = bench_now();
+    size_t mbstowcs_count = mbstowcs(NULL, text, 0);
+    bench_print_throughput("mbstowcs(NULL, ...)", len,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    size_t valid = utf8_validate(text, len);
+    bench_print_throughput("utf8_validate", len,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    size_t count = utf8_count(text, len);
+    bench_print_throughput("utf8_count", len,
+            bench_elapsed(start, bench_now()));
+
+    printf( "\tcode points: mbrlen %zu, mbstowcs %zu, utf8_count %zu\n"
+            "\tutf8_validate: %s\n",
+            mbrlen_count, mbstowcs_count, count,
+            valid == len ? "valid" : "INVALID");
+
+    free(text);
+    setlocale(LC_CTYPE, saved);
+    free(saved);
+}
@@ -0,0 +1,27 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h> /* size_t */
+
+/* length of the longest valid UTF-8 prefix of s, so the input is valid when
+ * this returns len and otherwise it is the offset of the first bad byte.
+ * Overlong forms, surrogates and anything past U+10FFFF are rejected */
+size_t utf8_validate(const char * s, size_t len);
+
+/* number of code points, assuming s is valid */
+size_t utf8_count(const char * s, size_t len);
+
+/* byte length of the longest prefix of s that is at most max_bytes long (or
+ * at most max_chars code points long) and doesn't end partway through a
+ * multibyte sequence. Cut there and the result is still valid UTF-8 */
+size_t utf8_truncate_bytes(const char * s, size_t len, size_t max_bytes);
+size_t utf8_truncate_chars(const char * s, size_t len, size_t max_chars);
+
+/* len bytes (plus a terminator) of mostly ASCII text with a sprinkling of
+ * 2, 3 and 4 byte characters, for benchmarks. free() it when done */
+char * utf8_bench_text(size_t len);
+
+/* compares the above against mbrlen/mbstowcs on generated text */
+void utf8_benchmark(void);
+
+#endif /* UTF8_H */
@@ -0,0 +1,56 @@
+/* Chapter 6 -- Character Set Handling
+ *
+ * 6.1 - Introduction to Extended Characters
+ *
+ * There are two ways to hold text that doesn't fit in ASCII: wide characters,
+ * where every character is one fixed size wchar_t, and multibyte characters,
+ * where one character is a variable number of chars. On glibc wchar_t is 32
+ * bits and holds a UCS-4/UTF-32 code point (__STDC_ISO_10646__ is defined to
+ * say so), and the multibyte encoding is whatever the locale's LC_CTYPE says,
+ * which these days is nearly always UTF-8.
+ *
+ * 6.2 - Overview about Character Handling Functions
+ *
+ * The conversion functions are all affected by LC_CTYPE, so the same bytes
+ * can convert differently depending on setlocale. MB_CUR_MAX is the longest
+ * multibyte character in the current locale (6 for glibc's UTF-8, for
+ * historical reasons, even though valid UTF-8 stops at 4).
+ *
+ * 6.3 - Restartable Multibyte Conversion Functions
+ *
+ * The r in mbrtowc, mbsrtowcs, wcsrtombs etc. is for restartable: the shift
+ * state lives in an mbstate_t the caller passes in instead of a hidden static,
+ * so they're thread safe and a conversion can stop partway and carry on later
+ *      size_t mbrtowc(wchar_t *PWC, const char *S, size_t N, mbstate_t *PS)
+ *      size_t mbsrtowcs(wchar_t *DST, const char **SRC, size_t LEN,
+ *                          mbstate_t *PS)
+ *      size_t wcsrtombs(char *DST, const wchar_t **SRC, size_t LEN,
+ *                          mbstate_t *PS)
+ * (size_t)-2 from mbrtowc means the character is incomplete and more input is
+ * needed, (size_t)-1 means the input is invalid and errno is EILSEQ.
+ *
+ *      wint_t btowc(int C)
+ * converts a single byte, and returns WEOF if that byte isn't a complete
+ * character on its own, which in UTF-8 is everything past ASCII.
+ *
+ * 6.4 & 6.5 are the non-restartable versions (mbtowc, mbstowcs ...), which
+ * keep their state in a static and should be avoided.
+ *
+ * 6.6 - Generic Charset Conversion
+ *
+ * iconv converts between any two named encodings, independent of the locale.
+ * */
+
+#include "06_character_set_handling.h"
+#include "06_utf_transcode.h"
+
+#include <stdio.h>  /* printf */
+
+/* runnable for main */
+void charset_run_demos(void)
+{
+    printf("\t======================\n");
+    printf("\t===== CHAPTER 6 ======\n");
+    printf("\t======================\n");
+    utf_transcode_demo();
+}
@@ -0,0 +1,6 @@
+#ifndef CHARACTER_SET_HANDLING_H
+#define CHARACTER_SET_HANDLING_H
+
+void charset_run_demos(void);
+
+#endif /* CHARACTER_SET_HANDLING_H */
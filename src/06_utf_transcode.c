@@ -0,0 +1,442 @@
+/* Section 6.3 continued -- converting whole buffers between UTF-8 and UTF-32
+ *
+ * The restartable functions (mbrtowc, mbsrtowcs, wcsrtombs) convert between
+ * the locale's multibyte encoding and wchar_t, and they go through the
+ * locale's gconv machinery for every character. wchar_usage_demo uses btowc,
+ * which is worse still for UTF-8: it only handles single bytes, so anything
+ * past ASCII comes back as WEOF.
+ *
+ * When the encoding is known to be UTF-8 (and on glibc wchar_t is UTF-32) the
+ * conversion is simple bit shuffling:
+ *
+ *      U+0000   - U+007F    0xxxxxxx
+ *      U+0080   - U+07FF    110xxxxx 10xxxxxx
+ *      U+0800   - U+FFFF    1110xxxx 10xxxxxx 10xxxxxx
+ *      U+10000  - U+10FFFF  11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
+ *
+ * and the common case needs no shuffling at all. Both directions check 16
+ * bytes (or 8 code points) at a time with SSE2, and when they are all ASCII
+ * they are widened (or narrowed) with unpack/pack instructions in one go.
+ * Anything else goes through a strict one-sequence-at-a-time decoder that
+ * rejects overlong forms, surrogates, and values past U+10FFFF, and reports
+ * where the bad input is instead of just failing.
+ *
+ * For input that arrives in pieces (read(2) blocks, network packets) the
+ * stream version carries a sequence cut off at the end of one chunk over to
+ * the next.
+ * */
+
+#include "06_utf_transcode.h"
+#include "05_utf8.h"    /* utf8_bench_text */
+#include "bench.h"
+
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* malloc, free */
+#include <string.h>     /* memcpy, memcmp, memset, strlen */
+#include <locale.h>     /* setlocale */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+#ifdef __SSE2__
+#include <emmintrin.h>  /* SSE2 intrinsics */
+#endif
+
+/* size of the benchmark text, and of the chunks fed to the stream decoder */
+#ifndef TRANSCODE_BENCH_BYTES
+#define TRANSCODE_BENCH_BYTES (32UL << 20)
+#endif
+#ifndef TRANSCODE_CHUNK_LEN
+#define TRANSCODE_CHUNK_LEN (64UL << 10)
+#endif
+
+/* decode the sequence at s. Returns its length and sets *cp, 0 if it is
+ * invalid, or -1 if it is fine so far but runs past avail */
+static int decode_one(const unsigned char * s, size_t avail, char32_t * cp)
+{
+    unsigned char c = s[0];
+    unsigned char lo = 0x80;
+    unsigned char hi = 0xbf;
+    char32_t value;
+    size_t need;
+
+    if(c < 0x80)
+    {
+        *cp = c;
+        return 1;
+    }
+    else if(c >= 0xc2 && c <= 0xdf)
+    {
+        need = 1;
+        value = c & 0x1f;
+    }
+    else if(c >= 0xe0 && c <= 0xef)
+    {
+        need = 2;
+        value = c & 0x0f;
+        if(c == 0xe0)
+            lo = 0xa0;  /* overlong */
+        else if(c == 0xed)
+            hi = 0x9f;  /* surrogates */
+    }
+    else if(c >= 0xf0 && c <= 0xf4)
+    {
+        need = 3;
+        value = c & 0x07;
+        if(c == 0xf0)
+            lo = 0x90;  /* overlong */
+        else if(c == 0xf4)
+            hi = 0x8f;  /* past U+10FFFF */
+    }
+    else
+        return 0;
+
+    for(size_t k = 1; k <= need; k++)
+    {
+        if(k >= avail)
+            return -1;
+        unsigned char b = s[k];
+        if(k == 1 ? (b < lo || b > hi) : (b & 0xc0) != 0x80)
+            return 0;
+        value = (value << 6) | (b & 0x3f);
+    }
+    *cp = value;
+    return need + 1;
+}
+
+/* decode as much of [s, s + len) as possible. Stops at the end, at an invalid
+ * sequence, or at a sequence cut off by the end of the input; *status is 1,
+ * 0, or -1 for those. *used is how many bytes were consumed */
+static size_t decode_run(const unsigned char * s, size_t len, char32_t * dst,
+        size_t * used, int * status)
+{
+    size_t i = 0;
+    size_t o = 0;
+    *status = 1;
+
+    while(i < len)
+    {
+#ifdef __SSE2__
+        /* 16 ASCII bytes -> 16 code points, zero extended twice */
+        __m128i zero = _mm_setzero_si128();
+        while(i + 16 <= len)
+        {
+            __m128i c = _mm_loadu_si128((const __m128i *)(s + i));
+            if(_mm_movemask_epi8(c) != 0)
+                break;
+            __m128i lo16 = _mm_unpacklo_epi8(c, zero);
+            __m128i hi16 = _mm_unpackhi_epi8(c, zero);
+            __m128i * out = (__m128i *)(dst + o);
+            _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(lo16, zero));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo16, zero));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi16, zero));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi16, zero));
+            i += 16;
+            o += 16;
+        }
+        if(i >= len)
+            break;
+#endif
+        int n = decode_one(s + i, len - i, dst + o);
+        if(n <= 0)
+        {
+            *status = n;
+            break;
+        }
+        i += n;
+        o++;
+    }
+
+    *used = i;
+    return o;
+}
+
+size_t utf8_to_utf32(const char * src, size_t len, char32_t * dst,
+        size_t * error_pos)
+{
+    size_t used;
+    int status;
+    size_t written = decode_run((const unsigned char *)src, len, dst, &used,
+                                &status);
+    if(status != 1)
+    {
+        if(error_pos != NULL)
+            *error_pos = used;
+        return UTF_ERROR;
+    }
+    return written;
+}
+
+static size_t encode_one(char32_t cp, char * dst)
+{
+    unsigned char * d = (unsigned char *)dst;
+    if(cp < 0x80)
+    {
+        d[0] = cp;
+        return 1;
+    }
+    if(cp < 0x800)
+    {
+        d[0] = 0xc0 | (cp >> 6);
+        d[1] = 0x80 | (cp & 0x3f);
+        return 2;
+    }
+    if(cp < 0x10000)
+    {
+        if(cp >= 0xd800 && cp <= 0xdfff)
+            return 0;
+        d[0] = 0xe0 | (cp >> 12);
+        d[1] = 0x80 | ((cp >> 6) & 0x3f);
+        d[2] = 0x80 | (cp & 0x3f);
+        return 3;
+    }
+    if(cp <= 0x10ffff)
+    {
+        d[0] = 0xf0 | (cp >> 18);
+        d[1] = 0x80 | ((cp >> 12) & 0x3f);
+        d[2] = 0x80 | ((cp >> 6) & 0x3f);
+        d[3] = 0x80 | (cp & 0x3f);
+        return 4;
+    }
+    return 0;
+}
+
+size_t utf32_to_utf8(const char32_t * src, size_t len, char * dst,
+        size_t * error_pos)
+{
+    size_t i = 0;
+    size_t o = 0;
+
+    while(i < len)
+    {
+#ifdef __SSE2__
+        /* 8 code points that all fit in 7 bits -> 8 bytes */
+        __m128i not_ascii = _mm_set1_epi32(~0x7f);
+        __m128i zero = _mm_setzero_si128();
+        while(i + 8 <= len)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 4));
+            __m128i high = _mm_and_si128(_mm_or_si128(a, b), not_ascii);
+            if(_mm_movemask_epi8(_mm_cmpeq_epi32(high, zero)) != 0xffff)
+                break;
+            __m128i packed = _mm_packus_epi16(_mm_packs_epi32(a, b), zero);
+            _mm_storel_epi64((__m128i *)(dst + o), packed);
+            i += 8;
+            o += 8;
+        }
+        if(i >= len)
+            break;
+#endif
+        size_t n = encode_one(src[i], dst + o);
+        if(n == 0)
+        {
+            if(error_pos != NULL)
+                *error_pos = i;
+            return UTF_ERROR;
+        }
+        o += n;
+        i++;
+    }
+    return o;
+}
+
+void utf8_stream_init(utf8_stream * stream)
+{
+    stream->carry_len = 0;
+    stream->offset = 0;
+}
+
+size_t utf8_stream_decode(utf8_stream * stream, const char * chunk,
+        size_t len, int at_end, char32_t * dst, size_t * error_pos)
+{
+    const unsigned char * s = (const unsigned char *)chunk;
+    size_t i = 0;
+    size_t o = 0;
+
+    /* finish the sequence the last chunk ended in the middle of */
+    if(stream->carry_len > 0)
+    {
+        int n = -1;
+        while(n == -1 && i < len)
+        {
+            stream->carry[stream->carry_len++] = s[i++];
+            n = decode_one(stream->carry, stream->carry_len, dst);
+        }
+        if(n == 0 || (n == -1 && at_end))
+        {
+            if(error_pos != NULL)
+                *error_pos = stream->offset - (stream->carry_len - i);
+            return UTF_ERROR;
+        }
+        if(n == -1)
+        {
+            /* the whole chunk went into the carry and it's still short */
+            stream->offset += len;
+            return 0;
+        }
+        stream->carry_len = 0;
+        o = 1;
+    }
+
+    size_t used;
+    int status;
+    o += decode_run(s + i, len - i, dst + o, &used, &status);
+    i += used;
+
+    if(status == 0 || (status == -1 && at_end))
+    {
+        if(error_pos != NULL)
+            *error_pos = stream->offset + i;
+        return UTF_ERROR;
+    }
+    if(status == -1)
+    {
+        /* at most 3 bytes or decode_one would have said 0 */
+        stream->carry_len = len - i;
+        memcpy(stream->carry, s + i, stream->carry_len);
+    }
+
+    stream->offset += len;
+    return o;
+}
+
+static void transcode_benchmark(void)
+{
+    size_t len = TRANSCODE_BENCH_BYTES;
+    char * text = utf8_bench_text(len);
+    char32_t * wide = malloc(len * sizeof(char32_t));
+    wchar_t * wcs = malloc((len + 1) * sizeof(wchar_t));
+    char * narrow = malloc(4 * len + 1);
+    if(wide == NULL || wcs == NULL || narrow == NULL)
+        error(EXIT_FAILURE, errno, "benchmark buffer allocation failed");
+    /* fault the pages in now so the first one timed doesn't pay for them */
+    memset(wide, 0, len * sizeof(char32_t));
+    memset(wcs, 0, (len + 1) * sizeof(wchar_t));
+    memset(narrow, 0, 4 * len + 1);
+    printf("%zu bytes of mostly ASCII UTF-8, LC_CTYPE=%s:\n", len,
+            setlocale(LC_CTYPE, NULL));
+
+    /* the locale's way, which validates too */
+    const char * src = text;
+    mbstate_t state = { 0 };
+    struct timespec start = bench_now();
+    size_t wcs_len = mbsrtowcs(wcs, &src, len + 1, &state);
+    bench_print_throughput("mbsrtowcs", len,
+            bench_elapsed(start, bench_now()));
+
+    /* what wchar_usage_demo does, which is only right for ASCII */
+    start = bench_now();
+    for(size_t i = 0; i < len; i++)
+        wcs[i] = btowc((unsigned char)text[i]);
+    bench_print_throughput("btowc per byte (ASCII only!)", len,
+            bench_elapsed(start, bench_now()));
+
+    size_t error_pos = 0;
+    start = bench_now();
+    size_t wide_len = utf8_to_utf32(text, len, wide, &error_pos);
+    bench_print_throughput("utf8_to_utf32", len,
+            bench_elapsed(start, bench_now()));
+
+    /* same thing in chunks, deliberately cutting sequences in half */
+    utf8_stream stream;
+    utf8_stream_init(&stream);
+    size_t stream_len = 0;
+    start = bench_now();
+    for(size_t off = 0; off < len; off += TRANSCODE_CHUNK_LEN - 1)
+    {
+        size_t n = len - off < TRANSCODE_CHUNK_LEN - 1 ?
+                    len - off : TRANSCODE_CHUNK_LEN - 1;
+        size_t got = utf8_stream_decode(&stream, text + off, n,
+                                        off + n == len, wide + stream_len,
+                                        &error_pos);
+        if(got == UTF_ERROR)
+            break;
+        stream_len += got;
+    }
+    bench_print_throughput("utf8_stream_decode", len,
+            bench_elapsed(start, bench_now()));
+
+    /* and back again */
+    mbsrtowcs(wcs, &(const char *){ text }, len + 1, &state);
+    const wchar_t * wsrc = wcs;
+    start = bench_now();
+    size_t narrow_len = wcsrtombs(narrow, &wsrc, 4 * len + 1, &state);
+    bench_print_throughput("wcsrtombs", len,
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    size_t utf8_len = utf32_to_utf8(wide, wide_len, narrow, &error_pos);
+    bench_print_throughput("utf32_to_utf8", len,
+            bench_elapsed(start, bench_now()));
+
+    printf( "\tcode points: mbsrtowcs %zu, utf8_to_utf32 %zu, stream %zu\n"
+            "\twide strings %s, bytes: wcsrtombs %zu, utf32_to_utf8 %zu, "
+            "round trip %s\n",
+            wcs_len, wide_len, stream_len,
+            memcmp(wcs, wide, wide_len * sizeof(char32_t)) == 0 ?
+                "match" : "DIFFER",
+            narrow_len, utf8_len,
+            utf8_len == len && memcmp(narrow, text, len) == 0 ?
+                "matches" : "DIFFERS");
+
+    free(narrow);
+    free(wcs);
+    free(wide);
+    free(text);
+}
+
+void utf_transcode_demo(void)
+{
+    printf( "\t=================================\n"
+            "\t=== Section 6.3 UTF transcode ===\n"
+            "\t=================================\n\n");
+
+    char * saved = strdup(setlocale(LC_CTYPE, NULL));
+    if(saved == NULL)
+        error(EXIT_FAILURE, errno, "locale name allocation failed");
+    /* %ls and the mbstowcs comparison need a UTF-8 locale */
+    if(setlocale(LC_CTYPE, "C.UTF-8") == NULL)
+    {
+        printf("\tC.UTF-8 is not installed, skipping\n\n");
+        free(saved);
+        return;
+    }
+
+    /* "Here ÃrE sõmé chAracters ⇒ 🐸" */
+    char * text = "Here \xc3\x83rE s\xc3\xb5m\xc3\xa9 chAracters "
+                    "\xe2\x87\x92 \xf0\x9f\x90\xb8";
+    size_t len = strlen(text);
+    wchar_t wide[64];
+    size_t error_pos;
+    size_t n = utf8_to_wcs(text, len, wide, &error_pos);
+    wide[n] = L'\0';
+    printf("%zu bytes -> %zu wide characters: %ls\n", len, n, wide);
+
+    char back[64 * 4];
+    size_t back_len = wcs_to_utf8(wide, n, back, &error_pos);
+    printf("and back to %zu bytes: %.*s\n", back_len, (int)back_len, back);
+
+    /* broken input reports where it broke */
+    char * broken = "caf\xc3\xa9 \xed\xa0\x80 surrogate";
+    if(utf8_to_utf32(broken, strlen(broken), (char32_t *)wide, &error_pos)
+            == UTF_ERROR)
+        printf("encoded surrogate rejected at byte %zu\n", error_pos);
+
+    /* one character fed to the stream a byte at a time */
+    utf8_stream stream;
+    utf8_stream_init(&stream);
+    char * frog = "\xf0\x9f\x90\xb8";
+    printf("feeding U+1F438 one byte at a time:");
+    for(int i = 0; i < 4; i++)
+    {
+        size_t got = utf8_stream_decode(&stream, frog + i, 1, i == 3,
+                                        (char32_t *)wide, &error_pos);
+        printf(" %zu", got);
+    }
+    printf(" -> U+%04X\n", (unsigned)wide[0]);
+
+    transcode_benchmark();
+
+    setlocale(LC_CTYPE, saved);
+    free(saved);
+    printf("\n");
+}
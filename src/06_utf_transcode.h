@@ -0,0 +1,57 @@
+#ifndef UTF_TRANSCODE_H
+#define UTF_TRANSCODE_H
+
+#include <stddef.h> /* size_t */
+#include <uchar.h>  /* char32_t */
+#include <wchar.h>  /* wchar_t */
+
+/* returned instead of a count when the input is invalid */
+#define UTF_ERROR ((size_t)-1)
+
+/* UTF-8 -> UTF-32. dst needs room for len code points. Returns how many were
+ * written, or UTF_ERROR with *error_pos set to the byte offset of the first
+ * bad (or truncated) sequence */
+size_t utf8_to_utf32(const char * src, size_t len, char32_t * dst,
+        size_t * error_pos);
+
+/* UTF-32 -> UTF-8. dst needs room for 4 * len bytes. Returns the number of
+ * bytes written, or UTF_ERROR with *error_pos set to the index of the first
+ * surrogate or out of range code point */
+size_t utf32_to_utf8(const char32_t * src, size_t len, char * dst,
+        size_t * error_pos);
+
+/* streaming decode, for input that arrives in chunks. A sequence split
+ * across two chunks is held in the stream until the next call completes it */
+typedef struct _utf8_stream {
+    unsigned char carry[4];
+    size_t carry_len;
+    size_t offset;      /* bytes of input seen before this chunk */
+} utf8_stream;
+
+void utf8_stream_init(utf8_stream * stream);
+
+/* dst needs room for len + 1 code points. at_end says this is the last chunk,
+ * so a sequence still open at the end of it is an error. error_pos is an
+ * offset from the start of the stream */
+size_t utf8_stream_decode(utf8_stream * stream, const char * chunk,
+        size_t len, int at_end, char32_t * dst, size_t * error_pos);
+
+/* glibc's wchar_t is UTF-32 (that's what __STDC_ISO_10646__ promises), so
+ * the same code covers wchar_t strings */
+#if defined(__STDC_ISO_10646__) && __WCHAR_MAX__ >= 0x10ffff
+static inline size_t utf8_to_wcs(const char * src, size_t len, wchar_t * dst,
+        size_t * error_pos)
+{
+    return utf8_to_utf32(src, len, (char32_t *)dst, error_pos);
+}
+
+static inline size_t wcs_to_utf8(const wchar_t * src, size_t len, char * dst,
+        size_t * error_pos)
+{
+    return utf32_to_utf8((const char32_t *)src, len, dst, error_pos);
+}
+#endif
+
+void utf_transcode_demo(void);
+
+#endif /* UTF_TRANSCODE_H */
@@ -0,0 +1,317 @@
+/* Section 7.3 & 7.4 continued -- locales per thread
+ *
+ * setlocale changes the locale of the whole process. The manual marks it
+ * MT-Unsafe, and with reason: every other thread's isalpha, strcoll, printf
+ * %ls and mbstowcs switch along with it, partway through whatever they were
+ * doing. The demos in sections 4 and 5 each used to set LC_ALL for their own
+ * purposes and leave it that way for whoever ran next. With threads, the only
+ * correct way to use it is to hold one lock around setting the locale and
+ * everything that depends on it, which runs the threads one at a time.
+ *
+ * POSIX 2008 fixed this with locale objects:
+ *      locale_t newlocale(int CATEGORY_MASK, const char *LOCALE, locale_t BASE)
+ *      locale_t duplocale(locale_t LOCOBJ)
+ *      void freelocale(locale_t LOCOBJ)
+ *      locale_t uselocale(locale_t NEWLOC)
+ * plus an _l version of the functions that take one explicitly (isalpha_l,
+ * iswalpha_l, strcoll_l, strxfrm_l, toupper_l ...). uselocale only changes
+ * the calling thread, and anything without an _l version (mbstowcs, printf)
+ * follows the thread's locale. uselocale((locale_t)0) asks without changing
+ * anything, and LC_GLOBAL_LOCALE goes back to following setlocale.
+ *
+ * newlocale has to find and load the locale files, so it's worth doing once
+ * per name rather than per use. The manager below keeps one object per name
+ * behind a mutex, and locale_push/locale_pop are the thread-local
+ * replacement for the set-it-and-forget-it setlocale calls.
+ * */
+
+#include "07_locale_manager.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* malloc, free, mbstowcs */
+#include <string.h>     /* strcmp, strcoll, strcoll_l, strdup, strlen */
+#include <wctype.h>     /* iswalpha, iswalpha_l */
+#include <pthread.h>    /* pthread_create, pthread_join, mutexes */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+
+/* how many distinct locale names the manager will hold */
+#ifndef LOCALE_CACHE_LEN
+#define LOCALE_CACHE_LEN 16
+#endif
+
+/* benchmark size, thread count, and strings handled per setlocale */
+#ifndef LOCALE_BENCH_STRINGS
+#define LOCALE_BENCH_STRINGS 200000
+#endif
+#ifndef LOCALE_BENCH_THREADS
+#define LOCALE_BENCH_THREADS 4
+#endif
+#ifndef LOCALE_BENCH_BATCH
+#define LOCALE_BENCH_BATCH 64
+#endif
+
+static struct {
+    pthread_mutex_t lock;
+    size_t len;
+    char * names[LOCALE_CACHE_LEN];
+    locale_t locales[LOCALE_CACHE_LEN];
+} cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+locale_t locale_get(const char * name)
+{
+    locale_t loc = (locale_t)0;
+
+    pthread_mutex_lock(&cache.lock);
+    for(size_t i = 0; i < cache.len; i++)
+    {
+        if(strcmp(cache.names[i], name) == 0)
+        {
+            loc = cache.locales[i];
+            break;
+        }
+    }
+
+    if(loc == (locale_t)0)
+    {
+        if(cache.len == LOCALE_CACHE_LEN)
+            errno = ENOMEM;
+        else if((loc = newlocale(LC_ALL_MASK, name, (locale_t)0))
+                != (locale_t)0)
+        {
+            cache.names[cache.len] = strdup(name);
+            if(cache.names[cache.len] == NULL)
+                error(EXIT_FAILURE, errno, "locale name allocation failed");
+            cache.locales[cache.len++] = loc;
+        }
+    }
+    pthread_mutex_unlock(&cache.lock);
+
+    return loc;
+}
+
+void locale_manager_release(void)
+{
+    pthread_mutex_lock(&cache.lock);
+    for(size_t i = 0; i < cache.len; i++)
+    {
+        freelocale(cache.locales[i]);
+        free(cache.names[i]);
+    }
+    cache.len = 0;
+    pthread_mutex_unlock(&cache.lock);
+}
+
+locale_t locale_push(const char * name)
+{
+    locale_t loc = locale_get(name);
+    if(loc == (locale_t)0)
+        return (locale_t)0;
+    return uselocale(loc);
+}
+
+void locale_pop(locale_t previous)
+{
+    /* uselocale((locale_t)0) only queries, so a failed push pops cleanly */
+    uselocale(previous);
+}
+
+/* the same work either way: widen each string, count its letters, and
+ * compare it with the one before in the locale's collation order */
+typedef struct _locale_worker {
+    pthread_t thread;
+    const char * name;
+    int use_setlocale;
+    char * const * strs;
+    size_t begin;
+    size_t end;
+    unsigned long alpha;
+    long order;
+} locale_worker;
+
+static pthread_mutex_t setlocale_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void worker_string(locale_worker * w, size_t i, locale_t loc)
+{
+    wchar_t wide[128];
+    size_t n = mbstowcs(wide, w->strs[i], 128);
+    if(n == (size_t)-1)
+        return;
+    for(size_t k = 0; k < n; k++)
+        w->alpha += loc ? iswalpha_l(wide[k], loc) != 0
+                        : iswalpha(wide[k]) != 0;
+    if(i > w->begin)
+    {
+        int cmp = loc ? strcoll_l(w->strs[i - 1], w->strs[i], loc)
+                        : strcoll(w->strs[i - 1], w->strs[i]);
+        w->order += (cmp > 0) - (cmp < 0);
+    }
+}
+
+static void * locale_worker_run(void * arg)
+{
+    locale_worker * w = arg;
+
+    if(w->use_setlocale)
+    {
+        /* the whole batch has to happen under the lock, or another thread's
+         * setlocale could land in the middle of it */
+        for(size_t i = w->begin; i < w->end; i += LOCALE_BENCH_BATCH)
+        {
+            size_t end = i + LOCALE_BENCH_BATCH < w->end ?
+                            i + LOCALE_BENCH_BATCH : w->end;
+            pthread_mutex_lock(&setlocale_lock);
+            setlocale(LC_ALL, w->name);
+            for(size_t k = i; k < end; k++)
+                worker_string(w, k, (locale_t)0);
+            pthread_mutex_unlock(&setlocale_lock);
+        }
+    }
+    else
+    {
+        locale_t previous = locale_push(w->name);
+        locale_t loc = uselocale((locale_t)0);
+        for(size_t i = w->begin; i < w->end; i++)
+            worker_string(w, i, loc);
+        locale_pop(previous);
+    }
+
+    return NULL;
+}
+
+/* splits the strings into LOCALE_BENCH_THREADS jobs, each in its own
+ * locale, and runs them either all at once on their own threads or one after
+ * another on this one. Returns a checksum of what the jobs found so the
+ * different ways can be compared */
+static unsigned long run_workers(const char * label, int use_setlocale,
+        int threaded, const char * const * names, int nnames,
+        char * const * strs, size_t nstrs, size_t bytes)
+{
+    locale_worker workers[LOCALE_BENCH_THREADS];
+    unsigned long checksum = 0;
+
+    struct timespec start = bench_now();
+    for(int t = 0; t < LOCALE_BENCH_THREADS; t++)
+    {
+        locale_worker * w = &workers[t];
+        w->name = names[t % nnames];
+        w->use_setlocale = use_setlocale;
+        w->strs = strs;
+        w->begin = nstrs * t / LOCALE_BENCH_THREADS;
+        w->end = nstrs * (t + 1) / LOCALE_BENCH_THREADS;
+        w->alpha = 0;
+        w->order = 0;
+        if(!threaded)
+            locale_worker_run(w);
+        else if((errno = pthread_create(&w->thread, NULL, locale_worker_run,
+                                        w)) != 0)
+            error(EXIT_FAILURE, errno, "pthread_create failed");
+    }
+    for(int t = 0; t < LOCALE_BENCH_THREADS; t++)
+    {
+        if(threaded)
+            pthread_join(workers[t].thread, NULL);
+        checksum = checksum * 31 + workers[t].alpha
+                    + (unsigned long)workers[t].order;
+    }
+    bench_print_throughput(label, bytes, bench_elapsed(start, bench_now()));
+
+    return checksum;
+}
+
+static void locale_manager_benchmark(void)
+{
+    static const char * const candidates[] = {
+        "C.UTF-8", "en_US.UTF-8", "POSIX"
+    };
+    const char * names[3];
+    int nnames = 0;
+    for(int i = 0; i < 3; i++)
+        if(locale_get(candidates[i]) != (locale_t)0)
+            names[nnames++] = candidates[i];
+
+    static const char * const words[] = {
+        "Here", "\xc3\x83rE", "s\xc3\xb5m\xc3\xa9", "chAracters", "friday",
+        "blurb", "hello", "Hello", "caf\xc3\xa9", "\xce\xb1\xce\xb2\xce\xb3",
+        "\xe6\x97\xa5\xe6\x9c\xac", "42", "na\xc3\xafve", "Zebra"
+    };
+    size_t nwords = sizeof(words) / sizeof(words[0]);
+    size_t nstrs = LOCALE_BENCH_STRINGS;
+    char ** strs = malloc(nstrs * sizeof(char *));
+    if(strs == NULL)
+        error(EXIT_FAILURE, errno, "benchmark string allocation failed");
+    size_t bytes = 0;
+    unsigned long state = 1;
+    for(size_t i = 0; i < nstrs; i++)
+    {
+        char buf[128];
+        int len = 0;
+        for(int w = 0; w < 4; w++)
+        {
+            state = state * 1103515245UL + 12345UL;
+            len += snprintf(buf + len, sizeof(buf) - len, "%s%s",
+                            w ? " " : "", words[(state >> 16) % nwords]);
+        }
+        strs[i] = strdup(buf);
+        if(strs[i] == NULL)
+            error(EXIT_FAILURE, errno, "benchmark string allocation failed");
+        bytes += len;
+    }
+
+    printf("%zu strings in %d jobs, taking turns between", nstrs,
+            LOCALE_BENCH_THREADS);
+    for(int i = 0; i < nnames; i++)
+        printf(" %s", names[i]);
+    printf(":\n");
+
+    char label[64];
+    unsigned long sums[4];
+    sums[0] = run_workers("setlocale + lock, 1 thread", 1, 0, names, nnames,
+                            strs, nstrs, bytes);
+    sums[1] = run_workers("uselocale + _l, 1 thread", 0, 0, names, nnames,
+                            strs, nstrs, bytes);
+    snprintf(label, sizeof(label), "setlocale + lock, %d threads",
+            LOCALE_BENCH_THREADS);
+    sums[2] = run_workers(label, 1, 1, names, nnames, strs, nstrs, bytes);
+    snprintf(label, sizeof(label), "uselocale + _l, %d threads",
+            LOCALE_BENCH_THREADS);
+    sums[3] = run_workers(label, 0, 1, names, nnames, strs, nstrs, bytes);
+    printf("\tresults %s\n",
+            sums[0] == sums[1] && sums[0] == sums[2] && sums[0] == sums[3] ?
+                "match" : "DIFFER");
+
+    for(size_t i = 0; i < nstrs; i++)
+        free(strs[i]);
+    free(strs);
+}
+
+void locale_manager_demo(void)
+{
+    printf( "\t=====================================\n"
+            "\t=== Section 7.3 per-thread locale ===\n"
+            "\t=====================================\n\n");
+
+    char * saved = strdup(setlocale(LC_ALL, NULL));
+    if(saved == NULL)
+        error(EXIT_FAILURE, errno, "locale name allocation failed");
+
+    /* a thread's locale changes, the process's doesn't */
+    locale_t previous = locale_push("C.UTF-8");
+    printf( "after locale_push(\"C.UTF-8\"): setlocale says %s, "
+            "strcoll(\"h\", \"H\") = %d, this thread prints %ls\n",
+            setlocale(LC_ALL, NULL),
+            strcoll("h", "H"),
+            L"s\xf5m\xe9");
+    locale_pop(previous);
+
+    if(locale_push("xx_XX.UTF-8") == (locale_t)0)
+        printf("locale_push of a missing locale leaves things alone: %s\n",
+                setlocale(LC_ALL, NULL));
+
+    locale_manager_benchmark();
+
+    setlocale(LC_ALL, saved);
+    free(saved);
+    printf("\n");
+}
@@ -0,0 +1,24 @@
+#ifndef LOCALE_MANAGER_H
+#define LOCALE_MANAGER_H
+
+#include <locale.h> /* locale_t */
+
+/* a locale object for name covering every category, made with newlocale the
+ * first time it's asked for and shared after that. Safe to call from any
+ * thread. Returns (locale_t)0 with errno set if the locale isn't installed.
+ * The objects live until locale_manager_release */
+locale_t locale_get(const char * name);
+
+/* frees every cached locale. No thread may still be using one */
+void locale_manager_release(void);
+
+/* switch only the calling thread to name, returning what it was using so
+ * locale_pop can put it back. If name isn't available nothing changes, and
+ * popping the (locale_t)0 that comes back is harmless */
+locale_t locale_push(const char * name);
+void locale_pop(locale_t previous);
+
+/* per-thread locales against setlocale under several threads */
+void locale_manager_demo(void);
+
+#endif /* LOCALE_MANAGER_H */
@@ -0,0 +1,49 @@
+/* Chapter 7 -- Locales and Internationalization
+ *
+ * 7.1 - What Effects a Locale Has
+ *
+ * The locale decides which multibyte characters are valid and how they
+ * classify and convert (chapters 4 and 6), how strings collate (strcoll and
+ * strxfrm in chapter 5), and how numbers, money, times and dates print.
+ *
+ * 7.3 - Locale Categories
+ *
+ * Each of those is its own category, and they can be set independently:
+ *      LC_COLLATE, LC_CTYPE, LC_MONETARY, LC_NUMERIC, LC_TIME, LC_MESSAGES
+ * LC_ALL sets all of them at once.
+ *
+ * 7.4 - How Programs Set the Locale
+ *
+ *      char * setlocale(int CATEGORY, const char *LOCALE)
+ * Every program starts in the "C" locale whatever the environment says, and
+ * setlocale(LC_ALL, "") switches to what LANG/LC_* ask for. Passing NULL
+ * returns the current name without changing it, but the string it hands back
+ * can be overwritten by the next call, so strdup it if you want to restore it
+ * later. A locale that isn't installed gets you NULL and no change.
+ *
+ * 7.5 - Standard Locales
+ *
+ * "C" and "POSIX" are the same thing and always exist. glibc also always has
+ * "C.UTF-8" (since 2.35), which is C with UTF-8 as the character set.
+ *
+ * 7.6 - Locale Information
+ *
+ *      struct lconv * localeconv(void)
+ *      char * nl_langinfo(nl_item ITEM)
+ * localeconv gives the LC_NUMERIC and LC_MONETARY formatting details,
+ * nl_langinfo can look up nearly any single item by name.
+ * */
+
+#include "07_locales.h"
+#include "07_locale_manager.h"
+
+#include <stdio.h>  /* printf */
+
+/* runnable for main */
+void locales_run_demos(void)
+{
+    printf("\t======================\n");
+    printf("\t===== CHAPTER 7 ======\n");
+    printf("\t======================\n");
+    locale_manager_demo();
+}
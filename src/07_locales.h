@@ -0,0 +1,6 @@
+#ifndef LOCALES_H
+#define LOCALES_H
+
+void locales_run_demos(void);
+
+#endif /* LOCALES_H */
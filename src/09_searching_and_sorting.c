@@ -15,16 +15,36 @@ static void hash_search_function(void);
 static void tree_search_function(void);
 int compare_doubles(const void *, const void *);
 
-/* runnable for main */
-void search_sort_run_demos(void)
+/* the section's setup in the registry, search_demos are the rest */
+void search_sort_banner(void)
 {
     printf("\t======================\n");
     printf("\t===== CHAPTER 9 ======\n");
     printf("\t======================\n");
+}
+
+void search_compare_demo(void)
+{
     comparison_functions(compare_doubles);
+}
+
+void search_array_demo(void)
+{
     array_search_function(compare_doubles);
+}
+
+void search_sort_demo(void)
+{
     array_sort_function(compare_doubles);
+}
+
+void search_hash_demo(void)
+{
     hash_search_function();
+}
+
+void search_tree_demo(void)
+{
     tree_search_function();
 }
 
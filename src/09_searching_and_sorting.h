@@ -1,6 +1,12 @@
 #ifndef SEARCHING_AND_SORTING_H
 #define SEARCHING_AND_SORTING_H
 
-void search_sort_run_demos(void);
+/* one subsection each, section_registry.c runs them in order */
+void search_sort_banner(void);
+void search_compare_demo(void);
+void search_array_demo(void);
+void search_sort_demo(void);
+void search_hash_demo(void);
+void search_tree_demo(void);
 
 #endif /* SEARCHING_AND_SORTING_H */
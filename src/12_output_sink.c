@@ -0,0 +1,339 @@
+/* Section 12 -- Input/Output on Streams, and where the output goes
+ *
+ * stdio buffers for you, but how much depends on where stdout points. To a
+ * terminal it's line buffered (a write(2) per line), to a file or a pipe
+ * it's a buffer of st_blksize bytes, 4096 for a pipe. The demos print a lot
+ * of short lines, so a full run into a pipe is thousands of write calls,
+ * and in a benchmark every one of them is time spent on output nobody reads.
+ *
+ * The sink here is a 1MB buffer (OUT_BUFFER_LEN) that only goes to the
+ * file descriptor when it's full or flushed. Anything at least half the
+ * buffer's size isn't copied at all: it goes out with what's buffered in a
+ * single gather write,
+ *      ssize_t writev(int FD, const struct iovec *VECTOR, int COUNT)
+ * In OUT_QUIET mode nothing is written, only counted.
+ *
+ * All the demos already call printf, so instead of changing them the sink is
+ * put underneath it. 12.21 of the manual covers custom streams:
+ *      FILE * fopencookie(void *COOKIE, const char *OPENTYPE,
+ *                         cookie_io_functions_t IO_FUNCTIONS)
+ * makes a FILE that calls our functions to do the actual reading and
+ * writing, and 12.2 says that in glibc stdin, stdout and stderr are plain
+ * variables that can be assigned. So out_install points stdout at a cookie
+ * stream over the sink and everything printed goes through it.
+ *
+ * The stream gets a stdio buffer the size of the sink's (setvbuf), so printf
+ * stays on stdio's fast path of copying into a buffer, and cookie_write
+ * only sees whole buffers, or whatever is there at a fflush. Those go
+ * straight out with anything written to the sink directly, uncopied.
+ *
+ * error() and exit() fflush(stdout) first, so their messages still come
+ * after what was printed before them. perror and fprintf(stderr, ...) don't,
+ * so into a file or a pipe their messages can land ahead of earlier output,
+ * the same as with stdio's own full buffering. A terminal is different: a
+ * person is reading as it goes, and expects each line as it's printed and
+ * errors where they happened. So when stdout is a terminal, the buffered
+ * mode leaves it as stdio's line buffered stream.
+ * */
+
+#include "12_output_sink.h"
+#include "04_character_classification.h"
+#include "09_searching_and_sorting.h"
+#include "bench.h"
+
+#include <stdio.h>      /* fopencookie, printf */
+#include <stdlib.h>     /* malloc, free */
+#include <string.h>     /* memcpy, strncmp */
+#include <unistd.h>     /* pipe, fork, read, close, dup, isatty */
+#include <sys/uio.h>    /* writev */
+#include <sys/wait.h>   /* waitpid */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+
+/* times the workload runs in the demo */
+#ifndef OUT_BENCH_REPS
+#define OUT_BENCH_REPS 200
+#endif
+
+/* write all of iov, picking up after partial writes */
+static int writev_all(out_sink * sink, struct iovec * iov, int count)
+{
+    while(count > 0)
+    {
+        ssize_t n = writev(sink->fd, iov, count);
+        sink->stats.syscalls++;
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            sink->failed = errno;
+            return -1;
+        }
+        while(count > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if(count > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+void out_sink_init(out_sink * sink, int fd, out_mode mode, size_t cap)
+{
+    sink->fd = fd;
+    sink->mode = mode;
+    sink->len = 0;
+    sink->cap = cap;
+    sink->failed = 0;
+    sink->stream_buf = NULL;
+    sink->stats = (out_stats){ 0, 0, 0 };
+    /* on the first out_sink_write, stdout's sink only needs stream_buf */
+    sink->buf = NULL;
+}
+
+void out_sink_destroy(out_sink * sink)
+{
+    out_sink_flush(sink);
+    free(sink->buf);
+    free(sink->stream_buf);
+    sink->buf = NULL;
+    sink->stream_buf = NULL;
+}
+
+/* whatever is buffered and then data, in one writev */
+static int write_through(out_sink * sink, const void * data, size_t len)
+{
+    if(sink->mode != OUT_QUIET && !sink->failed)
+    {
+        struct iovec iov[2] = {
+            { sink->buf, sink->len },
+            { (void *)data, len },
+        };
+        writev_all(sink, sink->len ? iov : iov + 1, sink->len ? 2 : 1);
+    }
+    sink->len = 0;
+    return sink->failed ? -1 : 0;
+}
+
+void out_sink_write(out_sink * sink, const void * data, size_t len)
+{
+    sink->stats.bytes += len;
+    sink->stats.writes++;
+    if(sink->mode == OUT_QUIET || sink->failed)
+        return;
+
+    if(len >= sink->cap / 2)
+    {
+        write_through(sink, data, len);
+        return;
+    }
+    if(sink->buf == NULL && (sink->buf = malloc(sink->cap)) == NULL)
+        error(EXIT_FAILURE, errno, "output sink allocation failed");
+    if(sink->len + len > sink->cap)
+        out_sink_flush(sink);
+    memcpy(sink->buf + sink->len, data, len);
+    sink->len += len;
+}
+
+int out_sink_flush(out_sink * sink)
+{
+    if(sink->len > 0 && !sink->failed)
+    {
+        struct iovec iov = { sink->buf, sink->len };
+        writev_all(sink, &iov, 1);
+    }
+    sink->len = 0;
+    if(sink->failed)
+    {
+        errno = sink->failed;
+        return -1;
+    }
+    return 0;
+}
+
+/* stdio calls this with its whole buffer, or what's in it at a fflush */
+static ssize_t cookie_write(void * cookie, const char * buf, size_t size)
+{
+    out_sink * sink = cookie;
+    sink->stats.bytes += size;
+    sink->stats.writes++;
+    return write_through(sink, buf, size) == 0 ? (ssize_t)size : -1;
+}
+
+static int cookie_close(void * cookie)
+{
+    return out_sink_flush(cookie);
+}
+
+FILE * out_sink_stream(out_sink * sink)
+{
+    cookie_io_functions_t io = {
+        .read = NULL,
+        .write = cookie_write,
+        .seek = NULL,
+        .close = cookie_close,
+    };
+    FILE * stream = fopencookie(sink, "w", io);
+    if(stream == NULL)
+        error(EXIT_FAILURE, errno, "fopencookie failed");
+    /* with a NULL buffer glibc ignores the size and picks BUFSIZ */
+    sink->stream_buf = malloc(sink->cap);
+    if(sink->stream_buf == NULL)
+        error(EXIT_FAILURE, errno, "output sink allocation failed");
+    setvbuf(stream, sink->stream_buf, _IOFBF, sink->cap);
+    return stream;
+}
+
+/* the one stdout goes through. exit() flushes it like any other stream */
+static out_sink stdout_sink;
+static int installed;
+
+void out_install(out_mode mode)
+{
+    if(mode == OUT_STDIO || installed)
+        return;
+    /* line by line for whoever is watching, see the top of the file */
+    if(mode == OUT_BUFFERED && isatty(STDOUT_FILENO))
+        return;
+    fflush(stdout);
+    out_sink_init(&stdout_sink, STDOUT_FILENO, mode, OUT_BUFFER_LEN);
+    stdout = out_sink_stream(&stdout_sink);
+    installed = 1;
+}
+
+void out_flush(void)
+{
+    fflush(stdout);
+    if(installed)
+        out_sink_flush(&stdout_sink);
+}
+
+out_mode out_set_mode(out_mode mode)
+{
+    if(!installed)
+        return OUT_STDIO;
+    out_flush();
+    out_mode old = stdout_sink.mode;
+    stdout_sink.mode = mode;
+    return old;
+}
+
+/* write syscalls this process has made and bytes it has written so far,
+ * from /proc/self/io. 0 if that isn't there */
+static int write_counts(long * syscalls, long * bytes)
+{
+    FILE * f = fopen("/proc/self/io", "r");
+    if(f == NULL)
+        return 0;
+    char line[64];
+    int found = 0;
+    while(fgets(line, sizeof(line), f) != NULL)
+    {
+        if(strncmp(line, "syscw:", 6) == 0)
+        {
+            *syscalls = atol(line + 6);
+            found++;
+        }
+        else if(strncmp(line, "wchar:", 6) == 0)
+        {
+            *bytes = atol(line + 6);
+            found++;
+        }
+    }
+    fclose(f);
+    return found == 2;
+}
+
+/* two of the chattiest demos: 15 lines per character and a line per node */
+static void chatty_workload(void)
+{
+    for(int i = 0; i < OUT_BENCH_REPS; i++)
+    {
+        char_classification_demo();
+        search_tree_demo();
+    }
+}
+
+void output_sink_demo(void)
+{
+    printf( "\t==================================\n"
+            "\t== Section 12.21 output sink =====\n"
+            "\t==================================\n\n");
+
+    /* everything goes down a pipe to a child that reads and drops it, like
+     * libc_notes | grep would */
+    out_flush();
+    fflush(NULL);
+    int p[2];
+    if(pipe(p) != 0)
+        error(EXIT_FAILURE, errno, "pipe failed");
+    pid_t reader = fork();
+    if(reader < 0)
+        error(EXIT_FAILURE, errno, "fork failed");
+    if(reader == 0)
+    {
+        close(p[1]);
+        char buf[65536];
+        while(read(p[0], buf, sizeof(buf)) > 0)
+            ;
+        _exit(EXIT_SUCCESS);
+    }
+    close(p[0]);
+
+    static const char * const names[] = { "stdio", "buffered", "quiet" };
+    printf("the chatty demos %d times into a pipe:\n", OUT_BENCH_REPS);
+    printf("\t%-10s %14s %12s %12s %10s\n", "stdout", "bytes written",
+            "write calls", "bytes/call", "ms");
+    FILE * saved = stdout;
+    for(out_mode mode = OUT_STDIO; mode <= OUT_QUIET; mode++)
+    {
+        out_sink sink;
+        out_sink_init(&sink, p[1], mode, OUT_BUFFER_LEN);
+        /* plain stdio on a fresh FILE, so it picks its buffering for a
+         * pipe the way stdout would */
+        FILE * stream = mode == OUT_STDIO ? fdopen(dup(p[1]), "w")
+                                          : out_sink_stream(&sink);
+        if(stream == NULL)
+            error(EXIT_FAILURE, errno, "opening the pipe failed");
+
+        long calls_before = 0, bytes_before = 0;
+        long calls_after = 0, bytes_after = 0;
+        int counted = write_counts(&calls_before, &bytes_before);
+        struct timespec start = bench_now();
+        stdout = stream;
+        chatty_workload();
+        fclose(stream);
+        stdout = saved;
+        double seconds = bench_elapsed(start, bench_now());
+        counted = counted && write_counts(&calls_after, &bytes_after);
+
+        if(counted)
+        {
+            long calls = calls_after - calls_before;
+            long bytes = bytes_after - bytes_before;
+            printf("\t%-10s %14ld %12ld %12.0f %10.2f\n", names[mode], bytes,
+                    calls, calls ? (double)bytes / calls : 0.0,
+                    seconds * 1e3);
+        }
+        else
+        {
+            printf("\t%-10s %14s %12s %12s %10.2f\n", names[mode], "?", "?",
+                    "?", seconds * 1e3);
+        }
+        if(mode != OUT_STDIO)
+            printf("\t%-10s %zu bytes in %zu chunks, %zu writev calls\n",
+                    "", sink.stats.bytes, sink.stats.writes,
+                    sink.stats.syscalls);
+        out_sink_destroy(&sink);
+    }
+
+    close(p[1]);
+    waitpid(reader, NULL, 0);
+    printf("\n");
+}
@@ -0,0 +1,65 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <stdio.h>      /* FILE */
+#include <stddef.h>     /* size_t */
+
+/* what happens to the output */
+typedef enum _out_mode {
+    OUT_STDIO,      /* nothing, stdout stays plain stdio */
+    OUT_BUFFERED,   /* collected in the sink's buffer, written with writev */
+    OUT_QUIET       /* counted and thrown away, for benchmarking */
+} out_mode;
+
+typedef struct _out_stats {
+    size_t bytes;       /* handed to the sink */
+    size_t writes;      /* separate out_sink_write calls */
+    size_t syscalls;    /* writev calls it took */
+} out_stats;
+
+typedef struct _out_sink {
+    int fd;
+    out_mode mode;
+    char * buf;
+    size_t len;
+    size_t cap;
+    int failed;         /* a write failed, everything after is dropped */
+    char * stream_buf;  /* stdio's buffer for out_sink_stream */
+    out_stats stats;
+} out_sink;
+
+/* buffer size of the sink stdout goes through */
+#ifndef OUT_BUFFER_LEN
+#define OUT_BUFFER_LEN (1UL << 20)
+#endif
+
+void out_sink_init(out_sink * sink, int fd, out_mode mode, size_t cap);
+void out_sink_destroy(out_sink * sink);
+
+/* copies into the buffer, except for anything at least half the buffer in
+ * size, which goes out with what's buffered in one writev and isn't copied */
+void out_sink_write(out_sink * sink, const void * data, size_t len);
+
+/* -1 with errno set if the write failed (now or earlier) */
+int out_sink_flush(out_sink * sink);
+
+/* a FILE (from fopencookie) with a stdio buffer as big as the sink's, whose
+ * output goes through the sink, so printf and friends work unchanged */
+FILE * out_sink_stream(out_sink * sink);
+
+/* points stdout at a process wide sink on file descriptor 1. It's flushed
+ * along with the other streams at exit and by error(). OUT_STDIO leaves
+ * stdout as it is, and so does OUT_BUFFERED when stdout is a terminal */
+void out_install(out_mode mode);
+
+/* flush stdout and the sink under it, if there is one. Has to happen before
+ * a fork (or the child writes it out a second time) and before _exit */
+void out_flush(void);
+
+/* switch the process wide sink's mode, returns the old one. OUT_STDIO if
+ * there's no sink */
+out_mode out_set_mode(out_mode mode);
+
+void output_sink_demo(void);
+
+#endif /* OUTPUT_SINK_H */
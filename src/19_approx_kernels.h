@@ -0,0 +1,85 @@
+#ifndef APPROX_KERNELS_H
+#define APPROX_KERNELS_H
+
+/* low degree approximations shared by 19_function_variants.c and
+ * 19_fast_math.c, so the only difference between the "poly" and "fast-math"
+ * variants is the compiler flags. Good to about 1e-7, see the notes in
+ * 19_function_variants.c */
+
+#include <stdint.h> /* uint64_t */
+#include <string.h> /* memcpy */
+#include <math.h>   /* nearbyint, M_PI, M_LN2 */
+
+/* 2^n for n in [-1022, 1023] straight into the exponent field */
+static inline double approx_pow2(int n)
+{
+    uint64_t bits = (uint64_t)(n + 1023) << 52;
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+/* odd Taylor series to x^11 after folding x into [-pi/2, pi/2] */
+static inline double approx_sin(double x)
+{
+    double r = x - nearbyint(x * (0.5 / M_PI)) * (2.0 * M_PI);
+    if(r > M_PI_2)
+        r = M_PI - r;
+    else if(r < -M_PI_2)
+        r = -M_PI - r;
+    double z = r * r;
+    return r * (1.0 + z * (-1.0 / 6 + z * (1.0 / 120 + z * (-1.0 / 5040
+                + z * (1.0 / 362880 + z * (-1.0 / 39916800))))));
+}
+
+/* e^x = 2^n * e^r, |r| <= ln(2) / 2, Taylor series to r^7 */
+static inline double approx_exp(double x)
+{
+    if(x > 709.0)
+        return HUGE_VAL;
+    if(x < -708.0)
+        return 0.0;
+    double n = nearbyint(x * M_LOG2E);
+    double r = x - n * M_LN2;
+    double p = 1.0 + r * (1.0 + r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24
+                + r * (1.0 / 120 + r * (1.0 / 720 + r * (1.0 / 5040)))))));
+    return p * approx_pow2((int)n);
+}
+
+/* x = 2^k * m, m in [sqrt(1/2), sqrt(2)), and log(m) as an odd series in
+ * s = (m - 1) / (m + 1) up to s^7. Positive normal x only */
+static inline double approx_log(double x)
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int k = (int)(bits >> 52) - 1023;
+    bits = (bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+    double m;
+    memcpy(&m, &bits, sizeof(m));
+    if(m > M_SQRT2)
+    {
+        m *= 0.5;
+        k++;
+    }
+    double s = (m - 1.0) / (m + 1.0);
+    double z = s * s;
+    return k * M_LN2
+        + 2.0 * s * (1.0 + z * (1.0 / 3 + z * (1.0 / 5 + z * (1.0 / 7))));
+}
+
+/* the bit-twiddled reciprocal square root guess, three Newton steps, and
+ * multiplied by x. Positive x only */
+static inline double approx_sqrt(double x)
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    bits = 0x5fe6eb50c7b537a9ULL - (bits >> 1);
+    double y;
+    memcpy(&y, &bits, sizeof(y));
+    y = y * (1.5 - 0.5 * x * y * y);
+    y = y * (1.5 - 0.5 * x * y * y);
+    y = y * (1.5 - 0.5 * x * y * y);
+    return x * y;
+}
+
+#endif /* APPROX_KERNELS_H */
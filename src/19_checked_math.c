@@ -0,0 +1,229 @@
+/* Section 19.7 continued -- finding math errors in bulk
+ *
+ * A math function that fails reports it two ways (chapter 20.5): it sets
+ * errno (EDOM for an argument outside the domain, ERANGE for a result too big
+ * or small to represent), and it raises floating point exceptions in the FPU
+ * status word:
+ *      FE_INVALID      no sensible answer: sqrt(-1), log(-1), 0/0, inf - inf
+ *      FE_DIVBYZERO    an exact infinity from finite arguments: log(0), 1/0
+ *      FE_OVERFLOW     too big, rounded to inf: exp(1000)
+ *      FE_UNDERFLOW    too small to keep full precision: exp(-1000)
+ *      FE_INEXACT      rounded, which is almost every operation
+ *
+ * errno has to be reset before every call and read after it, because the
+ * functions only ever set it. The exception flags are sticky the same way, but
+ * that's the useful part: they accumulate, so one test after a thousand calls
+ * says whether any of them went wrong:
+ *      int feclearexcept(int EXCEPTS)
+ *      int fetestexcept(int EXCEPTS)
+ *      int fegetexceptflag(fexcept_t *FLAGP, int EXCEPTS)
+ *      int fesetexceptflag(const fexcept_t *FLAGP, int EXCEPTS)
+ *
+ * C99 says code that tests the flags should have #pragma STDC FENV_ACCESS ON
+ * so the compiler doesn't move floating point operations across the tests.
+ * GCC doesn't implement the pragma, but the calls into libm (and through a
+ * function pointer here) are opaque to it, so nothing gets moved past them.
+ * */
+
+#include "19_checked_math.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf, snprintf */
+#include <stdlib.h>     /* malloc, free */
+#include <string.h>     /* memcpy, memset */
+#include <math.h>       /* log, exp, sqrt */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+
+/* number of elements in the benchmark */
+#ifndef CHECKED_BENCH_LEN
+#define CHECKED_BENCH_LEN (1UL << 20)
+#endif
+
+/* each loop is timed this many times and the fastest run counts */
+#ifndef CHECKED_BENCH_RUNS
+#define CHECKED_BENCH_RUNS 5
+#endif
+
+int checked_map(double (*fn)(double), double * dst, const double * src,
+        size_t n, int * block_flags, checked_summary * summary)
+{
+    checked_summary s = { 0, n, 0, 0 };
+    fexcept_t saved;
+    fegetexceptflag(&saved, FE_ALL_EXCEPT);
+
+    /* when dst is src the results go through a local buffer, so src is
+     * still intact for the rescan */
+    double block[CHECKED_BLOCK_LEN];
+    for(size_t b = 0; b * CHECKED_BLOCK_LEN < n; b++)
+    {
+        size_t begin = b * CHECKED_BLOCK_LEN;
+        size_t len = n - begin < CHECKED_BLOCK_LEN ? n - begin :
+                        CHECKED_BLOCK_LEN;
+
+        double * out = dst == src ? block : dst + begin;
+        feclearexcept(CHECKED_EXCEPTS);
+        for(size_t i = 0; i < len; i++)
+            out[i] = fn(src[begin + i]);
+        int raised = fetestexcept(CHECKED_EXCEPTS);
+
+        if(raised != 0)
+        {
+            s.flags |= raised;
+            s.bad_blocks++;
+            for(size_t i = 0; s.first_index == n && i < len; i++)
+            {
+                feclearexcept(CHECKED_EXCEPTS);
+                fn(src[begin + i]);
+                if((s.first_flags = fetestexcept(CHECKED_EXCEPTS)) != 0)
+                    s.first_index = begin + i;
+            }
+        }
+        if(block_flags != NULL)
+            block_flags[b] = raised;
+        if(out == block)
+            memcpy(dst + begin, block, len * sizeof(double));
+    }
+
+    fesetexceptflag(&saved, FE_ALL_EXCEPT);
+    if(summary != NULL)
+        *summary = s;
+    return s.flags;
+}
+
+const char * checked_flag_names(int flags)
+{
+    static const struct {
+        int flag;
+        const char * name;
+    } names[] = {
+        { FE_INVALID, "FE_INVALID" },
+        { FE_DIVBYZERO, "FE_DIVBYZERO" },
+        { FE_OVERFLOW, "FE_OVERFLOW" },
+        { FE_UNDERFLOW, "FE_UNDERFLOW" },
+        { FE_INEXACT, "FE_INEXACT" },
+    };
+    static char buf[80];
+
+    size_t len = 0;
+    buf[0] = '\0';
+    for(size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        if(flags & names[i].flag)
+            len += snprintf(buf + len, sizeof(buf) - len, "%s%s",
+                            len ? "|" : "", names[i].name);
+    return len ? buf : "none";
+}
+
+static void checked_benchmark(void)
+{
+    size_t n = CHECKED_BENCH_LEN;
+    double * src = malloc(n * sizeof(double));
+    double * dst = malloc(n * sizeof(double));
+    if(src == NULL || dst == NULL)
+        error(EXIT_FAILURE, errno, "benchmark array allocation failed");
+
+    /* positive values with the occasional negative one */
+    unsigned long state = 1;
+    for(size_t i = 0; i < n; i++)
+    {
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        src[i] = (double)(state >> 11) * 0x1.0p-40;
+        if((state >> 20) % 50000 == 0)
+            src[i] = -src[i];
+    }
+    printf("sqrt over %zu elements, a few of them negative, fastest of %d "
+            "runs:\n", n, CHECKED_BENCH_RUNS);
+
+    /* fault dst in first, or whichever loop writes it first pays for a
+     * couple of thousand page faults and the overheads come out negative */
+    memset(dst, 0, n * sizeof(double));
+
+    double plain = 0;
+    for(int run = 0; run < CHECKED_BENCH_RUNS; run++)
+    {
+        struct timespec start = bench_now();
+        for(size_t i = 0; i < n; i++)
+            dst[i] = sqrt(src[i]);
+        double t = bench_elapsed(start, bench_now());
+        if(run == 0 || t < plain)
+            plain = t;
+    }
+    bench_print_throughput("unchecked", n * sizeof(double), plain);
+
+    size_t errno_first = n;
+    size_t errno_count = 0;
+    double per_element = 0;
+    for(int run = 0; run < CHECKED_BENCH_RUNS; run++)
+    {
+        errno_first = n;
+        errno_count = 0;
+        struct timespec start = bench_now();
+        for(size_t i = 0; i < n; i++)
+        {
+            errno = 0;
+            dst[i] = sqrt(src[i]);
+            if(errno != 0)
+            {
+                if(errno_first == n)
+                    errno_first = i;
+                errno_count++;
+            }
+        }
+        double t = bench_elapsed(start, bench_now());
+        if(run == 0 || t < per_element)
+            per_element = t;
+    }
+    bench_print_throughput("errno per element", n * sizeof(double),
+            per_element);
+
+    checked_summary summary;
+    double blocked = 0;
+    for(int run = 0; run < CHECKED_BENCH_RUNS; run++)
+    {
+        struct timespec start = bench_now();
+        checked_map(sqrt, dst, src, n, NULL, &summary);
+        double t = bench_elapsed(start, bench_now());
+        if(run == 0 || t < blocked)
+            blocked = t;
+    }
+    bench_print_throughput("checked_map", n * sizeof(double), blocked);
+
+    printf( "\toverhead vs unchecked: errno %+.1f%%, checked_map %+.1f%%\n"
+            "\terrno: %zu errors, first at %zu. checked_map: %s in %zu "
+            "blocks, first at %zu\n",
+            100.0 * (per_element - plain) / plain,
+            100.0 * (blocked - plain) / plain,
+            errno_count, errno_first,
+            checked_flag_names(summary.flags), summary.bad_blocks,
+            summary.first_index);
+
+    free(dst);
+    free(src);
+}
+
+void checked_math_demo(void)
+{
+    double src[] = { 1.0, 2.0, 0.0, -1.0, 1e300, 1e-300, 710.0, -746.0 };
+    size_t n = sizeof(src) / sizeof(src[0]);
+    double dst[sizeof(src) / sizeof(src[0])];
+    checked_summary summary;
+
+    /* the same inputs through a few functions */
+    static const struct {
+        const char * name;
+        double (*fn)(double);
+    } funcs[] = { { "log", log }, { "sqrt", sqrt }, { "exp", exp } };
+    for(size_t f = 0; f < sizeof(funcs) / sizeof(funcs[0]); f++)
+    {
+        checked_map(funcs[f].fn, dst, src, n, NULL, &summary);
+        printf("checked_map(%s): %s", funcs[f].name,
+                checked_flag_names(summary.flags));
+        if(summary.first_index < n)
+            printf(", first at [%zu] = %g which raised %s",
+                    summary.first_index, src[summary.first_index],
+                    checked_flag_names(summary.first_flags));
+        printf("\n");
+    }
+
+    checked_benchmark();
+}
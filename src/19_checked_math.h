@@ -0,0 +1,41 @@
+#ifndef CHECKED_MATH_H
+#define CHECKED_MATH_H
+
+#include <stddef.h> /* size_t */
+#include <fenv.h>   /* FE_INVALID etc. */
+
+/* the exceptions that mean something went wrong. FE_INEXACT is left out,
+ * nearly every operation raises it */
+#define CHECKED_EXCEPTS (FE_INVALID | FE_DIVBYZERO | FE_OVERFLOW | FE_UNDERFLOW)
+
+/* elements per fetestexcept */
+#ifndef CHECKED_BLOCK_LEN
+#define CHECKED_BLOCK_LEN 1024
+#endif
+
+typedef struct _checked_summary {
+    int flags;              /* every exception raised anywhere */
+    size_t first_index;     /* first element that raised one, n if none did */
+    int first_flags;        /* what that element raised */
+    size_t bad_blocks;      /* blocks that raised anything */
+} checked_summary;
+
+/* dst[i] = fn(src[i]) with the floating point exception flags checked once
+ * per CHECKED_BLOCK_LEN elements instead of errno once per element. When a
+ * block raised something, just that block is run again an element at a time
+ * to find the first culprit (fn has to be a pure function for that).
+ *
+ * block_flags, if not NULL, gets what each block raised, and needs room for
+ * (n + CHECKED_BLOCK_LEN - 1) / CHECKED_BLOCK_LEN ints. summary may be NULL.
+ * Returns summary->flags. The caller's exception flags are left as they were
+ * on entry */
+int checked_map(double (*fn)(double), double * dst, const double * src,
+        size_t n, int * block_flags, checked_summary * summary);
+
+/* "FE_INVALID|FE_OVERFLOW" or "none" for a set of flags, in a static buffer */
+const char * checked_flag_names(int flags);
+
+/* shows it off and measures it against checking errno per element */
+void checked_math_demo(void);
+
+#endif /* CHECKED_MATH_H */
@@ -0,0 +1,44 @@
+/* -ffast-math variants for 19_function_variants.c
+ *
+ * -ffast-math lets the compiler pretend floating point is real arithmetic:
+ * no NaNs or infinities (-ffinite-math-only), no signed zeros, reassociate
+ * and contract a * b + c into an fma as it likes (-fassociative-math), and
+ * no errno from the math functions (-fno-math-errno). The last one is what
+ * turns sqrt(x) into a single sqrtsd instruction, where normally it has to
+ * check for a negative argument and call into libm to set EDOM.
+ *
+ * It's a per file decision here (the Makefile adds the flags for this .o
+ * only), because it isn't safe for code that relies on NaN or inf checks.
+ * The kernels are the same source as the "poly" variants, and both objects
+ * are built at -O2, so comparing the two shows just what the flags are worth.
+ * */
+
+#include "19_fast_math.h"
+#include "19_approx_kernels.h"
+
+#include <math.h>   /* sqrt */
+
+double fm_sin(double x)
+{
+    return approx_sin(x);
+}
+
+double fm_exp(double x)
+{
+    return approx_exp(x);
+}
+
+double fm_log(double x)
+{
+    return approx_log(x);
+}
+
+double fm_sqrt(double x)
+{
+    return approx_sqrt(x);
+}
+
+double fm_libm_sqrt(double x)
+{
+    return sqrt(x);
+}
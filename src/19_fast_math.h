@@ -0,0 +1,12 @@
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+/* compiled with -O2 -ffast-math (see the Makefile), everything else in the
+ * program is built with the normal flags */
+double fm_sin(double x);
+double fm_exp(double x);
+double fm_log(double x);
+double fm_sqrt(double x);
+double fm_libm_sqrt(double x);
+
+#endif /* FAST_MATH_H */
@@ -0,0 +1,302 @@
+/* Section 19.9 continued -- trading accuracy for speed
+ *
+ * libm gets within an ULP or so of the right answer for every input, with
+ * every special case and errno handled. Lots of call sites don't need that:
+ * a sigmoid in a model, a colour curve, or an animation is fine at 1e-6.
+ * Every variant below is a different point on that curve:
+ *
+ *      - poly: reduce the argument the cheap way (no Cody-Waite split, no
+ *        special cases) and evaluate a short Taylor series. Around 1e-7
+ *      - table: precompute values once, then look up and interpolate. Linear
+ *        interpolation on a table of N points has error about h^2/8 times
+ *        the second derivative, h being the spacing, so a 4096 entry sin
+ *        table is good to 3e-7. exp uses 64 entries of 2^(j/64) and a cubic
+ *        for the leftover, which is more accurate than it is cheap
+ *      - fast-math: the same source as poly (or the libm call for sqrt)
+ *        compiled with -ffast-math, in 19_fast_math.c. This file is built
+ *        at the same -O2 so the flag is all that differs
+ *
+ * fv_choose picks the fastest one that is accurate enough, from an actual
+ * measurement on this machine, so a call site can say what it needs instead
+ * of which one it wants. Tables are built on first use (pthread_once, so
+ * that's safe from any thread).
+ *
+ * Error is reported as absolute where the true value is under 1 in
+ * magnitude and relative above that, since relative error means nothing
+ * next to a zero of sin or log.
+ * */
+
+#include "19_function_variants.h"
+#include "19_approx_kernels.h"
+#include "19_fast_math.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* malloc, free */
+#include <string.h>     /* strcmp */
+#include <math.h>       /* sin, exp, log, sqrt, floor, exp2, log1p */
+#include <pthread.h>    /* pthread_once, mutexes */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+
+/* number of points each variant is timed and checked on */
+#ifndef FV_BENCH_LEN
+#define FV_BENCH_LEN (1UL << 20)
+#endif
+
+/* table sizes */
+#ifndef FV_SIN_TABLE_LEN
+#define FV_SIN_TABLE_LEN 4096
+#endif
+#define FV_EXP_TABLE_LEN 64
+#define FV_LOG_TABLE_LEN 256
+
+static double sin_table[FV_SIN_TABLE_LEN + 1];
+static double exp_table[FV_EXP_TABLE_LEN];
+static double log_table[FV_LOG_TABLE_LEN + 1];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void build_tables(void)
+{
+    for(int i = 0; i <= FV_SIN_TABLE_LEN; i++)
+        sin_table[i] = sin(2.0 * M_PI * i / FV_SIN_TABLE_LEN);
+    for(int j = 0; j < FV_EXP_TABLE_LEN; j++)
+        exp_table[j] = exp2((double)j / FV_EXP_TABLE_LEN);
+    for(int i = 0; i <= FV_LOG_TABLE_LEN; i++)
+        log_table[i] = log1p((double)i / FV_LOG_TABLE_LEN);
+}
+
+static double table_sin(double x)
+{
+    pthread_once(&tables_once, build_tables);
+    double t = x * (FV_SIN_TABLE_LEN / (2.0 * M_PI));
+    t -= floor(t / FV_SIN_TABLE_LEN) * FV_SIN_TABLE_LEN;
+    int i = (int)t;
+    if(i >= FV_SIN_TABLE_LEN)   /* t rounded up to exactly the length */
+        i = FV_SIN_TABLE_LEN - 1;
+    double frac = t - i;
+    return sin_table[i] + frac * (sin_table[i + 1] - sin_table[i]);
+}
+
+/* x = (64n + j) * ln(2) / 64 + r, so e^x = 2^n * 2^(j/64) * e^r */
+static double table_exp(double x)
+{
+    pthread_once(&tables_once, build_tables);
+    if(x > 709.0)
+        return HUGE_VAL;
+    if(x < -708.0)
+        return 0.0;
+    double k = nearbyint(x * (FV_EXP_TABLE_LEN * M_LOG2E));
+    double r = x - k * (M_LN2 / FV_EXP_TABLE_LEN);
+    int ki = (int)k;
+    int j = ki & (FV_EXP_TABLE_LEN - 1);
+    int n = (ki - j) / FV_EXP_TABLE_LEN;
+    double p = 1.0 + r * (1.0 + r * (0.5 + r * (1.0 / 6)));
+    return exp_table[j] * p * approx_pow2(n);
+}
+
+/* x = 2^k * m, m in [1, 2), and log(m) interpolated from the table */
+static double table_log(double x)
+{
+    pthread_once(&tables_once, build_tables);
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int k = (int)(bits >> 52) - 1023;
+    bits = (bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+    double m;
+    memcpy(&m, &bits, sizeof(m));
+    double t = (m - 1.0) * FV_LOG_TABLE_LEN;
+    int i = (int)t;
+    double frac = t - i;
+    return k * M_LN2 + log_table[i] + frac * (log_table[i + 1] - log_table[i]);
+}
+
+static double poly_sin(double x)
+{
+    return approx_sin(x);
+}
+
+static double poly_exp(double x)
+{
+    return approx_exp(x);
+}
+
+static double poly_log(double x)
+{
+    return approx_log(x);
+}
+
+static double poly_sqrt(double x)
+{
+    return approx_sqrt(x);
+}
+
+const fv_impl fv_impls[] = {
+    { "sin",  "libm",      sin },
+    { "sin",  "poly",      poly_sin },
+    { "sin",  "table",     table_sin },
+    { "sin",  "fast-math", fm_sin },
+    { "exp",  "libm",      exp },
+    { "exp",  "poly",      poly_exp },
+    { "exp",  "table",     table_exp },
+    { "exp",  "fast-math", fm_exp },
+    { "log",  "libm",      log },
+    { "log",  "poly",      poly_log },
+    { "log",  "table",     table_log },
+    { "log",  "fast-math", fm_log },
+    { "sqrt", "libm",      sqrt },
+    { "sqrt", "poly",      poly_sqrt },
+    { "sqrt", "fast-math", fm_libm_sqrt },
+};
+const size_t fv_num_impls = sizeof(fv_impls) / sizeof(fv_impls[0]);
+
+/* where each function is tested, and the long double reference */
+static const struct {
+    const char * func;
+    double lo;
+    double hi;
+    int log_scale;  /* spread the points evenly over the exponents */
+    long double (*reference)(long double);
+} domains[] = {
+    { "sin",  -10.0, 10.0, 0, sinl },
+    { "exp",  -50.0, 50.0, 0, expl },
+    { "log",  1e-6,  1e6,  1, logl },
+    { "sqrt", 1e-6,  1e6,  1, sqrtl },
+};
+
+fv_fn fv_lookup(const char * func, const char * variant)
+{
+    for(size_t i = 0; i < fv_num_impls; i++)
+        if(strcmp(fv_impls[i].func, func) == 0
+                && strcmp(fv_impls[i].variant, variant) == 0)
+            return fv_impls[i].fn;
+    return NULL;
+}
+
+void fv_measure(const fv_impl * impl, fv_result * result)
+{
+    size_t d = 0;
+    while(d < sizeof(domains) / sizeof(domains[0])
+            && strcmp(domains[d].func, impl->func) != 0)
+        d++;
+    if(d == sizeof(domains) / sizeof(domains[0]))
+        error(EXIT_FAILURE, EINVAL, "no test domain for %s", impl->func);
+
+    size_t n = FV_BENCH_LEN;
+    double * xs = malloc(n * sizeof(double));
+    double * ys = malloc(n * sizeof(double));
+    if(xs == NULL || ys == NULL)
+        error(EXIT_FAILURE, errno, "benchmark array allocation failed");
+    double lo = domains[d].log_scale ? log(domains[d].lo) : domains[d].lo;
+    double hi = domains[d].log_scale ? log(domains[d].hi) : domains[d].hi;
+    unsigned long state = 1;
+    for(size_t i = 0; i < n; i++)
+    {
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        double u = lo + (hi - lo) * (double)(state >> 11) * 0x1.0p-53;
+        xs[i] = domains[d].log_scale ? exp(u) : u;
+    }
+
+    fv_fn fn = impl->fn;
+    fn(xs[0]);  /* build any tables outside the timing */
+    struct timespec start = bench_now();
+    for(size_t i = 0; i < n; i++)
+        ys[i] = fn(xs[i]);
+    double seconds = bench_elapsed(start, bench_now());
+    result->ns_per_call = seconds * 1e9 / n;
+    result->calls_per_sec = seconds > 0.0 ? n / seconds : 0.0;
+
+    double max_error = 0.0;
+    double sum_error = 0.0;
+    for(size_t i = 0; i < n; i++)
+    {
+        long double want = domains[d].reference(xs[i]);
+        long double scale = fabsl(want) < 1.0L ? 1.0L : fabsl(want);
+        double e = (double)(fabsl((long double)ys[i] - want) / scale);
+        if(e > max_error)
+            max_error = e;
+        sum_error += e;
+    }
+    result->max_error = max_error;
+    result->mean_error = sum_error / n;
+
+    free(ys);
+    free(xs);
+}
+
+/* measurements are made once per variant, on first use */
+static pthread_mutex_t measured_lock = PTHREAD_MUTEX_INITIALIZER;
+static fv_result measured[sizeof(fv_impls) / sizeof(fv_impls[0])];
+static int have_measured[sizeof(fv_impls) / sizeof(fv_impls[0])];
+
+static fv_result measurement(size_t i)
+{
+    pthread_mutex_lock(&measured_lock);
+    if(!have_measured[i])
+    {
+        fv_measure(&fv_impls[i], &measured[i]);
+        have_measured[i] = 1;
+    }
+    fv_result result = measured[i];
+    pthread_mutex_unlock(&measured_lock);
+    return result;
+}
+
+fv_fn fv_choose(const char * func, double max_error)
+{
+    fv_fn best = NULL;
+    double best_ns = 0.0;
+
+    for(size_t i = 0; i < fv_num_impls; i++)
+    {
+        if(strcmp(fv_impls[i].func, func) != 0)
+            continue;
+        fv_result r = measurement(i);
+        if(r.max_error <= max_error && (best == NULL || r.ns_per_call < best_ns))
+        {
+            best = fv_impls[i].fn;
+            best_ns = r.ns_per_call;
+        }
+    }
+
+    /* nothing is that good, libm is as good as it gets */
+    if(best == NULL)
+        best = fv_lookup(func, "libm");
+    return best;
+}
+
+static const char * variant_name(fv_fn fn)
+{
+    for(size_t i = 0; i < fv_num_impls; i++)
+        if(fv_impls[i].fn == fn)
+            return fv_impls[i].variant;
+    return "?";
+}
+
+void fv_demo(void)
+{
+    printf("%zu points per variant:\n", (size_t)FV_BENCH_LEN);
+    printf("\t%-5s %-10s %10s %12s %10s %10s\n",
+            "func", "variant", "ns/call", "Mcalls/s", "max err", "mean err");
+    for(size_t i = 0; i < fv_num_impls; i++)
+    {
+        fv_result r = measurement(i);
+        printf("\t%-5s %-10s %10.2f %12.1f %10.2e %10.2e\n",
+                fv_impls[i].func, fv_impls[i].variant, r.ns_per_call,
+                r.calls_per_sec / 1e6, r.max_error, r.mean_error);
+    }
+
+    static const char * const funcs[] = { "sin", "exp", "log", "sqrt" };
+    static const double tolerances[] = { 1e-15, 1e-9, 1e-6, 1e-3 };
+    printf("fv_choose picks, by max error allowed:\n\t%-5s", "");
+    for(size_t t = 0; t < 4; t++)
+        printf(" %10.0e", tolerances[t]);
+    printf("\n");
+    for(size_t f = 0; f < 4; f++)
+    {
+        printf("\t%-5s", funcs[f]);
+        for(size_t t = 0; t < 4; t++)
+            printf(" %10s", variant_name(fv_choose(funcs[f], tolerances[t])));
+        printf("\n");
+    }
+}
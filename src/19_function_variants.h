@@ -0,0 +1,45 @@
+#ifndef FUNCTION_VARIANTS_H
+#define FUNCTION_VARIANTS_H
+
+#include <stddef.h> /* size_t */
+
+typedef double (*fv_fn)(double);
+
+/* one way of computing one function. variant is one of
+ *      "libm"      the libm call, the reference for accuracy
+ *      "poly"      a short polynomial after range reduction
+ *      "table"     a precomputed table with interpolation
+ *      "fast-math" the poly source (or libm for sqrt) built with -ffast-math
+ * not every function has every variant */
+typedef struct _fv_impl {
+    const char * func;
+    const char * variant;
+    fv_fn fn;
+} fv_impl;
+
+extern const fv_impl fv_impls[];
+extern const size_t fv_num_impls;
+
+typedef struct _fv_result {
+    double ns_per_call;
+    double calls_per_sec;
+    double max_error;   /* absolute where |f(x)| < 1, relative elsewhere */
+    double mean_error;
+} fv_result;
+
+/* NULL if there's no such function or variant */
+fv_fn fv_lookup(const char * func, const char * variant);
+
+/* time impl over its function's test domain and compare against a long
+ * double reference */
+void fv_measure(const fv_impl * impl, fv_result * result);
+
+/* the fastest variant of func whose max error is at most max_error, from a
+ * measurement of all of them made on the first call for that function. The
+ * libm variant always qualifies as a fallback. NULL for an unknown func */
+fv_fn fv_choose(const char * func, double max_error);
+
+/* table of every variant's speed and error */
+void fv_demo(void);
+
+#endif /* FUNCTION_VARIANTS_H */
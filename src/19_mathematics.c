@@ -1,7 +1,17 @@
 #include "19_mathematics.h"
+#include "19_vector_math.h"
+#include "19_prng.h"
+#include "19_function_variants.h"
+#include "19_checked_math.h"
+#include "19_summation.h"
+#include "19_special_functions.h"
 
 #include "math.h"
 #include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "errno.h"
+#include "fenv.h"
 
 static void constants(void);
 static void trig(void);
@@ -12,6 +22,7 @@ static void specials(void);
 static void errors_in_math(void);
 static void pseudo_random(void);
 static void function_optimizations(void);
+static void summation(void);
 
 void mathematics_run_demos(void)
 {
@@ -24,6 +35,7 @@ void mathematics_run_demos(void)
     errors_in_math();
     pseudo_random();
     function_optimizations();
+    summation();
 }
 
 static void constants(void)
@@ -56,42 +68,281 @@ static void constants(void)
     printf("\n");
 }
 
+/* Section 19.2 Notes
+ *      double sin(double X), cos, tan
+ *      void sincos(double X, double *SINX, double *COSX)
+ * all take radians. sincos is a GNU extension that does both for the price of
+ * one range reduction. Each has an f (float) and l (long double) version, as
+ * does everything else in this chapter.
+ *
+ * For whole arrays see 19_vector_math.c */
 static void trig(void)
 {
+    printf( "==================\n"
+            "== SECTION 19.2 ==\n"
+            "====== TRIG ======\n"
+            "==================\n\n");
+
+    double s;
+    double c;
+    sincos(M_PI / 6, &s, &c);
+    printf("sin(pi/6) = %.17g, cos(pi/6) = %.17g, tan(pi/4) = %.17g\n",
+            s, c, tan(M_PI_4));
+    /* pi isn't exactly representable, so sin(M_PI) isn't exactly 0 */
+    printf("sin(M_PI) = %.17g\n", sin(M_PI));
 
+    double angles[8];
+    double sines[8];
+    double cosines[8];
+    for(int i = 0; i < 8; i++)
+        angles[i] = i * M_PI_4;
+    vm_sin(sines, angles, 8);
+    vm_cos(cosines, angles, 8);
+    printf("vm_sin and vm_cos over multiples of pi/4:\n");
+    for(int i = 0; i < 8; i++)
+        printf("\t%d pi/4: % .17f % .17f\n", i, sines[i], cosines[i]);
+
+    vm_benchmark(VM_SIN);
+    vm_benchmark(VM_COS);
+    printf("\n");
 }
 
+/* Section 19.3 Notes
+ *      double asin(double X), acos, atan
+ *      double atan2(double Y, double X)
+ * asin and acos are only defined on [-1, 1] and return NaN (with errno EDOM)
+ * outside it. atan2 is the one to use for the angle of a point, since it
+ * looks at the signs of both arguments to get the quadrant right and doesn't
+ * divide by X */
 static void inverse_trig(void)
 {
+    printf( "==================\n"
+            "== SECTION 19.3 ==\n"
+            "== INVERSE TRIG ==\n"
+            "==================\n\n");
+
+    printf("asin(0.5) = %.17g (pi/6 = %.17g)\n", asin(0.5), M_PI / 6);
+    printf("acos(2) = %g, out of the domain\n", acos(2.0));
+    printf("atan(-1/-1) = %g but atan2(-1, -1) = %g (-3pi/4)\n",
+            atan(-1.0 / -1.0), atan2(-1.0, -1.0));
 
+    /* round trip through the array sin, back inside [-pi/2, pi/2] */
+    double angles[5] = { -1.5, -0.75, 0.0, 0.75, 1.5 };
+    double sines[5];
+    vm_sin(sines, angles, 5);
+    printf("asin(vm_sin(x)):");
+    for(int i = 0; i < 5; i++)
+        printf(" %g", asin(sines[i]));
+    printf("\n\n");
 }
 
+/* Section 19.4 Notes
+ *      double exp(double X), exp2, exp10
+ *      double log(double X), log2, log10, logb
+ *      double pow(double BASE, double POWER)
+ *      double sqrt(double X), cbrt, hypot(double X, double Y)
+ *      double expm1(double X), log1p(double X)
+ * exp overflows to HUGE_VAL (errno ERANGE) past about 709.78, log of a
+ * negative is NaN (EDOM) and log(0) is -HUGE_VAL (ERANGE). expm1 and log1p
+ * exist because exp(x) - 1 and log(1 + x) lose everything to rounding when x
+ * is close to 0 */
 static void exponents_logs(void)
 {
+    printf( "==================\n"
+            "== SECTION 19.4 ==\n"
+            "= EXPONENTS/LOGS =\n"
+            "==================\n\n");
+
+    printf("exp(1) = %.17g, log(M_E) = %.17g\n", exp(1.0), log(M_E));
+    printf("exp2(10) = %g, exp10(3) = %g, log2(1024) = %g, log10(1e-3) = %g\n",
+            exp2(10.0), exp10(3.0), log2(1024.0), log10(1e-3));
+    printf("pow(2, 0.5) = %.17g, sqrt(2) = %.17g, cbrt(-27) = %g, "
+            "hypot(3, 4) = %g\n",
+            pow(2.0, 0.5), sqrt(2.0), cbrt(-27.0), hypot(3.0, 4.0));
+    printf("exp(1e-10) - 1 = %.17g but expm1(1e-10) = %.17g\n",
+            exp(1e-10) - 1, expm1(1e-10));
 
+    /* the special cases go through libm, so they come out the same */
+    double specials[4] = { -1.0, 0.0, INFINITY, NAN };
+    double logs[4];
+    vm_log(logs, specials, 4);
+    printf("vm_log of -1, 0, inf, nan: %g %g %g %g\n",
+            logs[0], logs[1], logs[2], logs[3]);
+
+    vm_benchmark(VM_EXP);
+    vm_benchmark(VM_LOG);
+    printf("\n");
 }
 
+/* Section 19.5 Notes
+ *      double sinh(double X), cosh, tanh
+ *      double asinh(double X), acosh, atanh
+ * tanh is the popular one (it squashes everything into (-1, 1)), and it runs
+ * into 1.0 in double precision by x = 20 or so */
 static void hyperbolics(void)
 {
+    printf( "==================\n"
+            "== SECTION 19.5 ==\n"
+            "== HYPERBOLICS ===\n"
+            "==================\n\n");
+
+    printf("sinh(1) = %.17g, cosh(1) = %.17g, cosh^2 - sinh^2 = %.17g\n",
+            sinh(1.0), cosh(1.0),
+            cosh(1.0) * cosh(1.0) - sinh(1.0) * sinh(1.0));
+    printf("asinh(sinh(2)) = %.17g, atanh(tanh(0.5)) = %.17g\n",
+            asinh(sinh(2.0)), atanh(tanh(0.5)));
 
+    float x[6] = { -30.0f, -1.0f, -0.0f, 1e-4f, 0.5f, 30.0f };
+    float y[6];
+    vm_tanhf(y, x, 6);
+    printf("vm_tanhf:");
+    for(int i = 0; i < 6; i++)
+        printf(" %g -> %.9g", x[i], y[i]);
+    printf("\n");
+
+    vm_benchmark(VM_TANH);
+    printf("\n");
 }
 
+/* Section 19.6 Notes
+ *      double erf(double X), erfc(double X)
+ *      double tgamma(double X), lgamma(double X), lgamma_r(double X, int *SIGNP)
+ *      double j0(double X), j1, jn(int N, double X), y0, y1, yn
+ * erfc(x) is 1 - erf(x) without losing everything to cancellation when erf(x)
+ * is close to 1. tgamma is the real gamma function (gamma() is an old name
+ * for lgamma, hence the t). lgamma is log|gamma(x)| and puts the sign in the
+ * global signgam, so threads should use lgamma_r. j and y are Bessel
+ * functions of the first and second kind.
+ *
+ * For tables of them see 19_special_functions.c */
 static void specials(void)
 {
+    printf( "==================\n"
+            "== SECTION 19.6 ==\n"
+            "==== SPECIALS ====\n"
+            "==================\n\n");
+
+    printf("erf(1) = %.17g, erfc(5) = %.17g, 1 - erf(5) = %.17g\n",
+            erf(1.0), erfc(5.0), 1.0 - erf(5.0));
+    int sign;
+    double lg = lgamma_r(-0.5, &sign);
+    printf("tgamma(5) = %g, tgamma(0.5)^2 = %.17g (pi), "
+            "lgamma_r(-0.5) = %.17g with sign %d\n",
+            tgamma(5.0), tgamma(0.5) * tgamma(0.5), lg, sign);
+    printf("j0(0) = %g, j1(1) = %.17g, jn(2, 1) = %.17g, y0(1) = %.17g\n",
+            j0(0.0), j1(1.0), jn(2, 1.0), y0(1.0));
 
+    sf_demo();
+    printf("\n");
 }
 
+/* Section 19.7 Notes
+ * The manual has a table of the largest error (in ULPs) known for each
+ * function on each architecture. Most are 1 or 2, some of the special
+ * functions are much worse, and the float versions are usually the roughest.
+ * 19_vector_math.c measures a few of them for comparison.
+ *
+ * The other kind of error is the argument being wrong to begin with, which
+ * libm reports through errno and the floating point exception flags. Checking
+ * the flags once per block is in 19_checked_math.c */
 static void errors_in_math(void)
 {
+    printf( "==================\n"
+            "== SECTION 19.7 ==\n"
+            "===== ERRORS =====\n"
+            "==================\n\n");
 
+    errno = 0;
+    feclearexcept(FE_ALL_EXCEPT);
+    double r = log(-1.0);
+    printf("log(-1) = %g, errno %s, raised %s\n", r, strerror(errno),
+            checked_flag_names(fetestexcept(FE_ALL_EXCEPT)));
+    errno = 0;
+    feclearexcept(FE_ALL_EXCEPT);
+    r = exp(1000.0);
+    printf("exp(1000) = %g, errno %s, raised %s\n", r, strerror(errno),
+            checked_flag_names(fetestexcept(FE_ALL_EXCEPT)));
+
+    checked_math_demo();
+    printf("\n");
 }
 
+/* Section 19.8 Notes
+ * Three families, all deterministic for a given seed:
+ *      int rand(void), void srand(unsigned int SEED)           ISO C
+ *      long int random(void), void srandom(unsigned int SEED)  BSD
+ *      double drand48(void), long int lrand48(void) ...        SVID
+ * RAND_MAX is only guaranteed to be 32767 (it's 2^31 - 1 on glibc). Each keeps
+ * its state in a hidden global, and each has a reentrant version that takes
+ * the state as an argument instead: rand_r, random_r and drand48_r. Those
+ * are the ones to use from threads.
+ *
+ * None of them should be anywhere near cryptography, see getrandom(2) */
 static void pseudo_random(void)
 {
+    printf( "==================\n"
+            "== SECTION 19.8 ==\n"
+            "== PSEUDORANDOM ==\n"
+            "==================\n\n");
+
+    srand48(1);
+    double first = drand48();
+    double second = drand48();
+    printf("drand48 after srand48(1): %.5f %.5f, then lrand48 %ld\n",
+            first, second, lrand48());
+
+    struct drand48_data data;
+    double d;
+    srand48_r(1, &data);
+    drand48_r(&data, &d);
+    printf("drand48_r with its own buffer, same seed: %.5f\n", d);
 
+    unsigned seed = 1;
+    printf("rand_r: %d (RAND_MAX %d)\n", rand_r(&seed), RAND_MAX);
+
+    /* xoshiro256** and PCG32, see 19_prng.c */
+    prng_demo();
+    printf("\n");
 }
 
+/* Section 19.9 Notes
+ * Calling a libm function costs a call, and the function then has to check
+ * for NaN, infinities and out of range arguments, set errno, and get within
+ * an ULP or so for every input. GCC knows what most of them do, so it can
+ * fold sin(0.0) at compile time and turn fabs or (with -fno-math-errno) sqrt
+ * into one instruction, but anything beyond that is a choice between speed
+ * and accuracy that only the caller can make. -ffast-math makes some of those
+ * choices for the whole file it's applied to.
+ *
+ * 19_function_variants.c measures several ways of computing the same thing
+ * so that choice can be made per call site */
 static void function_optimizations(void)
 {
+    printf( "==================\n"
+            "== SECTION 19.9 ==\n"
+            "== OPTIMIZATION ==\n"
+            "==================\n\n");
+
+    /* what a call site that can live with 1e-6 would do */
+    fv_fn fast_sin = fv_choose("sin", 1e-6);
+    printf("fv_choose(\"sin\", 1e-6)(1.0) = %.9f, sin(1.0) = %.9f\n",
+            fast_sin(1.0), sin(1.0));
+
+    fv_demo();
+    printf("\n");
+}
 
+/* Section 19.10 Notes
+ * Not a section of the manual: libm has no function for adding up an array,
+ * and the obvious loop loses precision with every add. 19_summation.c has
+ * the compensated ways of doing it, and the threaded ones */
+static void summation(void)
+{
+    printf( "==================\n"
+            "= SECTION 19.10 ==\n"
+            "=== SUMMATION ====\n"
+            "==================\n\n");
+
+    summation_demo();
+    printf("\n");
 }
@@ -0,0 +1,508 @@
+/* Section 19.8 continued -- faster random numbers
+ *
+ * drand48 and friends are a 48 bit linear congruential generator, and the
+ * non _r versions keep that state in a hidden global (the search and sort
+ * demos use drand48 this way). From several threads they race on it, and
+ * the _r versions fix that by taking a struct drand48_data instead, but the
+ * generator itself is still a 48 bit LCG: short period, weak low bits, and a
+ * multiply-add per draw with a division to make a double.
+ *
+ * The two here are the usual modern choices:
+ *      - xoshiro256** (Blackman & Vigna 2018): 4 words of state, shifts,
+ *        rotates and xors, period 2^256 - 1. The state update has no carries,
+ *        so four of them side by side map onto AVX2 lanes directly. There is
+ *        a jump function equal to 2^128 calls, so one seed can be split into
+ *        2^128 streams that never overlap, one per thread
+ *      - PCG32 (O'Neill 2014): a 64 bit LCG with a permutation applied to the
+ *        output, which fixes the weak bits. Different odd increments give
+ *        different sequences, and an LCG can be advanced by any distance in
+ *        log time
+ *
+ * Neither is for cryptography, use getrandom(2) for that.
+ *
+ * Doubles come from the top bits of a 64 bit draw: (x >> 11) * 2^-53 gives
+ * every multiple of 2^-53 in [0, 1). AVX2 has no 64 bit integer to double
+ * conversion, so the bulk version puts 52 bits into the mantissa of a double
+ * in [1, 2) and subtracts 1.
+ * */
+
+#include "19_prng.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* drand48, drand48_r, random_r, rand_r, malloc */
+#include <string.h>     /* memcpy, memcmp */
+#include <pthread.h>    /* pthread_create, pthread_join, mutexes */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+#ifdef __x86_64__
+#include <immintrin.h>  /* AVX2 intrinsics */
+#endif
+
+/* doubles generated per benchmark, and the threads to spread them over */
+#ifndef PRNG_BENCH_LEN
+#define PRNG_BENCH_LEN (1UL << 22)
+#endif
+#ifndef PRNG_BENCH_THREADS
+#define PRNG_BENCH_THREADS 4
+#endif
+
+static uint64_t splitmix64(uint64_t * x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void xoshiro_seed(xoshiro256 * rng, uint64_t seed)
+{
+    for(int i = 0; i < 4; i++)
+        rng->s[i] = splitmix64(&seed);
+}
+
+static void jump_by(xoshiro256 * rng, const uint64_t poly[4])
+{
+    uint64_t s[4] = { 0 };
+    for(int i = 0; i < 4; i++)
+    {
+        for(int b = 0; b < 64; b++)
+        {
+            if(poly[i] & (1ULL << b))
+                for(int k = 0; k < 4; k++)
+                    s[k] ^= rng->s[k];
+            xoshiro_next(rng);
+        }
+    }
+    memcpy(rng->s, s, sizeof(s));
+}
+
+void xoshiro_jump(xoshiro256 * rng)
+{
+    static const uint64_t jump[4] = {
+        0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+        0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+    };
+    jump_by(rng, jump);
+}
+
+void xoshiro_long_jump(xoshiro256 * rng)
+{
+    static const uint64_t long_jump[4] = {
+        0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL,
+        0x77710069854ee241ULL, 0x39109bb02acbe635ULL
+    };
+    jump_by(rng, long_jump);
+}
+
+void xoshiro_stream(xoshiro256 * rng, uint64_t seed, unsigned index)
+{
+    xoshiro_seed(rng, seed);
+    for(unsigned i = 0; i < index; i++)
+        xoshiro_jump(rng);
+}
+
+void xoshiro_x4_init(xoshiro256x4 * rng4, xoshiro256 * rng)
+{
+    for(int lane = 0; lane < 4; lane++)
+    {
+        for(int w = 0; w < 4; w++)
+            rng4->s[w][lane] = rng->s[w];
+        xoshiro_jump(rng);
+    }
+}
+
+/* 52 random bits as a double in [0, 1) */
+static inline double bits_to_double(uint64_t x)
+{
+    uint64_t bits = (x >> 12) | 0x3ff0000000000000ULL;
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d - 1.0;
+}
+
+static void fill_scalar(xoshiro256x4 * rng4, uint64_t * out, double * dout,
+        size_t n)
+{
+    xoshiro256 lanes[4];
+    for(int lane = 0; lane < 4; lane++)
+        for(int w = 0; w < 4; w++)
+            lanes[lane].s[w] = rng4->s[w][lane];
+
+    for(size_t i = 0; i < n; i += 4)
+    {
+        for(int lane = 0; lane < 4; lane++)
+        {
+            uint64_t x = xoshiro_next(&lanes[lane]);
+            if(i + lane >= n)
+                continue;
+            if(out != NULL)
+                out[i + lane] = x;
+            else
+                dout[i + lane] = bits_to_double(x);
+        }
+    }
+
+    for(int lane = 0; lane < 4; lane++)
+        for(int w = 0; w < 4; w++)
+            rng4->s[w][lane] = lanes[lane].s[w];
+}
+
+#ifdef __x86_64__
+#define PRNG_TARGET __attribute__((target("avx2")))
+
+static inline PRNG_TARGET __m256i rotl_epi64(__m256i x, int k)
+{
+    return _mm256_or_si256(_mm256_slli_epi64(x, k),
+                           _mm256_srli_epi64(x, 64 - k));
+}
+
+/* the same steps as xoshiro_next, a lane per generator. The multiplies by 5
+ * and 9 become a shift and an add, AVX2 has no 64 bit multiply */
+static PRNG_TARGET void fill_avx2(xoshiro256x4 * rng4, uint64_t * out,
+        double * dout, size_t n)
+{
+    __m256i s0 = _mm256_loadu_si256((__m256i *)rng4->s[0]);
+    __m256i s1 = _mm256_loadu_si256((__m256i *)rng4->s[1]);
+    __m256i s2 = _mm256_loadu_si256((__m256i *)rng4->s[2]);
+    __m256i s3 = _mm256_loadu_si256((__m256i *)rng4->s[3]);
+    __m256i one_bits = _mm256_set1_epi64x(0x3ff0000000000000LL);
+    __m256d one = _mm256_set1_pd(1.0);
+
+    for(size_t i = 0; i < n; i += 4)
+    {
+        __m256i x5 = _mm256_add_epi64(_mm256_slli_epi64(s1, 2), s1);
+        __m256i r = rotl_epi64(x5, 7);
+        __m256i result = _mm256_add_epi64(_mm256_slli_epi64(r, 3), r);
+        __m256i t = _mm256_slli_epi64(s1, 17);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = rotl_epi64(s3, 45);
+
+        if(out != NULL)
+        {
+            if(i + 4 <= n)
+                _mm256_storeu_si256((__m256i *)(out + i), result);
+            else
+            {
+                uint64_t last[4];
+                _mm256_storeu_si256((__m256i *)last, result);
+                memcpy(out + i, last, (n - i) * sizeof(uint64_t));
+            }
+        }
+        else
+        {
+            __m256i bits = _mm256_or_si256(_mm256_srli_epi64(result, 12),
+                                           one_bits);
+            __m256d d = _mm256_sub_pd(_mm256_castsi256_pd(bits), one);
+            if(i + 4 <= n)
+                _mm256_storeu_pd(dout + i, d);
+            else
+            {
+                double last[4];
+                _mm256_storeu_pd(last, d);
+                memcpy(dout + i, last, (n - i) * sizeof(double));
+            }
+        }
+    }
+
+    _mm256_storeu_si256((__m256i *)rng4->s[0], s0);
+    _mm256_storeu_si256((__m256i *)rng4->s[1], s1);
+    _mm256_storeu_si256((__m256i *)rng4->s[2], s2);
+    _mm256_storeu_si256((__m256i *)rng4->s[3], s3);
+}
+
+/* libgcc fills in the CPU model before main, no lazy check to race on */
+static int have_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+#endif /* __x86_64__ */
+
+static void fill(xoshiro256x4 * rng4, uint64_t * out, double * dout, size_t n)
+{
+#ifdef __x86_64__
+    if(have_avx2())
+    {
+        fill_avx2(rng4, out, dout, n);
+        return;
+    }
+#endif
+    fill_scalar(rng4, out, dout, n);
+}
+
+void xoshiro_fill_u64(xoshiro256x4 * rng4, uint64_t * out, size_t n)
+{
+    fill(rng4, out, NULL, n);
+}
+
+void xoshiro_fill_double(xoshiro256x4 * rng4, double * out, size_t n)
+{
+    fill(rng4, NULL, out, n);
+}
+
+void pcg32_seed(pcg32 * rng, uint64_t seed, uint64_t stream)
+{
+    rng->state = 0;
+    rng->inc = (stream << 1) | 1;
+    pcg32_next(rng);
+    rng->state += seed;
+    pcg32_next(rng);
+}
+
+/* Brown, "Random Number Generation with Arbitrary Stride": square the step
+ * (multiplier and increment together) once per bit of delta */
+void pcg32_advance(pcg32 * rng, uint64_t delta)
+{
+    uint64_t cur_mult = 6364136223846793005ULL;
+    uint64_t cur_plus = rng->inc;
+    uint64_t acc_mult = 1;
+    uint64_t acc_plus = 0;
+    while(delta > 0)
+    {
+        if(delta & 1)
+        {
+            acc_mult *= cur_mult;
+            acc_plus = acc_plus * cur_mult + cur_plus;
+        }
+        cur_plus = (cur_mult + 1) * cur_plus;
+        cur_mult *= cur_mult;
+        delta >>= 1;
+    }
+    rng->state = acc_mult * rng->state + acc_plus;
+}
+
+int xoshiro_srand48_r(long seedval, xoshiro256 * buffer)
+{
+    xoshiro_seed(buffer, (uint64_t)seedval);
+    return 0;
+}
+
+int xoshiro_drand48_r(xoshiro256 * buffer, double * result)
+{
+    *result = xoshiro_next_double(buffer);
+    return 0;
+}
+
+int xoshiro_lrand48_r(xoshiro256 * buffer, long * result)
+{
+    *result = (long)(xoshiro_next(buffer) >> 33);
+    return 0;
+}
+
+int xoshiro_mrand48_r(xoshiro256 * buffer, long * result)
+{
+    *result = (long)(int32_t)(xoshiro_next(buffer) >> 32);
+    return 0;
+}
+
+/* each way of filling an array with doubles on [0, 1) */
+typedef enum _prng_kind {
+    PRNG_DRAND48,
+    PRNG_DRAND48_LOCKED,    /* the only safe way to share drand48's state */
+    PRNG_DRAND48_R,
+    PRNG_RANDOM_R,
+    PRNG_RAND_R,
+    PRNG_PCG32,
+    PRNG_XOSHIRO,
+    PRNG_XOSHIRO_FILL,
+    PRNG_NUM_KINDS
+} prng_kind;
+
+static const char * const prng_kind_names[PRNG_NUM_KINDS] = {
+    "drand48", "drand48 + mutex", "drand48_r", "random_r", "rand_r",
+    "pcg32_next", "xoshiro_next_double", "xoshiro_fill_double"
+};
+
+static pthread_mutex_t drand48_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void generate(prng_kind kind, double * out, size_t n, unsigned index)
+{
+    switch(kind)
+    {
+        case PRNG_DRAND48:
+            for(size_t i = 0; i < n; i++)
+                out[i] = drand48();
+            break;
+        case PRNG_DRAND48_LOCKED:
+            for(size_t i = 0; i < n; i++)
+            {
+                pthread_mutex_lock(&drand48_lock);
+                out[i] = drand48();
+                pthread_mutex_unlock(&drand48_lock);
+            }
+            break;
+        case PRNG_DRAND48_R:
+        {
+            struct drand48_data data;
+            srand48_r(index + 1, &data);
+            for(size_t i = 0; i < n; i++)
+                drand48_r(&data, &out[i]);
+            break;
+        }
+        case PRNG_RANDOM_R:
+        {
+            struct random_data data = { 0 };
+            char state[64];
+            initstate_r(index + 1, state, sizeof(state), &data);
+            for(size_t i = 0; i < n; i++)
+            {
+                int32_t r;
+                random_r(&data, &r);
+                out[i] = r * 0x1.0p-31;
+            }
+            break;
+        }
+        case PRNG_RAND_R:
+        {
+            unsigned seed = index + 1;
+            for(size_t i = 0; i < n; i++)
+                out[i] = rand_r(&seed) / ((double)RAND_MAX + 1.0);
+            break;
+        }
+        case PRNG_PCG32:
+        {
+            pcg32 rng;
+            pcg32_seed(&rng, 42, index);
+            for(size_t i = 0; i < n; i++)
+                out[i] = pcg32_next(&rng) * 0x1.0p-32;
+            break;
+        }
+        case PRNG_XOSHIRO:
+        {
+            xoshiro256 rng;
+            xoshiro_stream(&rng, 42, index);
+            for(size_t i = 0; i < n; i++)
+                out[i] = xoshiro_next_double(&rng);
+            break;
+        }
+        case PRNG_XOSHIRO_FILL:
+        {
+            xoshiro256 rng;
+            xoshiro256x4 rng4;
+            xoshiro_stream(&rng, 42, 4 * index);
+            xoshiro_x4_init(&rng4, &rng);
+            xoshiro_fill_double(&rng4, out, n);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+typedef struct _prng_worker {
+    pthread_t thread;
+    prng_kind kind;
+    double * out;
+    size_t n;
+    unsigned index;
+} prng_worker;
+
+static void * prng_worker_run(void * arg)
+{
+    prng_worker * w = arg;
+    generate(w->kind, w->out, w->n, w->index);
+    return NULL;
+}
+
+static void prng_benchmark(void)
+{
+    size_t n = PRNG_BENCH_LEN;
+    double * out = malloc(n * sizeof(double));
+    if(out == NULL)
+        error(EXIT_FAILURE, errno, "benchmark array allocation failed");
+
+    printf("%zu doubles, one thread:\n", n);
+    for(int kind = 0; kind < PRNG_NUM_KINDS; kind++)
+    {
+        struct timespec start = bench_now();
+        generate(kind, out, n, 0);
+        bench_print_throughput(prng_kind_names[kind], n * sizeof(double),
+                bench_elapsed(start, bench_now()));
+    }
+
+    /* plain drand48 from several threads would race on its hidden state,
+     * so here it only runs under the mutex, which is what sharing it
+     * really costs: every draw from every thread takes turns */
+    printf("%zu doubles, %d threads with a stream each:\n", n,
+            PRNG_BENCH_THREADS);
+    for(int kind = 0; kind < PRNG_NUM_KINDS; kind++)
+    {
+        if(kind == PRNG_DRAND48)
+            continue;
+        prng_worker workers[PRNG_BENCH_THREADS];
+        struct timespec start = bench_now();
+        for(int t = 0; t < PRNG_BENCH_THREADS; t++)
+        {
+            size_t begin = n * t / PRNG_BENCH_THREADS;
+            workers[t].kind = kind;
+            workers[t].out = out + begin;
+            workers[t].n = n * (t + 1) / PRNG_BENCH_THREADS - begin;
+            workers[t].index = t;
+            errno = pthread_create(&workers[t].thread, NULL, prng_worker_run,
+                                    &workers[t]);
+            if(errno != 0)
+                error(EXIT_FAILURE, errno, "pthread_create failed");
+        }
+        for(int t = 0; t < PRNG_BENCH_THREADS; t++)
+            pthread_join(workers[t].thread, NULL);
+        bench_print_throughput(prng_kind_names[kind], n * sizeof(double),
+                bench_elapsed(start, bench_now()));
+    }
+
+    free(out);
+}
+
+void prng_demo(void)
+{
+    xoshiro256 rng;
+    xoshiro_srand48_r(2024, &rng);
+    printf("xoshiro_drand48_r:");
+    for(int i = 0; i < 4; i++)
+    {
+        double d;
+        xoshiro_drand48_r(&rng, &d);
+        printf(" %.5f", d);
+    }
+    long l;
+    xoshiro_lrand48_r(&rng, &l);
+    printf(", lrand48 style %ld", l);
+    xoshiro_mrand48_r(&rng, &l);
+    printf(", mrand48 style %ld\n", l);
+
+    /* advancing pcg32 by 1000 lands where 1000 calls would */
+    pcg32 a;
+    pcg32 b;
+    pcg32_seed(&a, 42, 7);
+    b = a;
+    for(int i = 0; i < 1000; i++)
+        pcg32_next(&a);
+    pcg32_advance(&b, 1000);
+    printf("pcg32 after 1000 calls %08x, after pcg32_advance(1000) %08x\n",
+            pcg32_next(&a), pcg32_next(&b));
+
+    /* the AVX2 fill has to agree with the plain C one */
+    enum { CHECK_LEN = 1003 };
+    uint64_t fast[CHECK_LEN];
+    uint64_t slow[CHECK_LEN];
+    xoshiro256x4 rng4_fast;
+    xoshiro256x4 rng4_slow;
+    xoshiro_seed(&rng, 1);
+    xoshiro_x4_init(&rng4_fast, &rng);
+    rng4_slow = rng4_fast;
+    xoshiro_fill_u64(&rng4_fast, fast, CHECK_LEN);
+    fill_scalar(&rng4_slow, slow, NULL, CHECK_LEN);
+    double sum = 0.0;
+    double doubles[CHECK_LEN];
+    xoshiro_fill_double(&rng4_fast, doubles, CHECK_LEN);
+    for(int i = 0; i < CHECK_LEN; i++)
+        sum += doubles[i];
+    printf("xoshiro_fill_u64 vs plain C: %s, mean of %d doubles %.4f\n",
+            memcmp(fast, slow, sizeof(fast)) == 0 ? "match" : "DIFFER",
+            CHECK_LEN, sum / CHECK_LEN);
+
+    prng_benchmark();
+}
@@ -0,0 +1,98 @@
+#ifndef PRNG_H
+#define PRNG_H
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint64_t, uint32_t */
+
+/* xoshiro256** (Blackman & Vigna): 256 bits of state, period 2^256 - 1 */
+typedef struct _xoshiro256 {
+    uint64_t s[4];
+} xoshiro256;
+
+/* fills the state from seed with splitmix64, as the authors recommend, so
+ * any seed (even 0) gives a good starting state */
+void xoshiro_seed(xoshiro256 * rng, uint64_t seed);
+
+/* advance by 2^128 and 2^192 draws. Seeding once and jumping gives streams
+ * that are guaranteed not to overlap for 2^128 draws each */
+void xoshiro_jump(xoshiro256 * rng);
+void xoshiro_long_jump(xoshiro256 * rng);
+
+/* stream number index of seed: seeded, then jumped index times. Hand one to
+ * each thread */
+void xoshiro_stream(xoshiro256 * rng, uint64_t seed, unsigned index);
+
+static inline uint64_t xoshiro_rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t xoshiro_next(xoshiro256 * rng)
+{
+    uint64_t * s = rng->s;
+    uint64_t result = xoshiro_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = xoshiro_rotl(s[3], 45);
+    return result;
+}
+
+/* uniform on [0, 1) with all 53 bits of the mantissa random */
+static inline double xoshiro_next_double(xoshiro256 * rng)
+{
+    return (double)(xoshiro_next(rng) >> 11) * 0x1.0p-53;
+}
+
+/* four xoshiro256** generators run side by side for filling arrays, 4 lanes
+ * of an AVX2 register. s[word][lane] so each word loads as one vector */
+typedef struct _xoshiro256x4 {
+    uint64_t s[4][4];
+} xoshiro256x4;
+
+/* lane k starts where rng is after k jumps, and rng is left 4 jumps on so it
+ * can keep being used (or passed here again) without overlapping */
+void xoshiro_x4_init(xoshiro256x4 * rng4, xoshiro256 * rng);
+
+/* out[4 * i + k] comes from lane k. The output is the same with or without
+ * AVX2. A length that isn't a multiple of 4 throws the leftover draws of the
+ * last step away. The doubles are on [0, 1) with 52 random bits */
+void xoshiro_fill_u64(xoshiro256x4 * rng4, uint64_t * out, size_t n);
+void xoshiro_fill_double(xoshiro256x4 * rng4, double * out, size_t n);
+
+/* PCG32 (O'Neill): 64 bit LCG state with a permuted 32 bit output. Every odd
+ * increment is a different sequence, so stream picks one of 2^63 */
+typedef struct _pcg32 {
+    uint64_t state;
+    uint64_t inc;
+} pcg32;
+
+void pcg32_seed(pcg32 * rng, uint64_t seed, uint64_t stream);
+
+/* skip delta draws ahead in O(log delta), for splitting one sequence into
+ * consecutive blocks */
+void pcg32_advance(pcg32 * rng, uint64_t delta);
+
+static inline uint32_t pcg32_next(pcg32 * rng)
+{
+    uint64_t old = rng->state;
+    rng->state = old * 6364136223846793005ULL + rng->inc;
+    uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+    uint32_t rot = old >> 59;
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+/* drop in replacements for the *rand48_r family: same arguments and results
+ * (0 on success, [0, 1) doubles, [0, 2^31) and [-2^31, 2^31) longs), but the
+ * buffer is a xoshiro256 instead of a struct drand48_data */
+int xoshiro_srand48_r(long seedval, xoshiro256 * buffer);
+int xoshiro_drand48_r(xoshiro256 * buffer, double * result);
+int xoshiro_lrand48_r(xoshiro256 * buffer, long * result);
+int xoshiro_mrand48_r(xoshiro256 * buffer, long * result);
+
+void prng_demo(void);
+
+#endif /* PRNG_H */
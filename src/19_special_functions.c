@@ -0,0 +1,433 @@
+/* Section 19.6 continued -- special functions over arrays
+ *
+ * tgamma, lgamma, erf, erfc, j0 and j1 are some of the most expensive calls
+ * in libm: a rational approximation per subrange, and for the Bessel
+ * functions an asymptotic expansion with its own trig calls once x is big.
+ * When the same function gets called millions of times over a known range,
+ * a table is much cheaper: evaluate it once on an evenly spaced grid, then
+ * each call is a multiply to find the interval and a cubic through the four
+ * nearest points.
+ *
+ * The cubic through 4 evenly spaced points is off by at most
+ *      |t (t - 1) (t + 1) (t - 2)| / 24 * h^4 * max|f''''|
+ * for t the position inside the interval (0 to 1) and h the spacing. That
+ * peaks at t = 1/2, so when a table is built it gets checked against libm at
+ * the middle of every interval, and the worst of those (with some room for
+ * rounding) is its error bound.
+ *
+ * Building a table is (SF_TABLE_LEN + 3) calls to the slow function plus the
+ * check, so they are built on first use, and with sf_table_cache_dir the
+ * result goes to a file that later runs just mmap. A file written by a
+ * different SF_TABLE_LEN or range doesn't match the header and is rebuilt.
+ * It's written to a temporary name and renamed into place, so two processes
+ * building at once can't leave half a table behind.
+ *
+ * A table read back is trusted, max_error and all, so the cache has to be
+ * somewhere nobody else can write: the directory and the file both have to
+ * belong to us and not be writable by the group or others, or the cache is
+ * left alone and the tables live in memory only. That also means nobody else
+ * can truncate a file while it's mapped (which would be a SIGBUS). A shared
+ * /tmp fails that test, so the demo makes its own directory with mkdtemp and
+ * removes it again afterwards.
+ *
+ * The table is the same bits on every machine with the same libm, but it's
+ * in native byte order, so the cache is not something to share across
+ * architectures.
+ * */
+
+#include "19_special_functions.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf, snprintf */
+#include <stdlib.h>     /* malloc, free */
+#include <string.h>     /* memcmp, memcpy, strlen */
+#include <stdint.h>     /* uint32_t */
+#include <math.h>       /* tgamma, lgamma, erf, erfc, j0, j1 */
+#include <float.h>      /* DBL_EPSILON */
+#include <pthread.h>    /* mutexes */
+#include <fcntl.h>      /* open */
+#include <unistd.h>     /* write, close, unlink, rmdir, geteuid */
+#include <sys/mman.h>   /* mmap, munmap */
+#include <sys/stat.h>   /* fstat */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+
+/* number of points in the benchmark */
+#ifndef SF_BENCH_LEN
+#define SF_BENCH_LEN (1UL << 18)
+#endif
+
+/* where the demo makes its private cache directory */
+#ifndef SF_DEMO_CACHE_DIR
+#define SF_DEMO_CACHE_DIR "/tmp"
+#endif
+
+const char * const sf_func_names[SF_NUM_FUNCS] = {
+    "tgamma", "lgamma", "erf", "erfc", "j0", "j1"
+};
+
+/* the table covers [lo, hi). tgamma's range stops where it gets too big to
+ * be interesting, erf and erfc where they are 1 (or 0 and 2) to the last
+ * bit, and the Bessel functions at some arbitrary point of their wiggling */
+static const struct {
+    double (*fn)(double);
+    double lo;
+    double hi;
+} domains[SF_NUM_FUNCS] = {
+    [SF_TGAMMA] = { tgamma, 0.5,   8.0 },
+    [SF_LGAMMA] = { lgamma, 0.5,  20.0 },
+    [SF_ERF]    = { erf,   -6.0,   6.0 },
+    [SF_ERFC]   = { erfc,  -6.0,  27.0 },
+    [SF_J0]     = { j0,   -64.0,  64.0 },
+    [SF_J1]     = { j1,   -64.0,  64.0 },
+};
+
+/* the layout in memory and in the file: this header then len + 3 values,
+ * values[k] = f(lo + (k - 1) * h), so the cubic for interval i uses
+ * values[i] to values[i + 3] */
+typedef struct _sf_table {
+    char magic[8];
+    uint32_t func;
+    uint32_t len;
+    double lo;
+    double hi;
+    double max_error;
+    double values[];
+} sf_table;
+
+static const char sf_magic[8] = "SFTABLE";
+
+typedef struct _sf_slot {
+    sf_table * table;
+    size_t size;    /* bytes mapped, 0 when it was malloced */
+} sf_slot;
+
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+static sf_slot slots[SF_NUM_FUNCS];
+static char * cache_dir;
+
+static size_t table_size(uint32_t len)
+{
+    return sizeof(sf_table) + (len + 3) * sizeof(double);
+}
+
+/* the cubic through values[0..3] (at -1, 0, 1, 2), at t */
+static inline double cubic(const double * p, double t)
+{
+    double tm1 = t - 1.0;
+    double tm2 = t - 2.0;
+    double tp1 = t + 1.0;
+    return (-t * tm1 * tm2 * p[0] + t * tp1 * tm1 * p[3]) * (1.0 / 6)
+        + (tp1 * tm1 * tm2 * p[1] - tp1 * t * tm2 * p[2]) * 0.5;
+}
+
+static inline double interpolate(const sf_table * t, double inv_h, double x)
+{
+    double pos = (x - t->lo) * inv_h;
+    uint32_t i = (uint32_t)pos;
+    if(i >= t->len)     /* x just under hi rounded up */
+        i = t->len - 1;
+    return cubic(t->values + i, pos - i);
+}
+
+static double error_of(double got, double want)
+{
+    double scale = fabs(want) < 1.0 ? 1.0 : fabs(want);
+    return fabs(got - want) / scale;
+}
+
+static sf_table * build_table(sf_func f)
+{
+    uint32_t len = SF_TABLE_LEN;
+    sf_table * t = malloc(table_size(len));
+    if(t == NULL)
+        error(EXIT_FAILURE, errno, "special function table allocation failed");
+    memcpy(t->magic, sf_magic, sizeof(t->magic));
+    t->func = f;
+    t->len = len;
+    t->lo = domains[f].lo;
+    t->hi = domains[f].hi;
+
+    double h = (t->hi - t->lo) / len;
+    for(uint32_t k = 0; k < len + 3; k++)
+        t->values[k] = domains[f].fn(t->lo + ((double)k - 1.0) * h);
+
+    double max_error = 0.0;
+    double inv_h = 1.0 / h;
+    for(uint32_t i = 0; i < len; i++)
+    {
+        double x = t->lo + (i + 0.5) * h;
+        double e = error_of(interpolate(t, inv_h, x), domains[f].fn(x));
+        if(e > max_error)
+            max_error = e;
+    }
+    /* the fourth derivative isn't constant across an interval, so the middle
+     * is only nearly the worst point, and the values and the cubic are
+     * rounded too */
+    t->max_error = max_error * 1.25 + 8 * DBL_EPSILON;
+    return t;
+}
+
+static int table_matches(const sf_table * t, sf_func f, size_t size)
+{
+    return size == table_size(SF_TABLE_LEN)
+        && memcmp(t->magic, sf_magic, sizeof(t->magic)) == 0
+        && t->func == (uint32_t)f
+        && t->len == SF_TABLE_LEN
+        && t->lo == domains[f].lo
+        && t->hi == domains[f].hi;
+}
+
+/* ours, and nobody else can change it */
+static int owned_privately(const struct stat * st)
+{
+    return st->st_uid == geteuid() && (st->st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+/* a directory only we can put files in (or rename them around in) */
+static int dir_is_private(const char * dir)
+{
+    struct stat st;
+    return stat(dir, &st) == 0 && S_ISDIR(st.st_mode) && owned_privately(&st);
+}
+
+/* dir/libc_notes_<func>.sftable, malloced */
+static char * cache_path(const char * dir, sf_func f)
+{
+    size_t path_len = strlen(dir) + strlen(sf_func_names[f])
+                        + sizeof("/libc_notes_.sftable");
+    char * path = malloc(path_len);
+    if(path == NULL)
+        error(EXIT_FAILURE, errno, "cache path allocation failed");
+    snprintf(path, path_len, "%s/libc_notes_%s.sftable", dir,
+            sf_func_names[f]);
+    return path;
+}
+
+/* map an existing cache file, NULL if there isn't a good one */
+static sf_table * map_table(const char * path, sf_func f, size_t * size)
+{
+    int fd = open(path, O_RDONLY | O_NOFOLLOW);
+    if(fd < 0)
+        return NULL;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || !owned_privately(&st)
+            || (size_t)st.st_size != table_size(SF_TABLE_LEN))
+    {
+        close(fd);
+        return NULL;
+    }
+    sf_table * t = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(t == MAP_FAILED)
+        return NULL;
+    if(!table_matches(t, f, st.st_size))
+    {
+        munmap(t, st.st_size);
+        return NULL;
+    }
+    *size = st.st_size;
+    return t;
+}
+
+/* failing to write the cache isn't fatal, the table still works from
+ * memory */
+static void write_table(const char * path, const sf_table * t)
+{
+    size_t path_len = strlen(path);
+    char * tmp = malloc(path_len + sizeof(".XXXXXX"));
+    if(tmp == NULL)
+        error(EXIT_FAILURE, errno, "cache path allocation failed");
+    memcpy(tmp, path, path_len);
+    memcpy(tmp + path_len, ".XXXXXX", sizeof(".XXXXXX"));
+
+    int fd = mkstemp(tmp);
+    if(fd < 0)
+    {
+        free(tmp);
+        return;
+    }
+    const char * p = (const char *)t;
+    size_t left = table_size(t->len);
+    while(left > 0)
+    {
+        ssize_t n = write(fd, p, left);
+        if(n < 0)
+            break;
+        p += n;
+        left -= n;
+    }
+    if(close(fd) != 0 || left > 0 || rename(tmp, path) != 0)
+        unlink(tmp);
+    free(tmp);
+}
+
+/* the table for f, from the slot, the cache file, or built from scratch */
+static const sf_table * get_table(sf_func f)
+{
+    pthread_mutex_lock(&tables_lock);
+    if(slots[f].table == NULL)
+    {
+        char * path = NULL;
+        if(cache_dir != NULL && dir_is_private(cache_dir))
+        {
+            path = cache_path(cache_dir, f);
+            slots[f].table = map_table(path, f, &slots[f].size);
+        }
+        if(slots[f].table == NULL)
+        {
+            slots[f].table = build_table(f);
+            slots[f].size = 0;
+            if(path != NULL)
+                write_table(path, slots[f].table);
+        }
+        free(path);
+    }
+    const sf_table * t = slots[f].table;
+    pthread_mutex_unlock(&tables_lock);
+    return t;
+}
+
+void sf_table_cache_dir(const char * dir)
+{
+    pthread_mutex_lock(&tables_lock);
+    free(cache_dir);
+    cache_dir = NULL;
+    if(dir != NULL && (cache_dir = strdup(dir)) == NULL)
+        error(EXIT_FAILURE, errno, "strdup failed");
+    pthread_mutex_unlock(&tables_lock);
+}
+
+double sf_table_error(sf_func f)
+{
+    return get_table(f)->max_error;
+}
+
+void sf_tables_release(void)
+{
+    pthread_mutex_lock(&tables_lock);
+    for(int f = 0; f < SF_NUM_FUNCS; f++)
+    {
+        if(slots[f].size != 0)
+            munmap(slots[f].table, slots[f].size);
+        else
+            free(slots[f].table);
+        slots[f].table = NULL;
+        slots[f].size = 0;
+    }
+    pthread_mutex_unlock(&tables_lock);
+}
+
+void sf_eval(sf_func f, double * dst, const double * src, size_t n)
+{
+    double (*fn)(double) = domains[f].fn;
+    for(size_t i = 0; i < n; i++)
+        dst[i] = fn(src[i]);
+}
+
+void sf_eval_table(sf_func f, double * dst, const double * src, size_t n)
+{
+    const sf_table * t = get_table(f);
+    double (*fn)(double) = domains[f].fn;
+    double lo = t->lo;
+    double hi = t->hi;
+    double inv_h = t->len / (hi - lo);
+    for(size_t i = 0; i < n; i++)
+    {
+        double x = src[i];
+        /* written so NaN fails it too */
+        dst[i] = x >= lo && x < hi ? interpolate(t, inv_h, x) : fn(x);
+    }
+}
+
+void sf_demo(void)
+{
+    /* a fresh directory of our own, so first use is always a build and
+     * write, then the same table again from the file */
+    char dir[] = SF_DEMO_CACHE_DIR "/libc_notes_sf.XXXXXX";
+    int have_dir = mkdtemp(dir) != NULL;
+    sf_tables_release();
+    sf_table_cache_dir(have_dir ? dir : NULL);
+    printf("tables of %u intervals, cached in %s:\n", SF_TABLE_LEN,
+            have_dir ? dir : "memory only, mkdtemp failed");
+    for(int f = 0; f < SF_NUM_FUNCS; f++)
+    {
+        struct timespec start = bench_now();
+        double bound = sf_table_error(f);
+        double first = bench_elapsed(start, bench_now());
+        sf_tables_release();
+        start = bench_now();
+        sf_table_error(f);
+        double again = bench_elapsed(start, bench_now());
+        printf("\t%-6s [%5g, %5g) error bound %.2e, "
+                "first use %8.3f ms, from the file %6.3f ms\n",
+                sf_func_names[f], domains[f].lo, domains[f].hi, bound,
+                first * 1e3, again * 1e3);
+    }
+
+    size_t n = SF_BENCH_LEN;
+    double * xs = malloc(n * sizeof(double));
+    double * want = malloc(n * sizeof(double));
+    double * got = malloc(n * sizeof(double));
+    if(xs == NULL || want == NULL || got == NULL)
+        error(EXIT_FAILURE, errno, "benchmark array allocation failed");
+
+    printf("%zu random points in each range:\n", n);
+    printf("\t%-6s %10s %10s %8s %10s\n",
+            "func", "libm ns", "table ns", "speedup", "max err");
+    unsigned long state = 1;
+    for(int f = 0; f < SF_NUM_FUNCS; f++)
+    {
+        double lo = domains[f].lo;
+        double hi = domains[f].hi;
+        for(size_t i = 0; i < n; i++)
+        {
+            state = state * 6364136223846793005UL + 1442695040888963407UL;
+            xs[i] = lo + (hi - lo) * (double)(state >> 11) * 0x1.0p-53;
+        }
+
+        struct timespec start = bench_now();
+        sf_eval(f, want, xs, n);
+        double libm_seconds = bench_elapsed(start, bench_now());
+        start = bench_now();
+        sf_eval_table(f, got, xs, n);
+        double table_seconds = bench_elapsed(start, bench_now());
+
+        double max_error = 0.0;
+        for(size_t i = 0; i < n; i++)
+        {
+            double e = error_of(got[i], want[i]);
+            if(e > max_error)
+                max_error = e;
+        }
+        printf("\t%-6s %10.2f %10.2f %7.1fx %10.2e%s\n", sf_func_names[f],
+                libm_seconds * 1e9 / n, table_seconds * 1e9 / n,
+                libm_seconds / table_seconds, max_error,
+                max_error > sf_table_error(f) ? " over the bound" : "");
+    }
+
+    /* outside the range it's libm's answer, special cases and all */
+    double edges[4] = { -1.0, 0.0, 200.0, NAN };
+    double out[4];
+    sf_eval_table(SF_TGAMMA, out, edges, 4);
+    printf("table tgamma of -1, 0, 200, nan: %g %g %g %g\n",
+            out[0], out[1], out[2], out[3]);
+
+    free(got);
+    free(want);
+    free(xs);
+    sf_tables_release();
+    sf_table_cache_dir(NULL);
+
+    /* the tables are only for this run, don't leave them behind */
+    if(have_dir)
+    {
+        for(int f = 0; f < SF_NUM_FUNCS; f++)
+        {
+            char * path = cache_path(dir, f);
+            unlink(path);
+            free(path);
+        }
+        rmdir(dir);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef SPECIAL_FUNCTIONS_H
+#define SPECIAL_FUNCTIONS_H
+
+#include <stddef.h> /* size_t */
+
+typedef enum _sf_func {
+    SF_TGAMMA,
+    SF_LGAMMA,
+    SF_ERF,
+    SF_ERFC,
+    SF_J0,
+    SF_J1,
+    SF_NUM_FUNCS
+} sf_func;
+
+extern const char * const sf_func_names[SF_NUM_FUNCS];
+
+/* intervals per table. The cubic's error shrinks with the 4th power of the
+ * spacing, so halving the table costs 16 times the error */
+#ifndef SF_TABLE_LEN
+#define SF_TABLE_LEN (1U << 15)
+#endif
+
+/* dst[i] = f(src[i]) with a libm call per element */
+void sf_eval(sf_func f, double * dst, const double * src, size_t n);
+
+/* the same by cubic interpolation in a table of f, built the first time f is
+ * used. Anything outside the table's range (and NaN) goes to libm, so the
+ * special cases are the same as sf_eval's. dst and src may be the same */
+void sf_eval_table(sf_func f, double * dst, const double * src, size_t n);
+
+/* where the tables are kept between runs. A table is read from (or written
+ * to, after building it) dir/libc_notes_<func>.sftable and mmapped from
+ * there. dir and the files have to be ours and not writable by anyone else,
+ * or they're ignored. NULL, the default, keeps them in memory only. Only
+ * affects tables that haven't been built yet */
+void sf_table_cache_dir(const char * dir);
+
+/* largest error of f's table, absolute where |f| < 1 and relative above,
+ * measured at the middle of every interval when it was built (that's where
+ * the cubic is furthest off) plus a margin for rounding. Builds the table
+ * if need be */
+double sf_table_error(sf_func f);
+
+/* free or unmap every table, the next use builds or loads them again */
+void sf_tables_release(void);
+
+void sf_demo(void);
+
+#endif /* SPECIAL_FUNCTIONS_H */
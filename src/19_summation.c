@@ -0,0 +1,522 @@
+/* Section 19 continued -- adding up a lot of doubles
+ *
+ * Every floating point addition rounds, and a plain loop piles up those
+ * roundings: the error bound grows with the number of terms, and when the
+ * terms cancel (big positive and negative values that leave a small total)
+ * the relative error of the result can be anything at all. The usual fixes:
+ *
+ *      - pairwise: add the halves separately and then add those, recursively.
+ *        Each term goes through log2(n) additions instead of up to n. Below
+ *        a block size the halves are summed plainly, so it costs about the
+ *        same as the plain loop
+ *      - Kahan (compensated) summation: keep a second variable with the low
+ *        order bits the last addition rounded away, and feed them back in:
+ *              y = x - c; t = s + y; c = (t - s) - y; s = t;
+ *        The error no longer depends on n at all
+ *      - Neumaier's version of that computes the rounding error of s + x
+ *        exactly whichever of the two is larger (Kahan's assumes |s| >= |x|)
+ *        and adds all of them up separately at the end
+ *      - long double: on x86 that's the x87 80 bit format with 64 bits of
+ *        mantissa, 11 more than double, but the x87 can't be vectorized
+ *
+ * For the dot product an fma gets the exact rounding error of each product
+ * too (fma(a, b, -a*b)), and adding those into the compensation is Ogita,
+ * Rump and Oishi's Dot2, which is as if it were computed in twice the
+ * precision.
+ *
+ * All but long double run 4 lanes at a time with AVX2 (each lane its own
+ * running sum and compensation, combined at the end), and all of them split
+ * across threads by handing each thread a slice and combining the slices'
+ * totals and compensations at the end.
+ *
+ * None of the compiler's reassociation is allowed here: -ffast-math would
+ * happily optimize (t - s) - y to 0 and turn Kahan back into the plain loop.
+ * */
+
+#include "19_summation.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* malloc, free */
+#include <stdint.h>     /* INT64_MAX */
+#include <math.h>       /* fabs, fma */
+#include <pthread.h>    /* pthread_create, pthread_join */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+#ifdef __x86_64__
+#include <immintrin.h>  /* AVX2 and FMA intrinsics */
+#endif
+
+/* pairwise stops splitting at this many terms */
+#ifndef SUM_PAIRWISE_BLOCK
+#define SUM_PAIRWISE_BLOCK 256
+#endif
+
+/* benchmark length and threads */
+#ifndef SUM_BENCH_LEN
+#define SUM_BENCH_LEN (1UL << 22)
+#endif
+#ifndef SUM_BENCH_THREADS
+#define SUM_BENCH_THREADS 4
+#endif
+
+const char * const sum_mode_names[SUM_NUM_MODES] = {
+    "naive", "pairwise", "kahan", "neumaier", "long double"
+};
+
+/* a total and whatever is still to be added to it */
+typedef struct _sum_parts {
+    double hi;
+    double lo;
+} sum_parts;
+
+/* Shewchuk's non-overlapping partials. Their exact sum is the exact sum of
+ * everything added, and with doubles there can't be more than about 40 */
+typedef struct _fsum_acc {
+    double p[64];
+    int n;
+} fsum_acc;
+
+static void fsum_add(fsum_acc * acc, double x)
+{
+    int i = 0;
+    for(int j = 0; j < acc->n; j++)
+    {
+        double y = acc->p[j];
+        if(fabs(x) < fabs(y))
+        {
+            double t = x;
+            x = y;
+            y = t;
+        }
+        double hi = x + y;
+        double lo = y - (hi - x);
+        if(lo != 0.0)
+            acc->p[i++] = lo;
+        x = hi;
+    }
+    acc->p[i] = x;
+    acc->n = i + 1;
+}
+
+static double fsum_result(const fsum_acc * acc)
+{
+    int n = acc->n;
+    double hi = 0.0;
+    double lo = 0.0;
+    if(n > 0)
+    {
+        hi = acc->p[--n];
+        while(n > 0)
+        {
+            double x = hi;
+            double y = acc->p[--n];
+            hi = x + y;
+            lo = y - (hi - x);
+            if(lo != 0.0)
+                break;
+        }
+        /* round half to even across the partials that are left */
+        if(n > 0 && ((lo < 0.0 && acc->p[n - 1] < 0.0)
+                    || (lo > 0.0 && acc->p[n - 1] > 0.0)))
+        {
+            double y = lo * 2.0;
+            double x = hi + y;
+            if(y == x - hi)
+                hi = x;
+        }
+    }
+    return hi;
+}
+
+double sum_exact(const double * x, size_t n)
+{
+    fsum_acc acc = { .n = 0 };
+    for(size_t i = 0; i < n; i++)
+        fsum_add(&acc, x[i]);
+    return fsum_result(&acc);
+}
+
+/* exactly rounded dot product, each product split into two doubles */
+static double dot_exact(const double * x, const double * y, size_t n)
+{
+    fsum_acc acc = { .n = 0 };
+    for(size_t i = 0; i < n; i++)
+    {
+        double p = x[i] * y[i];
+        fsum_add(&acc, p);
+        fsum_add(&acc, fma(x[i], y[i], -p));
+    }
+    return fsum_result(&acc);
+}
+
+/* the plain C versions, y is NULL for a sum */
+static sum_parts kernel_scalar(sum_mode mode, const double * x,
+        const double * y, size_t n)
+{
+    sum_parts r = { 0.0, 0.0 };
+    double s = 0.0;
+    double c = 0.0;
+
+    switch(mode)
+    {
+        case SUM_NAIVE:
+        case SUM_PAIRWISE:
+            for(size_t i = 0; i < n; i++)
+                s += y ? x[i] * y[i] : x[i];
+            r.hi = s;
+            break;
+        case SUM_KAHAN:
+            for(size_t i = 0; i < n; i++)
+            {
+                double v = (y ? x[i] * y[i] : x[i]) - c;
+                double t = s + v;
+                c = (t - s) - v;
+                s = t;
+            }
+            r.hi = s;
+            r.lo = -c;
+            break;
+        case SUM_NEUMAIER:
+            for(size_t i = 0; i < n; i++)
+            {
+                double v = y ? x[i] * y[i] : x[i];
+                if(y)
+                    c += fma(x[i], y[i], -v);
+                double t = s + v;
+                c += fabs(s) >= fabs(v) ? (s - t) + v : (v - t) + s;
+                s = t;
+            }
+            r.hi = s;
+            r.lo = c;
+            break;
+        case SUM_LONG_DOUBLE:
+        {
+            long double ls = 0.0L;
+            for(size_t i = 0; i < n; i++)
+                ls += y ? (long double)x[i] * y[i] : x[i];
+            r.hi = (double)ls;
+            r.lo = (double)(ls - r.hi);
+            break;
+        }
+        default:
+            break;
+    }
+    return r;
+}
+
+#ifdef __x86_64__
+#define SUM_TARGET __attribute__((target("avx2,fma")))
+
+/* add up 4 lanes of totals and compensations without losing anything */
+static SUM_TARGET sum_parts reduce_lanes(__m256d s, __m256d c)
+{
+    double lanes[8];
+    _mm256_storeu_pd(lanes, s);
+    _mm256_storeu_pd(lanes + 4, c);
+    sum_parts r = { 0.0, 0.0 };
+    for(int i = 0; i < 8; i++)
+    {
+        double t = r.hi + lanes[i];
+        r.lo += fabs(r.hi) >= fabs(lanes[i]) ? (r.hi - t) + lanes[i]
+                                             : (lanes[i] - t) + r.hi;
+        r.hi = t;
+    }
+    return r;
+}
+
+static SUM_TARGET sum_parts kernel_avx2(sum_mode mode, const double * x,
+        const double * y, size_t n)
+{
+    __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(INT64_MAX));
+    __m256d s = _mm256_setzero_pd();
+    __m256d s2 = _mm256_setzero_pd();
+    __m256d c = _mm256_setzero_pd();
+    size_t i = 0;
+
+    switch(mode)
+    {
+        case SUM_NAIVE:
+        case SUM_PAIRWISE:
+            /* two accumulators so consecutive adds don't wait on each other */
+            for(; i + 8 <= n; i += 8)
+            {
+                __m256d a = _mm256_loadu_pd(x + i);
+                __m256d b = _mm256_loadu_pd(x + i + 4);
+                if(y)
+                {
+                    s = _mm256_fmadd_pd(a, _mm256_loadu_pd(y + i), s);
+                    s2 = _mm256_fmadd_pd(b, _mm256_loadu_pd(y + i + 4), s2);
+                }
+                else
+                {
+                    s = _mm256_add_pd(s, a);
+                    s2 = _mm256_add_pd(s2, b);
+                }
+            }
+            s = _mm256_add_pd(s, s2);
+            break;
+        case SUM_KAHAN:
+            for(; i + 4 <= n; i += 4)
+            {
+                __m256d v = _mm256_loadu_pd(x + i);
+                if(y)
+                    v = _mm256_mul_pd(v, _mm256_loadu_pd(y + i));
+                v = _mm256_sub_pd(v, c);
+                __m256d t = _mm256_add_pd(s, v);
+                c = _mm256_sub_pd(_mm256_sub_pd(t, s), v);
+                s = t;
+            }
+            c = _mm256_sub_pd(_mm256_setzero_pd(), c);
+            break;
+        case SUM_NEUMAIER:
+            for(; i + 4 <= n; i += 4)
+            {
+                __m256d v = _mm256_loadu_pd(x + i);
+                if(y)
+                {
+                    __m256d b = _mm256_loadu_pd(y + i);
+                    __m256d p = _mm256_mul_pd(v, b);
+                    c = _mm256_add_pd(c, _mm256_fmsub_pd(v, b, p));
+                    v = p;
+                }
+                __m256d t = _mm256_add_pd(s, v);
+                __m256d s_bigger = _mm256_cmp_pd(_mm256_and_pd(s, abs_mask),
+                                                 _mm256_and_pd(v, abs_mask),
+                                                 _CMP_GE_OQ);
+                __m256d big = _mm256_blendv_pd(v, s, s_bigger);
+                __m256d small = _mm256_blendv_pd(s, v, s_bigger);
+                c = _mm256_add_pd(c, _mm256_add_pd(_mm256_sub_pd(big, t),
+                                                   small));
+                s = t;
+            }
+            break;
+        default:
+            return kernel_scalar(mode, x, y, n);
+    }
+
+    sum_parts r = reduce_lanes(s, c);
+    /* and the last few the same way */
+    sum_parts tail = kernel_scalar(mode, x + i, y ? y + i : NULL, n - i);
+    double t = r.hi + tail.hi;
+    r.lo += (fabs(r.hi) >= fabs(tail.hi) ? (r.hi - t) + tail.hi
+                                         : (tail.hi - t) + r.hi) + tail.lo;
+    r.hi = t;
+    if(mode == SUM_NAIVE || mode == SUM_PAIRWISE)
+    {
+        /* the lanes were combined carefully, don't pretend that's naive */
+        r.hi += r.lo;
+        r.lo = 0.0;
+    }
+    return r;
+}
+
+/* libgcc fills in the CPU model before main, so asking is a load and a test
+ * with nothing to race on when several workers get here at once */
+static int have_avx2_fma(void)
+{
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+#endif /* __x86_64__ */
+
+static sum_parts kernel(sum_mode mode, const double * x, const double * y,
+        size_t n)
+{
+    if(mode == SUM_PAIRWISE && n > SUM_PAIRWISE_BLOCK)
+    {
+        /* split on a multiple of 8 so the vector loops have no tails */
+        size_t half = (n / 2 + 7) & ~(size_t)7;
+        sum_parts a = kernel(mode, x, y, half);
+        sum_parts b = kernel(mode, x + half, y ? y + half : NULL, n - half);
+        a.hi += b.hi;
+        return a;
+    }
+#ifdef __x86_64__
+    if(have_avx2_fma())
+        return kernel_avx2(mode, x, y, n);
+#endif
+    return kernel_scalar(mode, x, y, n);
+}
+
+/* totals from several slices. The plain modes just add, the rest keep
+ * what every slice still had to add */
+static double combine(sum_mode mode, const sum_parts * parts, int count)
+{
+    if(mode == SUM_NAIVE || mode == SUM_PAIRWISE)
+    {
+        double s = 0.0;
+        for(int i = 0; i < count; i++)
+            s += parts[i].hi;
+        return s;
+    }
+    if(mode == SUM_LONG_DOUBLE)
+    {
+        long double s = 0.0L;
+        for(int i = 0; i < count; i++)
+            s += (long double)parts[i].hi + parts[i].lo;
+        return (double)s;
+    }
+    double s = 0.0;
+    double c = 0.0;
+    for(int i = 0; i < count; i++)
+    {
+        double t = s + parts[i].hi;
+        c += fabs(s) >= fabs(parts[i].hi) ? (s - t) + parts[i].hi
+                                          : (parts[i].hi - t) + s;
+        s = t;
+        c += parts[i].lo;
+    }
+    return s + c;
+}
+
+double sum_array(sum_mode mode, const double * x, size_t n)
+{
+    sum_parts r = kernel(mode, x, NULL, n);
+    return combine(mode, &r, 1);
+}
+
+double dot_array(sum_mode mode, const double * x, const double * y, size_t n)
+{
+    sum_parts r = kernel(mode, x, y, n);
+    return combine(mode, &r, 1);
+}
+
+typedef struct _sum_worker {
+    pthread_t thread;
+    sum_mode mode;
+    const double * x;
+    const double * y;
+    size_t n;
+    sum_parts result;
+} sum_worker;
+
+static void * sum_worker_run(void * arg)
+{
+    sum_worker * w = arg;
+    w->result = kernel(w->mode, w->x, w->y, w->n);
+    return NULL;
+}
+
+static double run_threads(sum_mode mode, const double * x, const double * y,
+        size_t n, int nthreads)
+{
+    if(nthreads < 1)
+        nthreads = 1;
+    sum_worker * workers = malloc(nthreads * sizeof(sum_worker));
+    sum_parts * parts = malloc(nthreads * sizeof(sum_parts));
+    if(workers == NULL || parts == NULL)
+        error(EXIT_FAILURE, errno, "summation worker allocation failed");
+
+    for(int t = 0; t < nthreads; t++)
+    {
+        size_t begin = n * t / nthreads;
+        workers[t].mode = mode;
+        workers[t].x = x + begin;
+        workers[t].y = y ? y + begin : NULL;
+        workers[t].n = n * (t + 1) / nthreads - begin;
+        errno = pthread_create(&workers[t].thread, NULL, sum_worker_run,
+                                &workers[t]);
+        if(errno != 0)
+            error(EXIT_FAILURE, errno, "pthread_create failed");
+    }
+    for(int t = 0; t < nthreads; t++)
+    {
+        pthread_join(workers[t].thread, NULL);
+        parts[t] = workers[t].result;
+    }
+    double total = combine(mode, parts, nthreads);
+
+    free(parts);
+    free(workers);
+    return total;
+}
+
+double sum_array_mt(sum_mode mode, const double * x, size_t n, int nthreads)
+{
+    return run_threads(mode, x, NULL, n, nthreads);
+}
+
+double dot_array_mt(sum_mode mode, const double * x, const double * y,
+        size_t n, int nthreads)
+{
+    return run_threads(mode, x, y, n, nthreads);
+}
+
+static void summation_benchmark(void)
+{
+    size_t n = SUM_BENCH_LEN;
+    double * x = malloc(n * sizeof(double));
+    double * y = malloc(n * sizeof(double));
+    if(x == NULL || y == NULL)
+        error(EXIT_FAILURE, errno, "benchmark array allocation failed");
+
+    /* magnitudes from 1e-8 to 1e8 and both signs, so there's plenty of
+     * cancellation and the total is small next to the biggest terms */
+    unsigned long state = 1;
+    for(size_t i = 0; i < n; i++)
+    {
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        double mant = (double)(state >> 11) * 0x1.0p-53;
+        int exponent = (int)((state >> 3) % 17) - 8;
+        x[i] = ((state >> 2) & 1 ? mant : -mant) * pow(10.0, exponent);
+        y[i] = 1.0 + mant;
+    }
+    double exact_sum = sum_exact(x, n);
+    double exact_dot = dot_exact(x, y, n);
+    printf("%zu doubles from 1e-8 to 1e8 in magnitude, exact sum %.17g:\n",
+            n, exact_sum);
+
+    char label[48];
+    for(int pass = 0; pass < 4; pass++)
+    {
+        int dot = pass & 1;
+        int threads = pass < 2 ? 1 : SUM_BENCH_THREADS;
+        double exact = dot ? exact_dot : exact_sum;
+        for(int mode = 0; mode < SUM_NUM_MODES; mode++)
+        {
+            struct timespec start = bench_now();
+            double got = threads == 1 ?
+                    (dot ? dot_array(mode, x, y, n) : sum_array(mode, x, n)) :
+                    (dot ? dot_array_mt(mode, x, y, n, threads) :
+                           sum_array_mt(mode, x, n, threads));
+            double seconds = bench_elapsed(start, bench_now());
+            snprintf(label, sizeof(label), "%s %s, %d thread%s",
+                    dot ? "dot" : "sum", sum_mode_names[mode], threads,
+                    threads == 1 ? "" : "s");
+            printf("\t%-30s %9.1f MB/s  relative error %.2e\n", label,
+                    (dot ? 2.0 : 1.0) * n * sizeof(double)
+                        / (1024.0 * 1024.0) / seconds,
+                    fabs((got - exact) / exact));
+        }
+    }
+
+    free(y);
+    free(x);
+}
+
+void summation_demo(void)
+{
+    /* the classic: 1 + 1e100 - 1e100 should be 1 */
+    double tricky[] = { 1.0, 1e100, 1.0, -1e100 };
+    printf("1 + 1e100 + 1 - 1e100 (should be 2):");
+    for(int mode = 0; mode < SUM_NUM_MODES; mode++)
+        printf(" %s %g,", sum_mode_names[mode],
+                sum_array(mode, tricky, 4));
+    printf(" exact %g\n", sum_exact(tricky, 4));
+
+    /* and a long run of 0.1, which isn't exactly representable */
+    enum { TENTHS = 10000000 };
+    double * tenths = malloc(TENTHS * sizeof(double));
+    if(tenths == NULL)
+        error(EXIT_FAILURE, errno, "tenths allocation failed");
+    for(int i = 0; i < TENTHS; i++)
+        tenths[i] = 0.1;
+    printf("0.1 added 10^7 times:\n");
+    for(int mode = 0; mode < SUM_NUM_MODES; mode++)
+        printf("\t%-12s %.17g\n", sum_mode_names[mode],
+                sum_array(mode, tenths, TENTHS));
+    printf("\t%-12s %.17g\n", "exact", sum_exact(tenths, TENTHS));
+    free(tenths);
+
+    summation_benchmark();
+}
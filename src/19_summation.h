@@ -0,0 +1,42 @@
+#ifndef SUMMATION_H
+#define SUMMATION_H
+
+#include <stddef.h> /* size_t */
+
+/* how the running total is kept. Error bounds for n terms, with u = 2^-53:
+ *      naive           n * u * sum|x|
+ *      pairwise        log2(n) * u * sum|x|
+ *      kahan           2u * sum|x|, independent of n
+ *      neumaier        like kahan, and still right when a term is bigger
+ *                      than the running total
+ *      long_double     n * 2^-64 * sum|x|, the x87 80 bit format */
+typedef enum _sum_mode {
+    SUM_NAIVE,
+    SUM_PAIRWISE,
+    SUM_KAHAN,
+    SUM_NEUMAIER,
+    SUM_LONG_DOUBLE,
+    SUM_NUM_MODES
+} sum_mode;
+
+extern const char * const sum_mode_names[SUM_NUM_MODES];
+
+/* x[0] + ... + x[n - 1] and x[0] * y[0] + ... + x[n - 1] * y[n - 1]. The
+ * neumaier dot product also keeps the rounding error of each product (with
+ * an fma), which makes it as good as computing in twice the precision */
+double sum_array(sum_mode mode, const double * x, size_t n);
+double dot_array(sum_mode mode, const double * x, const double * y, size_t n);
+
+/* the same, split over nthreads threads. Each thread's total is handed back
+ * with its compensation, and they are combined without losing it */
+double sum_array_mt(sum_mode mode, const double * x, size_t n, int nthreads);
+double dot_array_mt(sum_mode mode, const double * x, const double * y,
+        size_t n, int nthreads);
+
+/* the exactly rounded sum (Shewchuk's algorithm, as in Python's math.fsum).
+ * Slow, it's the reference the others are checked against */
+double sum_exact(const double * x, size_t n);
+
+void summation_demo(void);
+
+#endif /* SUMMATION_H */
@@ -0,0 +1,463 @@
+/* Sections 19.2 - 19.5 continued -- math over whole arrays
+ *
+ * libm's sin, exp and friends are accurate and handle every special case, but
+ * they take one argument at a time, and a loop of calls can't be vectorized.
+ * The functions here do 4 doubles at a time with AVX2 and FMA, built out of
+ * the same pieces libm uses:
+ *
+ *      - range reduction: write x as n * C + r with r small, where C is ln 2
+ *        for exp (so e^x = 2^n * e^r and 2^n is just an exponent field) and
+ *        pi/2 for sin/cos (so n mod 4 picks which of +-sin r, +-cos r it is).
+ *        C is split into a high part with trailing zero bits, so n * C_hi is
+ *        exact, and low parts that mop up the rest (Cody & Waite)
+ *      - a polynomial for the small r: Taylor series for exp, and the
+ *        minimax coefficients from fdlibm (the ancestor of most libms) for
+ *        sin, cos and log
+ *      - log splits x into 2^k * m with m in [sqrt(1/2), sqrt(2)) by pulling
+ *        the exponent bits apart, then log(m) = log((1 + s) / (1 - s)) with
+ *        s = (m - 1) / (m + 1), which is an odd series in s
+ *      - tanh(x) = expm1(2x) / (expm1(2x) + 2), expm1 being e^x - 1 computed
+ *        without the cancellation that e^x - 1 would have near 0
+ *
+ * Anything outside the range the reduction is good for goes to libm, one
+ * group of 4 at a time, so the results there (NaN, inf, errno not being set,
+ * etc.) are whatever libm says.
+ *
+ * Error is measured in ULPs, units in the last place: the gap between the
+ * result and the true value, divided by the gap between adjacent doubles at
+ * that size. libm aims for under 1 ULP on these (tanh manages about 2).
+ * vm_benchmark measures both against sinl/expl/... in long double, which has
+ * 11 more bits. The extra error here mostly comes from the sin/cos reduction
+ * rounding r twice, and from the division in tanh.
+ * */
+
+#include "19_vector_math.h"
+#include "bench.h"
+
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* malloc, free */
+#include <math.h>       /* sin, cos, exp, log, tanh, nextafter, fabs */
+#include <float.h>      /* DBL_MIN, DBL_MAX */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+#ifdef __x86_64__
+#include <immintrin.h>  /* AVX2 and FMA intrinsics */
+#endif
+
+/* number of elements in the benchmark arrays */
+#ifndef VM_BENCH_LEN
+#define VM_BENCH_LEN (1UL << 20)
+#endif
+
+const char * const vm_func_names[VM_NUM_FUNCS] = {
+    "sin", "cos", "exp", "log", "tanh"
+};
+
+static double (* const libm_funcs[VM_NUM_FUNCS])(double) = {
+    sin, cos, exp, log, tanh
+};
+
+static float (* const libm_funcsf[VM_NUM_FUNCS])(float) = {
+    sinf, cosf, expf, logf, tanhf
+};
+
+static long double (* const libm_funcsl[VM_NUM_FUNCS])(long double) = {
+    sinl, cosl, expl, logl, tanhl
+};
+
+/* fdlibm's constants: ln 2 and pi/2 in pieces (the high parts have enough
+ * trailing zeros that n * HI is exact), and the kernel polynomials */
+#define LN2_HI      6.93147180369123816490e-01
+#define LN2_LO      1.90821492927058770002e-10
+#define PIO2_1      1.57079632673412561417e+00
+#define PIO2_2      6.07710050630396597660e-11
+#define PIO2_2T     2.02226624879595063154e-21
+
+#define S1  -1.66666666666666324348e-01
+#define S2   8.33333333332248946124e-03
+#define S3  -1.98412698298579493134e-04
+#define S4   2.75573137070700676789e-06
+#define S5  -2.50507602534068634195e-08
+#define S6   1.58969099521155010221e-10
+
+#define C1   4.16666666666666019037e-02
+#define C2  -1.38888888888741095749e-03
+#define C3   2.48015872894767294178e-05
+#define C4  -2.75573143513906633035e-07
+#define C5   2.08757232129817482790e-09
+#define C6  -1.13596475577881948265e-11
+
+#define LG1  6.666666666666735130e-01
+#define LG2  3.999999999940941908e-01
+#define LG3  2.857142874366239149e-01
+#define LG4  2.222219843214978396e-01
+#define LG5  1.818357216161805012e-01
+#define LG6  1.531383769920937332e-01
+#define LG7  1.479819860511658591e-01
+
+#ifdef __x86_64__
+#define VM_TARGET __attribute__((target("avx2,fma")))
+
+/* 1/k! for k = 13 down to 2, for the exp and expm1 polynomials */
+static const double inv_fact[] = {
+    1.0 / 6227020800.0, 1.0 / 479001600.0, 1.0 / 39916800.0,
+    1.0 / 3628800.0, 1.0 / 362880.0, 1.0 / 40320.0, 1.0 / 5040.0,
+    1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 1.0 / 2.0
+};
+
+static inline VM_TARGET __m256d set1(double d)
+{
+    return _mm256_set1_pd(d);
+}
+
+static inline VM_TARGET __m256d abs_pd(__m256d x)
+{
+    return _mm256_andnot_pd(set1(-0.0), x);
+}
+
+/* 2^n for integral n in [-1022, 1023], by building the exponent field */
+static inline VM_TARGET __m256d pow2_pd(__m256d n)
+{
+    __m256i e = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+    e = _mm256_slli_epi64(_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52);
+    return _mm256_castsi256_pd(e);
+}
+
+/* x = n * ln 2 + r, |r| <= ln(2) / 2. Returns r, n in *n */
+static inline VM_TARGET __m256d reduce_ln2(__m256d x, __m256d * n)
+{
+    *n = _mm256_round_pd(_mm256_mul_pd(x, set1(M_LOG2E)),
+                        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(*n, set1(LN2_HI), x);
+    return _mm256_fnmadd_pd(*n, set1(LN2_LO), r);
+}
+
+/* (e^r - 1 - r) / r^2 for |r| <= ln(2) / 2 */
+static inline VM_TARGET __m256d exp_poly(__m256d r)
+{
+    __m256d p = set1(inv_fact[0]);
+    for(size_t k = 1; k < sizeof(inv_fact) / sizeof(inv_fact[0]); k++)
+        p = _mm256_fmadd_pd(p, r, set1(inv_fact[k]));
+    return p;
+}
+
+static VM_TARGET __m256d exp_pd(__m256d x, __m256d * ok)
+{
+    *ok = _mm256_cmp_pd(abs_pd(x), set1(708.0), _CMP_LE_OQ);
+    x = _mm256_and_pd(x, *ok);  /* keep the rejected lanes harmless */
+    __m256d n;
+    __m256d r = reduce_ln2(x, &n);
+    /* e^r = 1 + r + r^2 * poly */
+    __m256d p = _mm256_fmadd_pd(_mm256_mul_pd(r, r), exp_poly(r), r);
+    p = _mm256_add_pd(p, set1(1.0));
+    return _mm256_mul_pd(p, pow2_pd(n));
+}
+
+/* e^x - 1 for 0 <= x <= 40 */
+static inline VM_TARGET __m256d expm1_pd(__m256d x)
+{
+    __m256d n;
+    __m256d r = reduce_ln2(x, &n);
+    __m256d em = _mm256_fmadd_pd(_mm256_mul_pd(r, r), exp_poly(r), r);
+    /* 2^n * (em + 1) - 1, with the -1 folded into the exact 2^n - 1 */
+    __m256d two_n = pow2_pd(n);
+    return _mm256_fmadd_pd(two_n, em, _mm256_sub_pd(two_n, set1(1.0)));
+}
+
+static VM_TARGET __m256d tanh_pd(__m256d x, __m256d * ok)
+{
+    *ok = _mm256_cmp_pd(x, x, _CMP_ORD_Q);
+    __m256d sign = _mm256_and_pd(x, set1(-0.0));
+    /* tanh(20) is 1.0 in double, past that it doesn't change */
+    __m256d a = _mm256_min_pd(abs_pd(_mm256_and_pd(x, *ok)), set1(20.0));
+    __m256d t = expm1_pd(_mm256_add_pd(a, a));
+    __m256d y = _mm256_div_pd(t, _mm256_add_pd(t, set1(2.0)));
+    return _mm256_or_pd(y, sign);
+}
+
+static VM_TARGET __m256d log_pd(__m256d x, __m256d * ok)
+{
+    /* no zero, negative, subnormal, inf or NaN */
+    *ok = _mm256_and_pd(_mm256_cmp_pd(x, set1(DBL_MIN), _CMP_GE_OQ),
+                        _mm256_cmp_pd(x, set1(DBL_MAX), _CMP_LE_OQ));
+    x = _mm256_blendv_pd(set1(1.0), x, *ok);
+
+    /* x = 2^k * m, m in [1, 2). k comes out of the exponent field by way of
+     * the 2^52 trick, since AVX2 can't convert 64 bit integers to double */
+    __m256i bits = _mm256_castpd_si256(x);
+    __m256i magic = _mm256_castpd_si256(set1(4503599627370496.0));
+    __m256d k = _mm256_sub_pd(
+            _mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52),
+                                                magic)),
+            set1(4503599627370496.0 + 1023.0));
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(
+            _mm256_and_si256(bits, _mm256_set1_epi64x(0x000fffffffffffffLL)),
+            _mm256_castpd_si256(set1(1.0))));
+    /* move m to [sqrt(1/2), sqrt(2)) so f = m - 1 is as small as it gets */
+    __m256d big = _mm256_cmp_pd(m, set1(M_SQRT2), _CMP_GT_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, set1(0.5)), big);
+    k = _mm256_add_pd(k, _mm256_and_pd(big, set1(1.0)));
+
+    /* fdlibm's __ieee754_log from here */
+    __m256d f = _mm256_sub_pd(m, set1(1.0));
+    __m256d s = _mm256_div_pd(f, _mm256_add_pd(f, set1(2.0)));
+    __m256d z = _mm256_mul_pd(s, s);
+    __m256d R = set1(LG7);
+    R = _mm256_fmadd_pd(R, z, set1(LG6));
+    R = _mm256_fmadd_pd(R, z, set1(LG5));
+    R = _mm256_fmadd_pd(R, z, set1(LG4));
+    R = _mm256_fmadd_pd(R, z, set1(LG3));
+    R = _mm256_fmadd_pd(R, z, set1(LG2));
+    R = _mm256_fmadd_pd(R, z, set1(LG1));
+    R = _mm256_mul_pd(R, z);
+    __m256d hfsq = _mm256_mul_pd(_mm256_mul_pd(f, f), set1(0.5));
+    /* k * ln2_hi - ((hfsq - (s * (hfsq + R) + k * ln2_lo)) - f) */
+    __m256d t = _mm256_fmadd_pd(s, _mm256_add_pd(hfsq, R),
+                                _mm256_mul_pd(k, set1(LN2_LO)));
+    t = _mm256_sub_pd(_mm256_sub_pd(hfsq, t), f);
+    return _mm256_fmsub_pd(k, set1(LN2_HI), t);
+}
+
+/* sin(x) for quadrant_offset 0, cos(x) for 1 */
+static VM_TARGET __m256d sincos_pd(__m256d x, int quadrant_offset,
+        __m256d * ok)
+{
+    /* past 1e5 three pieces of pi/2 aren't enough to keep r accurate */
+    *ok = _mm256_cmp_pd(abs_pd(x), set1(1e5), _CMP_LE_OQ);
+    x = _mm256_and_pd(x, *ok);
+    __m256d n = _mm256_round_pd(_mm256_mul_pd(x, set1(M_2_PI)),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(n, set1(PIO2_1), x);
+    r = _mm256_fnmadd_pd(n, set1(PIO2_2), r);
+    r = _mm256_fnmadd_pd(n, set1(PIO2_2T), r);
+
+    __m256d z = _mm256_mul_pd(r, r);
+    /* fdlibm's __kernel_sin: r + r^3 * (S1 + z * (S2 + ...)) */
+    __m256d ps = set1(S6);
+    ps = _mm256_fmadd_pd(ps, z, set1(S5));
+    ps = _mm256_fmadd_pd(ps, z, set1(S4));
+    ps = _mm256_fmadd_pd(ps, z, set1(S3));
+    ps = _mm256_fmadd_pd(ps, z, set1(S2));
+    ps = _mm256_fmadd_pd(ps, z, set1(S1));
+    __m256d sin_r = _mm256_fmadd_pd(_mm256_mul_pd(r, z), ps, r);
+    /* and __kernel_cos: 1 - z/2 + z^2 * (C1 + z * (C2 + ...)), with the
+     * 1 - z/2 done so its rounding error isn't lost */
+    __m256d pc = set1(C6);
+    pc = _mm256_fmadd_pd(pc, z, set1(C5));
+    pc = _mm256_fmadd_pd(pc, z, set1(C4));
+    pc = _mm256_fmadd_pd(pc, z, set1(C3));
+    pc = _mm256_fmadd_pd(pc, z, set1(C2));
+    pc = _mm256_fmadd_pd(pc, z, set1(C1));
+    __m256d hz = _mm256_mul_pd(z, set1(0.5));
+    __m256d w = _mm256_sub_pd(set1(1.0), hz);
+    __m256d lost = _mm256_sub_pd(_mm256_sub_pd(set1(1.0), w), hz);
+    __m256d cos_r = _mm256_add_pd(w, _mm256_fmadd_pd(_mm256_mul_pd(z, z), pc,
+                                                     lost));
+
+    /* quadrant: bit 0 swaps sin and cos, bit 1 flips the sign */
+    __m128i q = _mm_add_epi32(_mm256_cvtpd_epi32(n),
+                              _mm_set1_epi32(quadrant_offset));
+    __m256i q64 = _mm256_cvtepi32_epi64(q);
+    __m256d swap = _mm256_castsi256_pd(_mm256_cmpeq_epi64(
+            _mm256_and_si256(q64, _mm256_set1_epi64x(1)),
+            _mm256_set1_epi64x(1)));
+    __m256d neg = _mm256_castsi256_pd(_mm256_slli_epi64(
+            _mm256_and_si256(q64, _mm256_set1_epi64x(2)), 62));
+    return _mm256_xor_pd(_mm256_blendv_pd(sin_r, cos_r, swap), neg);
+}
+
+static inline VM_TARGET __m256d kernel_pd(vm_func f, __m256d x, __m256d * ok)
+{
+    switch(f)
+    {
+        case VM_SIN:    return sincos_pd(x, 0, ok);
+        case VM_COS:    return sincos_pd(x, 1, ok);
+        case VM_EXP:    return exp_pd(x, ok);
+        case VM_LOG:    return log_pd(x, ok);
+        case VM_TANH:   return tanh_pd(x, ok);
+        default:        *ok = _mm256_setzero_pd(); return x;
+    }
+}
+
+static VM_TARGET void apply_avx2(vm_func f, double * dst, const double * src,
+        size_t n)
+{
+    double (*scalar)(double) = libm_funcs[f];
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        __m256d ok;
+        __m256d y = kernel_pd(f, _mm256_loadu_pd(src + i), &ok);
+        if(_mm256_movemask_pd(ok) == 0xf)
+            _mm256_storeu_pd(dst + i, y);
+        else
+            for(size_t k = i; k < i + 4; k++)
+                dst[k] = scalar(src[k]);
+    }
+    for(; i < n; i++)
+        dst[i] = scalar(src[i]);
+}
+
+static VM_TARGET void applyf_avx2(vm_func f, float * dst, const float * src,
+        size_t n)
+{
+    float (*scalar)(float) = libm_funcsf[f];
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        __m256d ok;
+        __m256d y = kernel_pd(f, _mm256_cvtps_pd(_mm_loadu_ps(src + i)), &ok);
+        if(_mm256_movemask_pd(ok) == 0xf)
+            _mm_storeu_ps(dst + i, _mm256_cvtpd_ps(y));
+        else
+            for(size_t k = i; k < i + 4; k++)
+                dst[k] = scalar(src[k]);
+    }
+    for(; i < n; i++)
+        dst[i] = scalar(src[i]);
+}
+
+/* libgcc fills in the CPU model before main, no lazy check to race on */
+static int have_avx2_fma(void)
+{
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+#endif /* __x86_64__ */
+
+void vm_apply(vm_func f, double * dst, const double * src, size_t n)
+{
+#ifdef __x86_64__
+    if(have_avx2_fma())
+    {
+        apply_avx2(f, dst, src, n);
+        return;
+    }
+#endif
+    double (*scalar)(double) = libm_funcs[f];
+    for(size_t i = 0; i < n; i++)
+        dst[i] = scalar(src[i]);
+}
+
+void vm_applyf(vm_func f, float * dst, const float * src, size_t n)
+{
+#ifdef __x86_64__
+    if(have_avx2_fma())
+    {
+        applyf_avx2(f, dst, src, n);
+        return;
+    }
+#endif
+    float (*scalar)(float) = libm_funcsf[f];
+    for(size_t i = 0; i < n; i++)
+        dst[i] = scalar(src[i]);
+}
+
+/* |got - want| in units of the spacing of doubles (or floats) around want */
+static double ulp_error(double got, long double want)
+{
+    double rounded = (double)want;
+    double ulp = nextafter(fabs(rounded), INFINITY) - fabs(rounded);
+    return (double)(fabsl((long double)got - want) / ulp);
+}
+
+static double ulp_errorf(float got, long double want)
+{
+    float rounded = (float)want;
+    float ulp = nextafterf(fabsf(rounded), INFINITY) - fabsf(rounded);
+    return (double)(fabsl((long double)got - want) / ulp);
+}
+
+void vm_benchmark(vm_func f)
+{
+    size_t n = VM_BENCH_LEN;
+    double * src = malloc(n * sizeof(double));
+    double * dst = malloc(n * sizeof(double));
+    double * ref = malloc(n * sizeof(double));
+    float * srcf = malloc(n * sizeof(float));
+    float * dstf = malloc(n * sizeof(float));
+    if(src == NULL || dst == NULL || ref == NULL || srcf == NULL
+            || dstf == NULL)
+        error(EXIT_FAILURE, errno, "benchmark array allocation failed");
+
+    /* a domain where each function does something interesting. log gets
+     * e^u so its inputs cover most of the exponent range */
+    double lo = f == VM_TANH ? -20.0 : f == VM_SIN || f == VM_COS ? -100.0 :
+                -700.0;
+    unsigned long state = 1;
+    for(size_t i = 0; i < n; i++)
+    {
+        state = state * 6364136223846793005UL + 1442695040888963407UL;
+        double u = lo + (-2.0 * lo) * (double)(state >> 11) / 9007199254740992.0;
+        src[i] = f == VM_LOG ? exp(u) : u;
+        /* float only has room for e^+-87 */
+        srcf[i] = f == VM_LOG ? expf((float)u / 8.0f) :
+                    f == VM_EXP ? (float)u / 8.0f : (float)u;
+    }
+
+    double (*scalar)(double) = libm_funcs[f];
+    float (*scalarf)(float) = libm_funcsf[f];
+    long double (*reference)(long double) = libm_funcsl[f];
+    char label[32];
+    printf("%s over %zu elements:\n", vm_func_names[f], n);
+
+    struct timespec start = bench_now();
+    for(size_t i = 0; i < n; i++)
+        ref[i] = scalar(src[i]);
+    snprintf(label, sizeof(label), "libm %s", vm_func_names[f]);
+    bench_print_throughput(label, n * sizeof(double),
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    vm_apply(f, dst, src, n);
+    snprintf(label, sizeof(label), "vm_apply %s", vm_func_names[f]);
+    bench_print_throughput(label, n * sizeof(double),
+            bench_elapsed(start, bench_now()));
+
+    start = bench_now();
+    for(size_t i = 0; i < n; i++)
+        dstf[i] = scalarf(srcf[i]);
+    snprintf(label, sizeof(label), "libm %sf", vm_func_names[f]);
+    bench_print_throughput(label, n * sizeof(float),
+            bench_elapsed(start, bench_now()));
+
+    /* score libm's float answers now, vm_applyf is about to overwrite them */
+    double max_libmf = 0.0;
+    for(size_t i = 0; i < n; i++)
+    {
+        double e = ulp_errorf(dstf[i], reference(srcf[i]));
+        if(e > max_libmf)
+            max_libmf = e;
+    }
+
+    start = bench_now();
+    vm_applyf(f, dstf, srcf, n);
+    snprintf(label, sizeof(label), "vm_applyf %s", vm_func_names[f]);
+    bench_print_throughput(label, n * sizeof(float),
+            bench_elapsed(start, bench_now()));
+
+    double max_libm = 0.0;
+    double max_vm = 0.0;
+    double max_vmf = 0.0;
+    for(size_t i = 0; i < n; i++)
+    {
+        long double want = reference(src[i]);
+        double e = ulp_error(ref[i], want);
+        if(e > max_libm)
+            max_libm = e;
+        e = ulp_error(dst[i], want);
+        if(e > max_vm)
+            max_vm = e;
+        e = ulp_errorf(dstf[i], reference(srcf[i]));
+        if(e > max_vmf)
+            max_vmf = e;
+    }
+    printf( "\tmax error vs long double: libm %.3f ULP, vm_apply %.3f ULP, "
+            "libm float %.3f ULP, vm_applyf %.3f ULP\n",
+            max_libm, max_vm, max_libmf, max_vmf);
+
+    free(dstf);
+    free(srcf);
+    free(ref);
+    free(dst);
+    free(src);
+}
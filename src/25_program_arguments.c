@@ -1,12 +1,18 @@
 #include "25_program_arguments.h"
+#include "bench_harness.h"
+#include "task_pool.h"
+#include "12_output_sink.h"
+#include "startup_profile.h"
 #include <argp.h>       /* argp functions */
-#include <stdbool.h>    /* false */
 #include <stdlib.h>     /* EXIT_SUCCESS */
-#include <string.h>     /* strtok */
+#include <string.h>     /* strtok, strcmp */
 #include <errno.h>      /* errno */
 #include <error.h>      /* error */
 
-_Bool sections[39] = {false,};
+const section * selected_sections[MAX_SELECTED_SECTIONS];
+size_t num_selected_sections;
+int jobs = 1;
+int output_mode = OUT_BUFFERED;
 
 /* argp globals */
 const char * argp_program_version = "libc_notes version 5.14.0";
@@ -16,10 +22,41 @@ const char doc[] = "libc notes -- a runnable set of examples subdivided by "
 
 static error_t custom_parser(int key, char * arg, struct argp_state * state);
 
+/* keys for the options that only have a long name */
+enum {
+    KEY_STARTUP_BENCH = 256,
+    KEY_STARTUP_COLD,
+};
+
 static struct argp_option options[] = {
         {"sections", 's', "CSV_SECTIONS", 0, 
-            "comma-separated (no spaces) integers representing section numbers." 
-            "e.g. 01,05,23", 0},
+            "comma-separated (no spaces) section numbers or names, run in "
+            "that order. e.g. 01,05,23 or math,ctype", 0},
+        {"list", 'l', 0, 0, "list the sections and exit", 0},
+        {"jobs", 'j', "N", 0,
+            "run up to N demos at once, 0 for one per CPU (default 1)", 0},
+        {"bench", 'b', 0, 0,
+            "time each demo of the selected sections instead of showing its "
+            "output, and print a report", 0},
+        {"iterations", 'i', "N", 0,
+            "timed runs of each demo with --bench (default 10)", 0},
+        {"warmup", 'w', "N", 0,
+            "untimed runs of each demo before those (default 1)", 0},
+        {"format", 'f', "FORMAT", 0,
+            "--bench report as text (default), csv or json", 0},
+        {"output", 'o', "MODE", 0,
+            "buffered (default) collects the output and writes it in big "
+            "pieces unless it's a terminal, stdio leaves stdout alone, "
+            "quiet throws it away", 0},
+        {"startup", 'S', 0, 0,
+            "print how long it took to get to the first section on stderr",
+            0},
+        {"startup-bench", KEY_STARTUP_BENCH, "N", 0,
+            "start the program N times, cold and warm, and print how long "
+            "it takes to get going, then exit", 0},
+        {"startup-cold", KEY_STARTUP_COLD, 0, 0,
+            "with --startup-bench, also time a few cold starts. Drops the "
+            "page cache of the whole machine before each, needs root", 0},
         { 0 }
     };
 
@@ -41,18 +78,92 @@ static error_t custom_parser(int key, char * arg, struct argp_state * state)
             argp_error(state, "argument required for --sections");
         while(ptr != NULL)
         {
-            int sub_arg = atoi(ptr);
-            if(sub_arg > 0)
-            {
-                sections[sub_arg] = true;
-            }
-            else /* a return of 0 means an error */
+            const section * s = section_find(ptr);
+            if(s == NULL)
+                argp_error(state, "no section %s, --list shows them", ptr);
+
+            /* naming one twice runs it once, where it was first named */
+            size_t i = 0;
+            while(i < num_selected_sections && selected_sections[i] != s)
+                i++;
+            if(i == num_selected_sections)
             {
-                argp_error(state, "Do not pass 0 as a section.");
+                if(num_selected_sections == MAX_SELECTED_SECTIONS)
+                    argp_error(state, "too many sections");
+                selected_sections[num_selected_sections++] = s;
             }
             ptr = strsep(&arg_copy, ",");
         }
     }
+    else if(key == 'l')
+    {
+        section_list();
+        exit(EXIT_SUCCESS);
+    }
+    else if(key == 'b')
+    {
+        bench_settings.enabled = 1;
+    }
+    else if(key == 'S')
+    {
+        startup_settings.enabled = 1;
+    }
+    else if(key == KEY_STARTUP_COLD)
+    {
+        startup_settings.cold = 1;
+    }
+    /* --iterations=N, --warmup=N, --jobs=N and --startup-bench=N */
+    else if(key == 'i' || key == 'w' || key == 'j' || key == KEY_STARTUP_BENCH)
+    {
+        /* at least one timed run, warmup can be none, jobs 0 is automatic */
+        long least = key == 'i' || key == KEY_STARTUP_BENCH ? 1 : 0;
+        char * end;
+        errno = 0;
+        long n = strtol(arg, &end, 10);
+        if(errno != 0 || end == arg || *end != '\0' || n < least
+                || n > 1000000)
+            argp_error(state, "bad count for --%s: %s", key == 'i' ?
+                        "iterations" : key == 'w' ? "warmup" :
+                        key == 'j' ? "jobs" : "startup-bench", arg);
+        if(key == 'i')
+            bench_settings.iterations = n;
+        else if(key == 'w')
+            bench_settings.warmup = n;
+        else if(key == 'j')
+            jobs = n == 0 ? pool_default_jobs() : n;
+        else
+            startup_settings.runs = n;
+    }
+    /* --format=text|csv|json */
+    else if(key == 'f')
+    {
+        if(strcmp(arg, "text") == 0)
+            bench_settings.format = BENCH_FORMAT_TEXT;
+        else if(strcmp(arg, "csv") == 0)
+            bench_settings.format = BENCH_FORMAT_CSV;
+        else if(strcmp(arg, "json") == 0)
+            bench_settings.format = BENCH_FORMAT_JSON;
+        else
+            argp_error(state, "--format is text, csv or json, not %s", arg);
+    }
+    /* --output=buffered|stdio|quiet */
+    else if(key == 'o')
+    {
+        if(strcmp(arg, "buffered") == 0)
+            output_mode = OUT_BUFFERED;
+        else if(strcmp(arg, "stdio") == 0)
+            output_mode = OUT_STDIO;
+        else if(strcmp(arg, "quiet") == 0)
+            output_mode = OUT_QUIET;
+        else
+            argp_error(state, "--output is buffered, stdio or quiet, not %s",
+                        arg);
+    }
+    /* timing demos that share the CPUs with each other says nothing */
+    else if(key == ARGP_KEY_END && bench_settings.enabled && jobs > 1)
+    {
+        argp_error(state, "--bench can't be used with --jobs");
+    }
 
     return 0;
 }
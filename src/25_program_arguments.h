@@ -1,10 +1,20 @@
 #ifndef PROGRAM_ARGUMENTS_H
 
+#include "section_registry.h"
+
 /* demo for using argp */
 int parse_arguments_argp_demo(int argc, char * argv[]);
 
-/* globals for if we'll run certain demo sections or not */
-extern _Bool sections[39];
+/* the sections to run, in the order --sections named them */
+#define MAX_SELECTED_SECTIONS 64
+extern const section * selected_sections[MAX_SELECTED_SECTIONS];
+extern size_t num_selected_sections;
+
+/* demos to run at once with --jobs, 1 is one after the other */
+extern int jobs;
+
+/* an out_mode for stdout, see 12_output_sink.h */
+extern int output_mode;
 
 #define PROGRAM_ARGUMENTS_H
 #endif /* PROGRAM_ARGUMENTS_H */
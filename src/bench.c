@@ -0,0 +1,37 @@
+/* Benchmark helpers
+ *
+ * Chapter 21 of the manual covers the clocks, and the one you want for timing
+ * things is CLOCK_MONOTONIC. CLOCK_REALTIME can jump around when ntp or a
+ * human adjusts the system time, the monotonic clock only ever counts up.
+ *
+ *      int clock_gettime(clockid_t CLOCK, struct timespec *TS)
+ * */
+#include "bench.h"
+#include <stdio.h>  /* printf */
+#include <stdlib.h> /* EXIT_FAILURE */
+#include <errno.h>  /* errno */
+#include <error.h>  /* error */
+
+struct timespec bench_now(void)
+{
+    struct timespec ts;
+    if(clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+        error(EXIT_FAILURE, errno, "clock_gettime failed");
+    return ts;
+}
+
+double bench_elapsed(struct timespec start, struct timespec end)
+{
+    return (double)(end.tv_sec - start.tv_sec)
+        + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+void bench_print_throughput(const char * label, size_t bytes, double seconds)
+{
+    double mb = (double)bytes / (1024.0 * 1024.0);
+    printf( "\t%-28s %9.1f MB in %8.4f s (%9.1f MB/s)\n",
+            label,
+            mb,
+            seconds,
+            seconds > 0.0 ? mb / seconds : 0.0);
+}
@@ -0,0 +1,14 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h> /* size_t */
+#include <time.h>   /* struct timespec */
+
+/* wall clock helpers shared by the benchmark portions of the demos */
+struct timespec bench_now(void);
+double bench_elapsed(struct timespec start, struct timespec end);
+
+/* prints "label: N MB in S s (X MB/s)" */
+void bench_print_throughput(const char * label, size_t bytes, double seconds);
+
+#endif /* BENCH_H */
@@ -0,0 +1,266 @@
+/* Benchmark harness for whole demos
+ *
+ * The demos already time their own inner loops, this times them from the
+ * outside so a nightly run can compare one build against another. Each demo
+ * is run a few times untimed first (page faults, lazily built tables, cold
+ * caches and the dynamic linker resolving symbols all land in the first run)
+ * and then timed with CLOCK_MONOTONIC for every run.
+ *
+ * Latencies are reported as the minimum (the best the machine can do), the
+ * median (typical) and the 99th percentile by nearest rank (the bad runs,
+ * which with only a handful of iterations is just the slowest one). The mean
+ * isn't, one run that got descheduled drags it anywhere.
+ *
+ * Everything the demos print while being timed is thrown away by the output
+ * sink (12_output_sink.c) without a single write, and file descriptor 1 is
+ * pointed at /dev/null with dup2 as well for --output=stdio. A section's
+ * setup and teardown (chapter 9's banner) go through bench_untimed and are
+ * silenced the same way. So the report is the only thing on stdout and it
+ * can go straight into a file. stderr is left alone.
+ *
+ * The timed runs are also counted with the CPU's performance counters (see
+ * perf_counters.c) and the report has each one per run, plus instructions per
+ * cycle. Counters this machine doesn't give us are blank in the csv, null in
+ * the json and - in the text.
+ * */
+#include "bench_harness.h"
+#include "bench.h"
+#include "perf_counters.h"
+#include "12_output_sink.h"
+#include <stdio.h>      /* printf, fflush */
+#include <stdlib.h>     /* malloc, realloc, qsort */
+#include <fcntl.h>      /* open */
+#include <unistd.h>     /* dup, dup2, close */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+
+bench_config bench_settings = {
+    .enabled = 0,
+    .iterations = 10,
+    .warmup = 1,
+    .format = BENCH_FORMAT_TEXT,
+};
+
+typedef struct _bench_result {
+    int section;
+    const char * name;
+    double min;
+    double median;
+    double p99;
+    perf_counts counts;     /* per run */
+} bench_result;
+
+static bench_result * results;
+static size_t num_results;
+
+/* opened on the first bench_demo and kept for the rest */
+static perf_counters counters;
+static _Bool counters_open;
+
+static int compare_doubles(const void * a, const void * b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* point stdout at /dev/null, returns the descriptor to restore */
+static int stdout_silence(out_mode * saved_mode)
+{
+    *saved_mode = out_set_mode(OUT_QUIET);
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if(saved < 0 || null_fd < 0)
+        error(EXIT_FAILURE, errno, "redirecting stdout failed");
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+    return saved;
+}
+
+static void stdout_restore(int saved, out_mode saved_mode)
+{
+    out_set_mode(saved_mode);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+void bench_untimed(void (*fn)(void))
+{
+    if(!bench_settings.enabled)
+    {
+        fn();
+        return;
+    }
+    out_mode saved_mode;
+    int saved = stdout_silence(&saved_mode);
+    fn();
+    stdout_restore(saved, saved_mode);
+}
+
+void bench_demo(int section, const char * name, void (*demo)(void))
+{
+    if(!bench_settings.enabled)
+    {
+        demo();
+        return;
+    }
+
+    int n = bench_settings.iterations;
+    double * samples = malloc(n * sizeof(double));
+    bench_result * grown = realloc(results,
+                                    (num_results + 1) * sizeof(bench_result));
+    if(samples == NULL || grown == NULL)
+        error(EXIT_FAILURE, errno, "benchmark result allocation failed");
+    results = grown;
+
+    if(!counters_open)
+    {
+        if(perf_open(&counters) == 0)
+            fprintf(stderr, "no perf_event_open counters available\n");
+        counters_open = 1;
+    }
+
+    fprintf(stderr, "benchmarking %s (%d + %d runs)\n", name,
+            bench_settings.warmup, n);
+    perf_counts counts;
+    out_mode saved_mode;
+    int saved = stdout_silence(&saved_mode);
+    for(int i = 0; i < bench_settings.warmup; i++)
+        demo();
+    perf_start(&counters);
+    for(int i = 0; i < n; i++)
+    {
+        struct timespec start = bench_now();
+        demo();
+        samples[i] = bench_elapsed(start, bench_now());
+    }
+    perf_stop(&counters, &counts);
+    stdout_restore(saved, saved_mode);
+
+    qsort(samples, n, sizeof(double), compare_doubles);
+    bench_result * r = &results[num_results++];
+    r->section = section;
+    r->name = name;
+    r->min = samples[0];
+    r->median = n % 2 ? samples[n / 2]
+                      : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    /* nearest rank: the smallest sample with 99% at or below it */
+    r->p99 = samples[(99 * n + 99) / 100 - 1];
+    r->counts = counts;
+    for(int c = 0; c < PERF_NUM_COUNTERS; c++)
+        r->counts.values[c] /= n;
+    free(samples);
+}
+
+/* instructions per cycle, or a negative number without both counters */
+static double ipc(const perf_counts * counts)
+{
+    if(!counts->valid[PERF_CYCLES] || !counts->valid[PERF_INSTRUCTIONS]
+            || counts->values[PERF_CYCLES] == 0)
+        return -1.0;
+    return (double)counts->values[PERF_INSTRUCTIONS]
+            / counts->values[PERF_CYCLES];
+}
+
+void bench_report(void)
+{
+    if(!bench_settings.enabled)
+        return;
+
+    /* the counter columns' names without spaces, for csv and json */
+    static const char * const keys[PERF_NUM_COUNTERS] = {
+        "cycles", "instructions", "l1d_misses", "llc_misses",
+        "branch_misses", "page_faults"
+    };
+
+    switch(bench_settings.format)
+    {
+        case BENCH_FORMAT_CSV:
+            printf("section,demo,iterations,min_ns,median_ns,p99_ns,"
+                    "runs_per_sec,ipc");
+            for(int c = 0; c < PERF_NUM_COUNTERS; c++)
+                printf(",%s", keys[c]);
+            printf("\n");
+            for(size_t i = 0; i < num_results; i++)
+            {
+                const bench_result * r = &results[i];
+                printf("%d,%s,%d,%.0f,%.0f,%.0f,%.3f,", r->section, r->name,
+                        bench_settings.iterations, r->min * 1e9,
+                        r->median * 1e9, r->p99 * 1e9, 1.0 / r->median);
+                if(ipc(&r->counts) >= 0.0)
+                    printf("%.3f", ipc(&r->counts));
+                for(int c = 0; c < PERF_NUM_COUNTERS; c++)
+                    if(r->counts.valid[c])
+                        printf(",%lu", r->counts.values[c]);
+                    else
+                        printf(",");
+                printf("\n");
+            }
+            break;
+        case BENCH_FORMAT_JSON:
+            printf("{\"iterations\": %d, \"warmup\": %d, \"results\": [",
+                    bench_settings.iterations, bench_settings.warmup);
+            for(size_t i = 0; i < num_results; i++)
+            {
+                const bench_result * r = &results[i];
+                printf("%s\n  {\"section\": %d, \"demo\": \"%s\", "
+                        "\"min_ns\": %.0f, \"median_ns\": %.0f, "
+                        "\"p99_ns\": %.0f, \"runs_per_sec\": %.3f, ",
+                        i ? "," : "", r->section, r->name, r->min * 1e9,
+                        r->median * 1e9, r->p99 * 1e9, 1.0 / r->median);
+                if(ipc(&r->counts) >= 0.0)
+                    printf("\"ipc\": %.3f", ipc(&r->counts));
+                else
+                    printf("\"ipc\": null");
+                for(int c = 0; c < PERF_NUM_COUNTERS; c++)
+                    if(r->counts.valid[c])
+                        printf(", \"%s\": %lu", keys[c], r->counts.values[c]);
+                    else
+                        printf(", \"%s\": null", keys[c]);
+                printf("}");
+            }
+            printf("\n]}\n");
+            break;
+        default:
+            printf("%d timed runs of each demo after %d warmup:\n",
+                    bench_settings.iterations, bench_settings.warmup);
+            printf("\t%-3s %-30s %12s %12s %12s %14s\n", "sec", "demo",
+                    "min ms", "median ms", "p99 ms", "runs/s");
+            for(size_t i = 0; i < num_results; i++)
+                printf("\t%-3d %-30s %12.3f %12.3f %12.3f %14.2f\n",
+                        results[i].section, results[i].name,
+                        results[i].min * 1e3, results[i].median * 1e3,
+                        results[i].p99 * 1e3, 1.0 / results[i].median);
+
+            printf("counters per run:\n\t%-3s %-30s %6s", "sec", "demo",
+                    "IPC");
+            for(int c = 0; c < PERF_NUM_COUNTERS; c++)
+                printf(" %14s", perf_counter_names[c]);
+            printf("\n");
+            for(size_t i = 0; i < num_results; i++)
+            {
+                const bench_result * r = &results[i];
+                printf("\t%-3d %-30s", r->section, r->name);
+                if(ipc(&r->counts) >= 0.0)
+                    printf(" %6.2f", ipc(&r->counts));
+                else
+                    printf(" %6s", "-");
+                for(int c = 0; c < PERF_NUM_COUNTERS; c++)
+                    if(r->counts.valid[c])
+                        printf(" %14lu", r->counts.values[c]);
+                    else
+                        printf(" %14s", "-");
+                printf("\n");
+            }
+            break;
+    }
+
+    free(results);
+    results = NULL;
+    num_results = 0;
+    if(counters_open)
+        perf_close(&counters);
+    counters_open = 0;
+}
@@ -0,0 +1,35 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+/* repeated, timed runs of whole demos for --bench, see 25_program_arguments.c
+ * for the options that fill in bench_settings */
+
+typedef enum _bench_format {
+    BENCH_FORMAT_TEXT,
+    BENCH_FORMAT_CSV,
+    BENCH_FORMAT_JSON
+} bench_format;
+
+typedef struct _bench_config {
+    _Bool enabled;
+    int iterations;     /* timed runs of each demo */
+    int warmup;         /* untimed runs before those */
+    bench_format format;
+} bench_config;
+
+extern bench_config bench_settings;
+
+/* without --bench just calls demo. With it, runs demo warmup + iterations
+ * times with its stdout thrown away and keeps the timings for bench_report */
+void bench_demo(int section, const char * name, void (*demo)(void));
+
+/* just calls fn, with its stdout thrown away under --bench. For the setup
+ * and teardown around the demos, which have to run but aren't timed */
+void bench_untimed(void (*fn)(void));
+
+/* min, median, p99, runs per second and the performance counters (per run)
+ * of every demo so far, to stdout in bench_settings.format. Does nothing
+ * without --bench */
+void bench_report(void);
+
+#endif /* BENCH_HARNESS_H */
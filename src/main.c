@@ -3,65 +3,64 @@
 #include <errno.h>
 #include <error.h>
 
-/* notes files -- all have an associated .c */
-#include "02_error_reporting.h"
-#include "03_virtual_memory_allocation.h"
-#include "04_character_classification.h"
-#include "05_string_utils.h"
-#include "09_searching_and_sorting.h"
-#include "19_mathematics.h"
+/* every section main can run is in the registry, see section_registry.c */
+#include "section_registry.h"
+#include "07_locale_manager.h"
 #include "25_program_arguments.h"
+#include "bench_harness.h"
+#include "12_output_sink.h"
+#include "startup_profile.h"
 
 int main(int argc, char * argv[])
 {
+    /* the phases of startup for --startup, see startup_profile.c */
+    startup_mark("to main");
     int ret = parse_arguments_argp_demo(argc, argv);
     if(ret != EXIT_SUCCESS)
         error(EXIT_FAILURE, errno, "Argument Parsing Failure");
+    startup_mark("argument parsing");
 
-    /* Section 3 -- memory management demo */
-    if(sections[3])
-    {
-        get_memory_subsystem_info();
-        virtual_memory_allocation_demo();
-        paging_demo();
-    }
-
-    /* Section 4 -- Character Classification Examples */
-    if(sections[4])
-    {
-        char_classification_demo();
-        char_case_conversion_demo();
-        wchar_classification_demo();
-        wchar_usage_demo();
-        wchar_mapping_demo();
-    }
+    /* stdout through a big buffer from here on, see 12_output_sink.c */
+    out_install(output_mode);
+    startup_mark("output setup");
 
-    /* Section 5 -- String & Array Demos */
-    if(sections[5])
+    if(startup_settings.runs > 0)
     {
-        string_run_demos();
+        startup_bench();
+        exit(EXIT_SUCCESS);
     }
+    startup_report();
 
-    /* Section 9 -- Search and Sort Functions */
-    if(sections[9])
-    {
-        search_sort_run_demos();
-    }
+    /* in the order they were asked for, except the ones that exit */
+    const section * to_run[MAX_SELECTED_SECTIONS];
+    size_t num_to_run = 0;
+    for(size_t i = 0; i < num_selected_sections; i++)
+        if(!selected_sections[i]->exits)
+            to_run[num_to_run++] = selected_sections[i];
+    if(jobs > 1)
+        section_run_parallel(to_run, num_to_run, jobs);
+    else
+        for(size_t i = 0; i < num_to_run; i++)
+            section_run(to_run[i]);
 
-    if(sections[19])
-    {
-        mathematics_run_demos();
-    }
+    /* everything has run, the report goes out before a section can exit */
+    bench_report();
 
-    /* Section 2 -- error reporting should be run last because it will exit with
-     * return value of EXIT_FAILURE before we reach the exit below */
-    if(sections[2])
+    /* Section 2 -- error reporting has to run last because it will exit with
+     * return value of EXIT_FAILURE before we reach the exit below. Exiting
+     * isn't something to time, so --bench leaves it out */
+    for(size_t i = 0; i < num_selected_sections; i++)
     {
+        if(!selected_sections[i]->exits || bench_settings.enabled)
+            continue;
         printf("Starting error reporting demo:\n");
-        error_reporting_demo();
+        section_run(selected_sections[i]);
         /* we won't reach anything below this point, that's part of the demo */
         printf("Error reporting demo complete.\n\n");
     }
+
+    /* the locale objects the demos shared */
+    locale_manager_release();
         
     exit(EXIT_SUCCESS);
 }
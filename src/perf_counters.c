@@ -0,0 +1,151 @@
+/* Hardware performance counters
+ *
+ * Timing says how long, the CPU's counters say why: instructions per cycle
+ * (under 1 usually means waiting on memory), cache misses, and branch
+ * mispredictions. Linux hands them out through a syscall glibc has no wrapper
+ * for, so it's called through syscall(2):
+ *
+ *      int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu,
+ *                          int group_fd, unsigned long flags)
+ *
+ * pid 0 and cpu -1 counts this process on whatever CPU it runs. Each counter
+ * is its own file descriptor, started, stopped and zeroed with ioctl and read
+ * with read(2).
+ *
+ * Plenty of places won't have them: virtual machines often don't pass the
+ * PMU through (no "cpu" in /sys/bus/event_source/devices), containers block
+ * the syscall, and /proc/sys/kernel/perf_event_paranoid above 2 stops
+ * unprivileged use altogether. Below that, exclude_kernel = 1 is what an
+ * unprivileged process is allowed, so only user space is counted. A counter
+ * that doesn't open is just left out, and page faults (a software event that
+ * needs no PMU) come from getrusage if even that fails.
+ *
+ * There are only a handful of hardware counter registers, so if more events
+ * are open than fit the kernel rotates them and reports how long each one
+ * actually ran; the count is scaled up by enabled / running.
+ * */
+#include "perf_counters.h"
+#include <string.h>             /* memset */
+#include <unistd.h>             /* syscall, read, close */
+#include <sys/ioctl.h>          /* ioctl */
+#include <sys/syscall.h>        /* SYS_perf_event_open */
+#include <sys/resource.h>       /* getrusage */
+#include <linux/perf_event.h>   /* struct perf_event_attr, PERF_* */
+
+const char * const perf_counter_names[PERF_NUM_COUNTERS] = {
+    "cycles", "instructions", "L1d misses", "LLC misses", "branch misses",
+    "page faults"
+};
+
+/* type and config for each counter */
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[PERF_NUM_COUNTERS] = {
+    [PERF_CYCLES]        = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [PERF_INSTRUCTIONS]  = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [PERF_L1D_MISSES]    = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    [PERF_LLC_MISSES]    = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    [PERF_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    [PERF_PAGE_FAULTS]   = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+/* what read(2) gives back with the format below */
+struct read_format {
+    uint64_t value;
+    uint64_t time_enabled;
+    uint64_t time_running;
+};
+
+static long rusage_faults(void)
+{
+    struct rusage ru;
+    if(getrusage(RUSAGE_SELF, &ru) != 0)
+        return -1;
+    return ru.ru_minflt + ru.ru_majflt;
+}
+
+int perf_open(perf_counters * pc)
+{
+    int opened = 0;
+    for(int i = 0; i < PERF_NUM_COUNTERS; i++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+                            | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        pc->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+                                PERF_FLAG_FD_CLOEXEC);
+        if(pc->fds[i] >= 0)
+            opened++;
+        else
+            pc->fds[i] = -1;
+    }
+    pc->rusage_faults = -1;
+    return opened;
+}
+
+void perf_start(perf_counters * pc)
+{
+    for(int i = 0; i < PERF_NUM_COUNTERS; i++)
+    {
+        if(pc->fds[i] < 0)
+            continue;
+        ioctl(pc->fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(pc->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    if(pc->fds[PERF_PAGE_FAULTS] < 0)
+        pc->rusage_faults = rusage_faults();
+}
+
+void perf_stop(perf_counters * pc, perf_counts * counts)
+{
+    /* disable them all first so reading doesn't get counted */
+    for(int i = 0; i < PERF_NUM_COUNTERS; i++)
+        if(pc->fds[i] >= 0)
+            ioctl(pc->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    for(int i = 0; i < PERF_NUM_COUNTERS; i++)
+    {
+        struct read_format r;
+        counts->valid[i] = 0;
+        counts->values[i] = 0;
+        if(pc->fds[i] < 0
+                || read(pc->fds[i], &r, sizeof(r)) != (ssize_t)sizeof(r)
+                || r.time_running == 0)
+            continue;
+        counts->values[i] = r.time_running < r.time_enabled ?
+            (uint64_t)((double)r.value * r.time_enabled / r.time_running) :
+            r.value;
+        counts->valid[i] = 1;
+    }
+
+    if(pc->fds[PERF_PAGE_FAULTS] < 0 && pc->rusage_faults >= 0)
+    {
+        long now = rusage_faults();
+        if(now >= 0)
+        {
+            counts->values[PERF_PAGE_FAULTS] = now - pc->rusage_faults;
+            counts->valid[PERF_PAGE_FAULTS] = 1;
+        }
+    }
+}
+
+void perf_close(perf_counters * pc)
+{
+    for(int i = 0; i < PERF_NUM_COUNTERS; i++)
+    {
+        if(pc->fds[i] >= 0)
+            close(pc->fds[i]);
+        pc->fds[i] = -1;
+    }
+}
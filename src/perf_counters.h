@@ -0,0 +1,44 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h> /* uint64_t */
+
+/* hardware and software event counters from perf_event_open(2), for the
+ * process that opens them (all threads it creates after, too) */
+typedef enum _perf_counter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_PAGE_FAULTS,
+    PERF_NUM_COUNTERS
+} perf_counter;
+
+extern const char * const perf_counter_names[PERF_NUM_COUNTERS];
+
+typedef struct _perf_counters {
+    int fds[PERF_NUM_COUNTERS];         /* -1 for the ones that didn't open */
+    long rusage_faults;                 /* page faults at perf_start when
+                                         * they come from getrusage instead */
+} perf_counters;
+
+typedef struct _perf_counts {
+    uint64_t values[PERF_NUM_COUNTERS];
+    _Bool valid[PERF_NUM_COUNTERS];
+} perf_counts;
+
+/* opens whatever this machine and perf_event_paranoid allow and returns how
+ * many of the counters did. Any that didn't just come back not valid, and
+ * page faults fall back to getrusage, so none of this is fatal */
+int perf_open(perf_counters * pc);
+
+/* zero and run the counters, then stop them and read them into counts.
+ * Counters the kernel had to time share with others are scaled up to an
+ * estimate for the whole time */
+void perf_start(perf_counters * pc);
+void perf_stop(perf_counters * pc, perf_counts * counts);
+
+void perf_close(perf_counters * pc);
+
+#endif /* PERF_COUNTERS_H */
@@ -0,0 +1,245 @@
+/* Section registry
+ *
+ * Every runnable section of the notes, described once. main runs whatever
+ * --sections picked in the order it was given, --list prints this table, and
+ * --bench times each demo of a section separately. A new section is a new
+ * entry here (and its header), nothing else has to change.
+ *
+ * With --jobs the demos of every section go to the task pool together, so
+ * demos from different sections and from the same section run side by side.
+ * That's fine because no demo depends on another having run first, only on
+ * its section's setup, and the setups all run (in the parent, before the
+ * pool starts) first. Teardowns run after the pool is done.
+ * */
+#include "section_registry.h"
+#include "bench_harness.h"
+#include "task_pool.h"
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* strtol, malloc, free */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+#include <string.h>     /* strcmp */
+
+/* notes files -- all have an associated .c */
+#include "02_error_reporting.h"
+#include "02_error_log.h"
+#include "02_errno_table.h"
+#include "03_virtual_memory_allocation.h"
+#include "04_character_classification.h"
+#include "04_bulk_ctype.h"
+#include "04_ctype_tables.h"
+#include "04_wctype_cache.h"
+#include "05_string_utils.h"
+#include "05_string_builder.h"
+#include "05_collation_keys.h"
+#include "05_csv_reader.h"
+#include "06_character_set_handling.h"
+#include "07_locales.h"
+#include "12_output_sink.h"
+#include "09_searching_and_sorting.h"
+#include "19_mathematics.h"
+
+/* so the name is the function's name */
+#define DEMO(fn) { #fn, fn }
+
+/* error_reporting_demo ends with error(EXIT_FAILURE, ...), so it's last */
+static const section_demo error_demos[] = {
+    DEMO(errno_table_demo),
+    DEMO(error_log_demo),
+    DEMO(error_reporting_demo),
+    { NULL, NULL }
+};
+
+static const section_demo memory_demos[] = {
+    DEMO(get_memory_subsystem_info),
+    DEMO(virtual_memory_allocation_demo),
+    DEMO(paging_demo),
+    { NULL, NULL }
+};
+
+static const section_demo ctype_demos[] = {
+    DEMO(char_classification_demo),
+    DEMO(char_case_conversion_demo),
+    DEMO(ctype_bulk_demo),
+    DEMO(ctype_tables_demo),
+    DEMO(wchar_classification_demo),
+    DEMO(wchar_usage_demo),
+    DEMO(wchar_mapping_demo),
+    DEMO(wchar_cache_demo),
+    { NULL, NULL }
+};
+
+static const section_demo string_demos[] = {
+    DEMO(string_length_demo),
+    DEMO(string_copying_demo),
+    DEMO(string_concat_demo),
+    DEMO(string_builder_demo),
+    DEMO(string_truncate_demo),
+    DEMO(string_compare_demo),
+    DEMO(string_collate_demo),
+    DEMO(string_collate_keys_demo),
+    DEMO(string_search_demo),
+    DEMO(string_split_demo),
+    DEMO(string_csv_demo),
+    DEMO(string_erasing_demo),
+    DEMO(string_shuffle_demo),
+    DEMO(string_obfuscate_demo),
+    DEMO(string_encode_demo),
+    DEMO(string_argz_envz_demo),
+    { NULL, NULL }
+};
+
+static const section_demo charset_demos[] = {
+    DEMO(charset_run_demos),
+    { NULL, NULL }
+};
+
+static const section_demo locale_demos[] = {
+    DEMO(locales_run_demos),
+    { NULL, NULL }
+};
+
+/* the banner is the setup */
+static const section_demo search_demos[] = {
+    DEMO(search_compare_demo),
+    DEMO(search_array_demo),
+    DEMO(search_sort_demo),
+    DEMO(search_hash_demo),
+    DEMO(search_tree_demo),
+    { NULL, NULL }
+};
+
+static const section_demo stream_demos[] = {
+    DEMO(output_sink_demo),
+    { NULL, NULL }
+};
+
+static const section_demo math_demos[] = {
+    DEMO(mathematics_run_demos),
+    { NULL, NULL }
+};
+
+const section section_registry[] = {
+    /* error reporting exits with EXIT_FAILURE, that's part of the demo */
+    { 2,  "errors",  "Error Reporting",
+        NULL, error_demos, NULL, 1 },
+    { 3,  "memory",  "Virtual Memory Allocation",
+        NULL, memory_demos, NULL, 0 },
+    { 4,  "ctype",   "Character Handling",
+        NULL, ctype_demos, NULL, 0 },
+    { 5,  "strings", "String and Array Utilities",
+        NULL, string_demos, NULL, 0 },
+    { 6,  "charset", "Character Set Handling",
+        NULL, charset_demos, NULL, 0 },
+    { 7,  "locales", "Locales and Internationalization",
+        NULL, locale_demos, NULL, 0 },
+    { 9,  "search",  "Searching and Sorting",
+        search_sort_banner, search_demos, NULL, 0 },
+    { 12, "streams", "Input/Output on Streams",
+        NULL, stream_demos, NULL, 0 },
+    { 19, "math",    "Mathematics",
+        NULL, math_demos, NULL, 0 },
+};
+const size_t section_count = sizeof(section_registry)
+                                / sizeof(section_registry[0]);
+
+const section * section_find(const char * id_or_name)
+{
+    char * end;
+    long id = strtol(id_or_name, &end, 10);
+    _Bool numeric = end != id_or_name && *end == '\0';
+
+    for(size_t i = 0; i < section_count; i++)
+    {
+        if(numeric ? section_registry[i].id == id
+                   : strcmp(section_registry[i].name, id_or_name) == 0)
+            return &section_registry[i];
+    }
+    return NULL;
+}
+
+void section_run(const section * s)
+{
+    if(s->setup != NULL)
+        bench_untimed(s->setup);
+    for(const section_demo * d = s->demos; d->run != NULL; d++)
+    {
+        bench_demo(s->id, d->name, d->run);
+        /* a demo at a time, so a slow one doesn't hold up the ones before */
+        out_flush();
+    }
+    if(s->teardown != NULL)
+        bench_untimed(s->teardown);
+}
+
+static size_t count_demos(const section * s)
+{
+    size_t n = 0;
+    while(s->demos[n].run != NULL)
+        n++;
+    return n;
+}
+
+void section_run_parallel(const section * const * sections, size_t n,
+        int jobs)
+{
+    size_t total = 0;
+    for(size_t i = 0; i < n; i++)
+        total += count_demos(sections[i]);
+    pool_task * setups = calloc(n, sizeof(pool_task));
+    pool_task * teardowns = calloc(n, sizeof(pool_task));
+    pool_task * demos = calloc(total, sizeof(pool_task));
+    if(setups == NULL || teardowns == NULL || demos == NULL)
+        error(EXIT_FAILURE, errno, "section task allocation failed");
+
+    size_t d = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        setups[i].name = "setup";
+        setups[i].run = sections[i]->setup;
+        if(setups[i].run != NULL)
+            pool_capture(&setups[i]);
+        for(const section_demo * demo = sections[i]->demos; demo->run != NULL;
+                demo++, d++)
+        {
+            demos[d].name = demo->name;
+            demos[d].run = demo->run;
+        }
+    }
+
+    pool_run(demos, total, jobs);
+
+    for(size_t i = 0; i < n; i++)
+    {
+        teardowns[i].name = "teardown";
+        teardowns[i].run = sections[i]->teardown;
+        if(teardowns[i].run != NULL)
+            pool_capture(&teardowns[i]);
+    }
+
+    /* and out in the order the sequential run would have printed them */
+    d = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        size_t num_demos = count_demos(sections[i]);
+        pool_print(&setups[i], 1);
+        pool_print(&demos[d], num_demos);
+        pool_print(&teardowns[i], 1);
+        d += num_demos;
+    }
+
+    free(demos);
+    free(teardowns);
+    free(setups);
+}
+
+void section_list(void)
+{
+    printf("%-4s %-8s %-34s %s\n", "id", "name", "title", "demos");
+    for(size_t i = 0; i < section_count; i++)
+    {
+        const section * s = &section_registry[i];
+        printf("%-4d %-8s %-34s %zu%s\n", s->id, s->name, s->title,
+                count_demos(s), s->exits ? " (exits, always runs last)" : "");
+    }
+}
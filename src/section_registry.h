@@ -0,0 +1,43 @@
+#ifndef SECTION_REGISTRY_H
+#define SECTION_REGISTRY_H
+
+#include <stddef.h> /* size_t */
+
+/* one demo function of a section, the unit --bench times */
+typedef struct _section_demo {
+    const char * name;
+    void (*run)(void);
+} section_demo;
+
+/* everything main needs to know to run a section. setup and teardown may be
+ * NULL, demos ends with a { NULL, NULL } entry */
+typedef struct _section {
+    int id;                     /* chapter of the manual */
+    const char * name;          /* short name for --sections */
+    const char * title;         /* for --list */
+    void (*setup)(void);        /* before the first demo */
+    const section_demo * demos;
+    void (*teardown)(void);     /* after the last demo */
+    _Bool exits;                /* the demos end the process, run it last */
+} section;
+
+/* all of them, in chapter order */
+extern const section section_registry[];
+extern const size_t section_count;
+
+/* by number ("19", "05") or name ("math"), NULL if there's no such section */
+const section * section_find(const char * id_or_name);
+
+/* setup, every demo (each through the benchmark harness), teardown */
+void section_run(const section * s);
+
+/* the same for n sections at once with every demo in the task pool, jobs at
+ * a time. Setups run first and teardowns last, all in this process, and the
+ * output comes out in the order section_run would have printed it */
+void section_run_parallel(const section * const * sections, size_t n,
+        int jobs);
+
+/* the registry as a table, for --list */
+void section_list(void);
+
+#endif /* SECTION_REGISTRY_H */
@@ -0,0 +1,329 @@
+/* Startup profile
+ *
+ * Before the first demo prints anything, the kernel has mapped the program,
+ * ld.so has loaded libc and libm and relocated all three, the constructors
+ * have run, argp has parsed the arguments and stdout has been pointed at the
+ * output sink. --startup reports how long each of those took, with the minor
+ * page faults taken along the way (every page of code or data touched for
+ * the first time is one), on stderr so it doesn't mix with the output.
+ *
+ * Each phase ends at a startup_mark call. The earliest point this program's
+ * own code can mark is a constructor, which runs after ld.so is done, so
+ * exec, loading and linking only shows up when something outside started
+ * the clock. --startup-bench does that: it takes CLOCK_MONOTONIC (the same
+ * clock in every process) right before posix_spawn and hands it over in
+ * STARTUP_EXEC_ENV. The child sends its phases back down a pipe whose
+ * descriptor is in STARTUP_FD_ENV.
+ *
+ * Nothing here loads a locale or builds a table, and neither does anything
+ * else before the first section. setlocale and newlocale (through
+ * 07_locale_manager.c), the errno table, the special function tables and
+ * the wctype cache are all set up by the first demo that wants them, so
+ * running one section only pays for that one. A run with no sections is
+ * the startup cost alone, which is what the benchmark starts.
+ *
+ * Warm runs are the normal case of starting it twice in a row. Cold runs
+ * have the page cache dropped first, so the program and its libraries come
+ * from disk again. That goes through /proc/sys/vm/drop_caches, which needs
+ * root and empties the cache of the whole machine, slowing down everything
+ * else on it for a while. So cold runs only happen with --startup-cold.
+ * */
+#include "startup_profile.h"
+#include "bench.h"
+#include <stdio.h>      /* fprintf, printf, snprintf */
+#include <stdlib.h>     /* getenv, strtol, qsort, malloc, free */
+#include <string.h>     /* strchr, strdup */
+#include <unistd.h>     /* pipe, read, write, close, sync */
+#include <fcntl.h>      /* open, fcntl */
+#include <spawn.h>      /* posix_spawn */
+#include <sys/wait.h>   /* waitpid */
+#include <sys/resource.h>   /* getrusage */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+
+/* what the benchmark passes to the runs it starts */
+#define STARTUP_EXEC_ENV "LIBC_NOTES_EXEC_NS"
+#define STARTUP_FD_ENV "LIBC_NOTES_STARTUP_FD"
+
+#define STARTUP_MAX_MARKS 16
+
+/* how many of the --startup-bench runs are cold */
+#ifndef STARTUP_COLD_RUNS
+#define STARTUP_COLD_RUNS 5
+#endif
+
+startup_config startup_settings = {
+    .enabled = 0,
+    .runs = 0,
+    .cold = 0,
+};
+
+typedef struct _startup_phase {
+    const char * name;
+    long ns;            /* CLOCK_MONOTONIC when it ended */
+    long faults;        /* minor page faults by then */
+} startup_phase;
+
+static startup_phase phases[STARTUP_MAX_MARKS];
+static int num_phases;
+static long exec_ns = -1;   /* when the benchmark spawned us, if it did */
+
+static long monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void startup_mark(const char * phase)
+{
+    if(num_phases == STARTUP_MAX_MARKS)
+        return;
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    phases[num_phases].name = phase;
+    phases[num_phases].ns = monotonic_ns();
+    phases[num_phases].faults = ru.ru_minflt;
+    num_phases++;
+}
+
+/* as early as our code gets to run */
+__attribute__((constructor))
+static void startup_begin(void)
+{
+    const char * spawned = getenv(STARTUP_EXEC_ENV);
+    if(spawned != NULL)
+        exec_ns = strtol(spawned, NULL, 10);
+    startup_mark("exec, loading and linking");
+}
+
+/* phase i's time, -1 for the first one when nobody started the clock */
+static long phase_ns(int i)
+{
+    if(i > 0)
+        return phases[i].ns - phases[i - 1].ns;
+    return exec_ns >= 0 ? phases[0].ns - exec_ns : -1;
+}
+
+void startup_report(void)
+{
+    long start = exec_ns >= 0 ? exec_ns : phases[0].ns;
+    long total = phases[num_phases - 1].ns - start;
+
+    const char * fd_env = getenv(STARTUP_FD_ENV);
+    if(fd_env != NULL)
+    {
+        /* for the benchmark, a line per phase */
+        int fd = strtol(fd_env, NULL, 10);
+        char line[128];
+        for(int i = 0; i < num_phases; i++)
+        {
+            int n = snprintf(line, sizeof(line), "%s\t%ld\t%ld\n",
+                        phases[i].name, phase_ns(i), phases[i].faults
+                        - (i > 0 ? phases[i - 1].faults : 0));
+            if(write(fd, line, n) != n)
+                break;
+        }
+        close(fd);
+        return;
+    }
+    if(!startup_settings.enabled)
+        return;
+
+    fprintf(stderr, "startup, exec to the first section:\n");
+    fprintf(stderr, "\t%-28s %10s %8s\n", "phase", "us", "faults");
+    for(int i = 0; i < num_phases; i++)
+    {
+        long faults = phases[i].faults - (i > 0 ? phases[i - 1].faults : 0);
+        if(phase_ns(i) < 0)
+            fprintf(stderr, "\t%-28s %10s %8ld\n", phases[i].name, "?",
+                    faults);
+        else
+            fprintf(stderr, "\t%-28s %10.1f %8ld\n", phases[i].name,
+                    phase_ns(i) / 1e3, faults);
+    }
+    fprintf(stderr, "\t%-28s %10.1f %8ld\n", exec_ns >= 0 ? "total" :
+            "total since constructors", total / 1e3,
+            phases[num_phases - 1].faults);
+    if(exec_ns < 0)
+        fprintf(stderr, "\t(--startup-bench times exec and linking too)\n");
+}
+
+/* empty the page cache so the next run reads everything from disk. 0 if
+ * that isn't allowed */
+static int drop_page_cache(void)
+{
+    sync();
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+    if(fd < 0)
+        return 0;
+    int ok = write(fd, "1", 1) == 1;
+    close(fd);
+    return ok;
+}
+
+/* timings of every phase over the runs, the last row is the whole run */
+typedef struct _startup_samples {
+    const char * names[STARTUP_MAX_MARKS + 1];
+    int num_names;
+    double * us[STARTUP_MAX_MARKS + 1];
+    long faults[STARTUP_MAX_MARKS + 1];
+    int runs;
+} startup_samples;
+
+/* starts one run and adds its phases to samples */
+static void spawn_run(startup_samples * samples)
+{
+    int p[2];
+    if(pipe(p) != 0)
+        error(EXIT_FAILURE, errno, "pipe failed");
+    fcntl(p[0], F_SETFD, FD_CLOEXEC);
+
+    char exec_env[64];
+    char fd_env[64];
+    snprintf(fd_env, sizeof(fd_env), STARTUP_FD_ENV "=%d", p[1]);
+    char * envp[] = { exec_env, fd_env, NULL };
+    char * argv[] = { "libc_notes", "--startup", NULL };
+
+    /* its stdout and stderr go nowhere, it shouldn't print anything anyway */
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+            O_WRONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+
+    pid_t pid;
+    long start = monotonic_ns();
+    snprintf(exec_env, sizeof(exec_env), STARTUP_EXEC_ENV "=%ld", start);
+    int err = posix_spawn(&pid, "/proc/self/exe", &actions, NULL, argv,
+                envp);
+    if(err != 0)
+        error(EXIT_FAILURE, err, "posix_spawn failed");
+    close(p[1]);
+
+    char buf[4096];
+    size_t len = 0;
+    ssize_t n;
+    while(len < sizeof(buf) - 1
+            && (n = read(p[0], buf + len, sizeof(buf) - 1 - len)) > 0)
+        len += n;
+    buf[len] = '\0';
+    close(p[0]);
+    int status;
+    if(waitpid(pid, &status, 0) < 0)
+        error(EXIT_FAILURE, errno, "waitpid failed");
+    long whole = monotonic_ns() - start;
+    posix_spawn_file_actions_destroy(&actions);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        error(EXIT_FAILURE, 0, "a startup run failed, wait status %#x",
+                status);
+
+    /* "phase\tns\tfaults" per line, in the same order every run */
+    int row = 0;
+    for(char * line = buf; *line != '\0' && row < STARTUP_MAX_MARKS; row++)
+    {
+        char * tab = strchr(line, '\t');
+        char * end = strchr(line, '\n');
+        if(tab == NULL || end == NULL)
+            break;
+        *tab = '\0';
+        *end = '\0';
+        if(row == samples->num_names)
+        {
+            /* the names are string constants in the child, copy them */
+            samples->names[row] = strdup(line);
+            samples->num_names++;
+        }
+        char * field;
+        samples->us[row][samples->runs] = strtol(tab + 1, &field, 10) / 1e3;
+        samples->faults[row] += strtol(field, NULL, 10);
+        line = end + 1;
+    }
+    if(row == 0)
+        error(EXIT_FAILURE, 0, "a startup run didn't report its phases");
+    samples->us[STARTUP_MAX_MARKS][samples->runs] = whole / 1e3;
+    samples->runs++;
+}
+
+static int compare_doubles(const void * a, const void * b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_samples(const char * label, startup_samples * samples)
+{
+    printf("%s, %d runs:\n", label, samples->runs);
+    printf("\t%-28s %10s %10s %10s %8s\n", "phase", "min us", "median us",
+            "max us", "faults");
+    for(int i = 0; i <= STARTUP_MAX_MARKS; i++)
+    {
+        if(i >= samples->num_names && i < STARTUP_MAX_MARKS)
+            continue;
+        double * us = samples->us[i];
+        qsort(us, samples->runs, sizeof(double), compare_doubles);
+        const char * name = i < STARTUP_MAX_MARKS ? samples->names[i]
+                                                  : "whole run, spawn to exit";
+        printf("\t%-28s %10.1f %10.1f %10.1f", name, us[0],
+                us[samples->runs / 2], us[samples->runs - 1]);
+        if(i < STARTUP_MAX_MARKS)
+            printf(" %8ld", samples->faults[i] / samples->runs);
+        printf("\n");
+    }
+    printf("\n");
+}
+
+static void samples_init(startup_samples * samples, int runs)
+{
+    samples->num_names = 0;
+    samples->runs = 0;
+    for(int i = 0; i <= STARTUP_MAX_MARKS; i++)
+    {
+        samples->names[i] = NULL;
+        samples->faults[i] = 0;
+        samples->us[i] = malloc(runs * sizeof(double));
+        if(samples->us[i] == NULL)
+            error(EXIT_FAILURE, errno, "startup sample allocation failed");
+    }
+}
+
+static void samples_free(startup_samples * samples)
+{
+    for(int i = 0; i <= STARTUP_MAX_MARKS; i++)
+    {
+        free((char *)samples->names[i]);
+        free(samples->us[i]);
+    }
+}
+
+void startup_bench(void)
+{
+    int runs = startup_settings.runs;
+    startup_samples samples;
+
+    if(startup_settings.cold)
+    {
+        samples_init(&samples, STARTUP_COLD_RUNS);
+        int cold = 0;
+        for(int i = 0; i < STARTUP_COLD_RUNS && drop_page_cache();
+                i++, cold++)
+            spawn_run(&samples);
+        if(cold > 0)
+            print_samples("cold, page cache dropped before each", &samples);
+        else
+            printf("no cold runs, dropping the page cache needs root\n\n");
+        samples_free(&samples);
+    }
+
+    /* one to get it all back into the page cache */
+    samples_init(&samples, 1);
+    spawn_run(&samples);
+    samples_free(&samples);
+
+    samples_init(&samples, runs);
+    for(int i = 0; i < runs; i++)
+        spawn_run(&samples);
+    print_samples("warm", &samples);
+    samples_free(&samples);
+}
@@ -0,0 +1,28 @@
+#ifndef STARTUP_PROFILE_H
+#define STARTUP_PROFILE_H
+
+/* where the time goes between exec and the first section, for --startup and
+ * --startup-bench, see 25_program_arguments.c */
+
+typedef struct _startup_config {
+    _Bool enabled;      /* --startup, report this run's startup on stderr */
+    int runs;           /* --startup-bench=N, start the program N times */
+    _Bool cold;         /* --startup-cold, drop the page cache for a few */
+} startup_config;
+
+extern startup_config startup_settings;
+
+/* the named phase of startup ends now. The first one is marked by a
+ * constructor, before main */
+void startup_mark(const char * phase);
+
+/* the phases so far, on stderr with --startup, or to the benchmark that
+ * started this run. Call it right before the first section */
+void startup_report(void);
+
+/* starts this program startup_settings.runs times with --startup and no
+ * sections and prints each phase's median and the whole run's. With
+ * startup_settings.cold a few cold runs (page cache dropped) come first */
+void startup_bench(void);
+
+#endif /* STARTUP_PROFILE_H */
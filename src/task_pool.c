@@ -0,0 +1,170 @@
+/* Running demos side by side
+ *
+ * The demos were written to run one after another in one process, and they
+ * act like it: they print straight to stdout, some switch the global locale
+ * with setlocale, lgamma sets the global signgam, and a few keep static
+ * tables. Threads would share all of that, so each task here gets a process
+ * instead (fork is cheap, the pages are copy-on-write) with its stdout and
+ * stderr pointed at an anonymous in-memory file from memfd_create(2):
+ *
+ *      int memfd_create(const char *NAME, unsigned int FLAGS)
+ *
+ * The parent keeps up to jobs children going, reaping whichever finishes
+ * with waitpid(-1, ...), and reads each one's output back once it has
+ * exited. Printing them in task order afterwards gives the same output as
+ * the sequential run no matter which finished first.
+ *
+ * A child also gets whatever the parent had set up before the fork, so a
+ * section's setup can run in the parent once and every demo sees its result.
+ * */
+#include "task_pool.h"
+#include "12_output_sink.h"
+#include <stdio.h>      /* fflush, fprintf */
+#include <stdlib.h>     /* malloc, free, _exit */
+#include <unistd.h>     /* fork, dup, dup2, pread, sysconf */
+#include <sys/mman.h>   /* memfd_create */
+#include <sys/stat.h>   /* fstat */
+#include <sys/wait.h>   /* waitpid */
+#include <errno.h>      /* errno */
+#include <error.h>      /* error */
+
+static int output_file(const char * name)
+{
+    int fd = memfd_create(name, MFD_CLOEXEC);
+    if(fd < 0)
+        error(EXIT_FAILURE, errno, "memfd_create failed");
+    return fd;
+}
+
+/* everything written to fd, into the task, and close fd */
+static void collect_output(pool_task * task, int fd)
+{
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+        error(EXIT_FAILURE, errno, "fstat of %s's output failed", task->name);
+    task->output_len = st.st_size;
+    task->output = malloc(st.st_size + 1);
+    if(task->output == NULL)
+        error(EXIT_FAILURE, errno, "task output allocation failed");
+
+    size_t have = 0;
+    while(have < (size_t)st.st_size)
+    {
+        ssize_t n = pread(fd, task->output + have, st.st_size - have, have);
+        if(n <= 0)
+            error(EXIT_FAILURE, errno, "reading %s's output failed",
+                    task->name);
+        have += n;
+    }
+    task->output[have] = '\0';
+    close(fd);
+}
+
+size_t pool_run(pool_task * tasks, size_t n, int jobs)
+{
+    if(jobs < 1)
+        jobs = 1;
+    pid_t * pids = malloc(n * sizeof(pid_t));
+    int * fds = malloc(n * sizeof(int));
+    if(pids == NULL || fds == NULL)
+        error(EXIT_FAILURE, errno, "task pool allocation failed");
+
+    size_t next = 0;
+    size_t running = 0;
+    size_t failed = 0;
+    while(next < n || running > 0)
+    {
+        if(next < n && running < (size_t)jobs)
+        {
+            pool_task * task = &tasks[next];
+            fds[next] = output_file(task->name);
+            /* or whatever is buffered gets written once by every child */
+            out_flush();
+            fflush(NULL);
+            pid_t pid = fork();
+            if(pid < 0)
+                error(EXIT_FAILURE, errno, "fork failed");
+            if(pid == 0)
+            {
+                dup2(fds[next], STDOUT_FILENO);
+                dup2(fds[next], STDERR_FILENO);
+                task->run();
+                out_flush();
+                fflush(NULL);
+                _exit(EXIT_SUCCESS);
+            }
+            pids[next++] = pid;
+            running++;
+            continue;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if(pid < 0)
+            error(EXIT_FAILURE, errno, "waitpid failed");
+        size_t i = 0;
+        while(i < next && pids[i] != pid)
+            i++;
+        if(i == next)   /* not one of ours */
+            continue;
+        pids[i] = 0;
+        running--;
+        tasks[i].status = WIFEXITED(status) && WEXITSTATUS(status) == 0 ?
+                            0 : status;
+        if(tasks[i].status != 0)
+            failed++;
+        collect_output(&tasks[i], fds[i]);
+    }
+
+    free(fds);
+    free(pids);
+    return failed;
+}
+
+void pool_capture(pool_task * task)
+{
+    int fd = output_file(task->name);
+    out_flush();
+    fflush(NULL);
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    if(saved_out < 0 || saved_err < 0)
+        error(EXIT_FAILURE, errno, "dup failed");
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+
+    task->run();
+
+    out_flush();
+    fflush(NULL);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+    task->status = 0;
+    collect_output(task, fd);
+}
+
+void pool_print(pool_task * tasks, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        /* a task that printed nothing has no buffer at all */
+        if(tasks[i].output_len > 0)
+            fwrite(tasks[i].output, 1, tasks[i].output_len, stdout);
+        if(tasks[i].status != 0)
+            fprintf(stdout, "[%s failed, wait status %#x]\n", tasks[i].name,
+                    tasks[i].status);
+        free(tasks[i].output);
+        tasks[i].output = NULL;
+        tasks[i].output_len = 0;
+    }
+    out_flush();
+    fflush(stdout);
+}
+
+int pool_default_jobs(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
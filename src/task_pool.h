@@ -0,0 +1,29 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <stddef.h> /* size_t */
+
+/* a demo to run with its output kept aside */
+typedef struct _pool_task {
+    const char * name;
+    void (*run)(void);
+    char * output;      /* what it wrote to stdout and stderr, malloced */
+    size_t output_len;
+    int status;         /* 0, or the failed child's wait status */
+} pool_task;
+
+/* runs every task, at most jobs at once, each in a child process of its
+ * own with stdout and stderr going to a buffer. Returns the number of tasks
+ * that failed (exited non zero or died on a signal) */
+size_t pool_run(pool_task * tasks, size_t n, int jobs);
+
+/* runs one task right here, still collecting its output */
+void pool_capture(pool_task * task);
+
+/* writes the outputs to stdout in order and frees them */
+void pool_print(pool_task * tasks, size_t n);
+
+/* the number of CPUs online, what --jobs=0 means */
+int pool_default_jobs(void);
+
+#endif /* TASK_POOL_H */